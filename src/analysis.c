@@ -0,0 +1,418 @@
+/**
+ * @file analysis.c
+ *
+ * @brief Find the nullable rules and the FIRST and FOLLOW sets of the IR.
+ * Each of them is found with a work list. A rule is only looked at again
+ * when something that it depends on has changed, and the sets only grow, so
+ * it stops when the list is empty.
+ *
+ * An element with a min of 0 can match nothing. An element that repeats
+ * can be followed by its own FIRST set.
+ *
+ * The end of the input can follow the first rule and every other grammar
+ * rule that no rule refers to.
+ *
+ * @author Chuck Tilbury (chucktilbury@gmail.com)
+ * @version 0.0
+ * @date 2024-08-22
+ * @copyright Copyright (c) 2024
+ *
+ */
+#include "analysis.h"
+#include "memory.h"
+#include "vec.h"
+
+typedef struct {
+    int* list;
+    char* queued;
+    int size;
+    int head;
+    int count;
+} _work_list_t_;
+
+static void init_work(_work_list_t_* work, int size) {
+
+    work->list   = _ALLOC_DS_ARRAY(int, size);
+    work->queued = _ALLOC_DS_ARRAY(char, size);
+    work->size   = size;
+    work->head   = 0;
+    work->count  = 0;
+}
+
+static void free_work(_work_list_t_* work) {
+
+    _FREE(work->list);
+    _FREE(work->queued);
+}
+
+static void push_work(_work_list_t_* work, int item) {
+
+    if(!work->queued[item]) {
+        work->queued[item]                                    = 1;
+        work->list[(work->head + work->count++) % work->size] = item;
+    }
+}
+
+static int pop_work(_work_list_t_* work) {
+
+    if(work->count == 0)
+        return -1;
+
+    int item           = work->list[work->head];
+    work->head         = (work->head + 1) % work->size;
+    work->queued[item] = 0;
+    work->count--;
+
+    return item;
+}
+
+static IntVec** create_int_vecs(int num) {
+
+    IntVec** vecs = _ALLOC_DS_ARRAY(IntVec*, num);
+    for(int i = 0; i < num; i++)
+        vecs[i] = create_int_vec();
+
+    return vecs;
+}
+
+static void destroy_int_vecs(IntVec** vecs, int num) {
+
+    for(int i = 0; i < num; i++)
+        destroy_int_vec(vecs[i]);
+    _FREE(vecs);
+}
+
+/*
+ * A rule becomes nullable when one of its productions has nothing left in
+ * it that cannot match nothing. Each production keeps a count of those, and
+ * the productions that use a rule are counted down when it becomes nullable.
+ * The uses are the productions that refer to each rule, once for every time
+ * that they do.
+ */
+static void find_nullable(Analysis* an, IrGrammar* ir, IntVec** uses) {
+
+    int* pending = _ALLOC_DS_ARRAY(int, ir->num_prods);
+    _work_list_t_ work;
+    init_work(&work, ir->num_rules);
+
+    for(int i = 0; i < ir->num_prods; i++) {
+        IrProd* prod = ir->prods[i];
+        for(size_t j = 0; j < prod->elems->len; j++) {
+            IrElem* elem = prod->elems->list[j];
+            if(elem->min == 0 || elem->type == IR_LEFT)
+                continue;
+            // a terminal can never match nothing
+            pending[i] += (elem->type == IR_TERMINAL) ? ir->num_prods : 1;
+        }
+
+        if(pending[i] == 0 && !an->nullable[prod->rule]) {
+            an->nullable[prod->rule] = 1;
+            push_work(&work, prod->rule);
+        }
+    }
+
+    int rule;
+    while((rule = pop_work(&work)) >= 0) {
+        IntVec* vec = uses[rule];
+        for(size_t i = 0; i < vec->len; i++) {
+            IrProd* prod = ir->prods[vec->list[i]];
+            if(--pending[prod->id] == 0 && !an->nullable[prod->rule]) {
+                an->nullable[prod->rule] = 1;
+                push_work(&work, prod->rule);
+            }
+        }
+    }
+
+    for(int i = 0; i < ir->num_prods; i++)
+        an->prod_nullable[i] = (pending[i] == 0);
+
+    free_work(&work);
+    _FREE(pending);
+}
+
+/*
+ * When the FIRST set of a rule grows, the rules that use it are looked at
+ * again.
+ */
+static void find_first(Analysis* an, IrGrammar* ir, IntVec** uses) {
+
+    _work_list_t_ work;
+    init_work(&work, ir->num_rules);
+
+    for(int i = 0; i < ir->num_rules; i++)
+        push_work(&work, i);
+
+    int num;
+    while((num = pop_work(&work)) >= 0) {
+        IrRule* rule = ir->rules[num];
+        int changed  = 0;
+
+        for(size_t i = 0; i < rule->prods->len; i++) {
+            IrProd* prod = rule->prods->list[i];
+            first_of_elems(an, prod, 0, prod_first(an, prod->id));
+            changed |= union_bits(rule_first(an, num), prod_first(an, prod->id), an->words);
+        }
+
+        if(changed) {
+            IntVec* vec = uses[num];
+            for(size_t i = 0; i < vec->len; i++)
+                push_work(&work, ir->prods[vec->list[i]]->rule);
+        }
+    }
+
+    free_work(&work);
+}
+
+/*
+ * Everything that can come after a rule in a production is added to its
+ * FOLLOW set first. If the rest of the production can match nothing, then
+ * the FOLLOW set of the rule that the production belongs to is added too,
+ * which is done with a work list after that.
+ */
+static void find_follow(Analysis* an, IrGrammar* ir, IntVec** uses) {
+
+    IntVec** flows = create_int_vecs(ir->num_rules);
+    uint64_t* tmp  = _ALLOC_DS_ARRAY(uint64_t, an->words);
+    _work_list_t_ work;
+    init_work(&work, ir->num_rules);
+
+    for(int i = 0; i < ir->num_grammar_rules; i++)
+        if(i == 0 || uses[i]->len == 0)
+            set_bit(rule_follow(an, i), an->end);
+
+    for(int i = 0; i < ir->num_prods; i++) {
+        IrProd* prod = ir->prods[i];
+        for(size_t j = 0; j < prod->elems->len; j++) {
+            IrElem* elem = prod->elems->list[j];
+            if(elem->type != IR_RULE)
+                continue;
+
+            for(int k = 0; k < an->words; k++)
+                tmp[k] = 0;
+            int nullable = first_of_elems(an, prod, j + 1, tmp);
+            if(elem->max == IR_MANY)
+                union_bits(tmp, rule_first(an, elem->sym), an->words);
+            union_bits(rule_follow(an, elem->sym), tmp, an->words);
+
+            if(nullable && elem->sym != prod->rule)
+                append_int_vec(flows[prod->rule], elem->sym);
+        }
+    }
+
+    for(int i = 0; i < ir->num_rules; i++)
+        push_work(&work, i);
+
+    int num;
+    while((num = pop_work(&work)) >= 0) {
+        IntVec* vec = flows[num];
+        for(size_t i = 0; i < vec->len; i++)
+            if(union_bits(rule_follow(an, vec->list[i]), rule_follow(an, num), an->words))
+                push_work(&work, vec->list[i]);
+    }
+
+    free_work(&work);
+    _FREE(tmp);
+    destroy_int_vecs(flows, ir->num_rules);
+}
+
+/******************************************************************************
+ *
+ * Public Interface
+ *
+ */
+
+/**
+ * @brief Analyze the IR of the grammar that was loaded. The results are kept
+ * in the IR.
+ */
+void analyze_grammar(void) {
+
+    IrGrammar* ir = get_ir();
+    if(ir == NULL)
+        return;
+
+    destroy_analysis(ir->analysis);
+
+    Analysis* an      = _ALLOC_DS(Analysis);
+    an->end           = ir->num_terms;
+    an->words         = BITSET_WORDS(ir->num_terms + 1);
+    an->nullable      = _ALLOC_DS_ARRAY(char, ir->num_rules + 1);
+    an->first         = _ALLOC_DS_ARRAY(uint64_t, (size_t)ir->num_rules * an->words + 1);
+    an->follow        = _ALLOC_DS_ARRAY(uint64_t, (size_t)ir->num_rules * an->words + 1);
+    an->prod_nullable = _ALLOC_DS_ARRAY(char, ir->num_prods + 1);
+    an->prod_first    = _ALLOC_DS_ARRAY(uint64_t, (size_t)ir->num_prods * an->words + 1);
+
+    // the productions that refer to each rule
+    IntVec** uses = create_int_vecs(ir->num_rules);
+    for(int i = 0; i < ir->num_prods; i++) {
+        IrProd* prod = ir->prods[i];
+        for(size_t j = 0; j < prod->elems->len; j++) {
+            IrElem* elem = prod->elems->list[j];
+            if(elem->type == IR_RULE && elem->min > 0)
+                append_int_vec(uses[elem->sym], i);
+        }
+    }
+
+    find_nullable(an, ir, uses);
+
+    // the FIRST and FOLLOW sets depend on every use of a rule
+    for(int i = 0; i < ir->num_prods; i++) {
+        IrProd* prod = ir->prods[i];
+        for(size_t j = 0; j < prod->elems->len; j++) {
+            IrElem* elem = prod->elems->list[j];
+            if(elem->type == IR_RULE && elem->min == 0)
+                append_int_vec(uses[elem->sym], i);
+        }
+    }
+
+    find_first(an, ir, uses);
+    find_follow(an, ir, uses);
+
+    destroy_int_vecs(uses, ir->num_rules);
+    ir->analysis = an;
+}
+
+/**
+ * @brief Free the analysis.
+ *
+ * @param an
+ */
+void destroy_analysis(Analysis* an) {
+
+    if(an != NULL) {
+        _FREE(an->nullable);
+        _FREE(an->first);
+        _FREE(an->follow);
+        _FREE(an->prod_nullable);
+        _FREE(an->prod_first);
+        _FREE(an);
+    }
+}
+
+/**
+ * @brief Return the analysis of the grammar that was loaded, or NULL if
+ * there is none.
+ *
+ * @return Analysis*
+ */
+Analysis* get_analysis(void) {
+
+    IrGrammar* ir = get_ir();
+    return (ir != NULL) ? ir->analysis : NULL;
+}
+
+/**
+ * @brief Add the FIRST set of the elements of the production, from start to
+ * the end, to the set. Returns non-zero if all of them can match nothing.
+ *
+ * @param an
+ * @param prod
+ * @param start
+ * @param set
+ * @return int
+ */
+int first_of_elems(Analysis* an, IrProd* prod, size_t start, uint64_t* set) {
+
+    for(size_t i = start; i < prod->elems->len; i++) {
+        IrElem* elem = prod->elems->list[i];
+
+        if(elem->type == IR_LEFT)
+            continue;
+        else if(elem->type == IR_TERMINAL) {
+            set_bit(set, elem->sym);
+            if(elem->min > 0)
+                return 0;
+        }
+        else {
+            union_bits(set, rule_first(an, elem->sym), an->words);
+            if(elem->min > 0 && !an->nullable[elem->sym])
+                return 0;
+        }
+    }
+
+    return 1;
+}
+
+/**
+ * @brief Find the tokens that can start the element of the production that
+ * repeats or is optional, and can also come after it. Returns non-zero if
+ * there are any.
+ *
+ * @param an
+ * @param prod
+ * @param idx
+ * @param set
+ * @return int
+ */
+int elem_overlap(Analysis* an, IrProd* prod, size_t idx, uint64_t* set) {
+
+    IrElem* elem = prod->elems->list[idx];
+
+    if(first_of_elems(an, prod, idx + 1, set))
+        union_bits(set, rule_follow(an, prod->rule), an->words);
+    for(int i = 0; i < an->words; i++)
+        set[i] &= rule_first(an, elem->sym)[i];
+
+    return !empty_bits(set, an->words);
+}
+
+/*
+ * Returns non-zero if the element is a grammar rule that is matched one
+ * time and cannot match nothing.
+ */
+static int list_item(IrGrammar* ir, Analysis* an, IrElem* elem) {
+
+    return elem->type == IR_RULE && elem->min == 1 && elem->max == 1 &&
+           ir->rules[elem->sym]->parent < 0 && !an->nullable[elem->sym];
+}
+
+/**
+ * @brief Return the group of a list that is at the element of the
+ * production, or NULL. A separated list is a rule and then a group of a
+ * terminal and the same rule, like X ( ',' X )*, where the element is the
+ * first X. A terminated list is a group of a rule and a terminal, like
+ * ( X ';' )* or ( X ';' )+, where the element is the group. The list is
+ * only found where the parser stores its items and where the tokens that
+ * start the group cannot come after it.
+ *
+ * @param ir
+ * @param an
+ * @param prod
+ * @param idx
+ * @return IrRule*
+ */
+IrRule* list_group(IrGrammar* ir, Analysis* an, IrProd* prod, size_t idx) {
+
+    IrElemVec* elems = prod->elems;
+    IrElem* elem     = elems->list[idx];
+    int separated    = (elem->min == 1 && elem->max == 1);
+    size_t loop      = separated ? idx + 1 : idx;
+
+    if(ir->rules[prod->rule]->depth > 1 || loop >= elems->len)
+        return NULL;
+
+    IrElem* rep  = elems->list[loop];
+    IrRule* rule = (rep->type == IR_RULE) ? ir->rules[rep->sym] : NULL;
+    if(rule == NULL || rule->parent != prod->rule || rep->max != IR_MANY || rep->min > 1 ||
+       rule->prods->len != 1 || rule->prods->list[0]->elems->len != 2)
+        return NULL;
+
+    IrElemVec* items = rule->prods->list[0]->elems;
+    IrElem* item     = items->list[separated ? 1 : 0];
+    IrElem* term     = items->list[separated ? 0 : 1];
+    if(!list_item(ir, an, item) || term->type != IR_TERMINAL || term->min != 1 || term->max != 1)
+        return NULL;
+
+    if(separated) {
+        String* a = (elem->name != NULL) ? elem->name : elem->tok;
+        String* b = (item->name != NULL) ? item->name : item->tok;
+        if(!list_item(ir, an, elem) || elem->sym != item->sym || comp_string_string(a, b))
+            return NULL;
+    }
+
+    uint64_t* after = _ALLOC_DS_ARRAY(uint64_t, an->words);
+    int overlap     = elem_overlap(an, prod, loop, after);
+    _FREE(after);
+
+    return overlap ? NULL : rule;
+}
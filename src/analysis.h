@@ -0,0 +1,64 @@
+/**
+ * @file analysis.h
+ *
+ * @brief Public interface to the grammar analysis. For every rule in the IR,
+ * including the synthetic rules that were made from groups, it finds if the
+ * rule can match nothing and the sets of terminals that can start it and
+ * that can come after it.
+ *
+ * The sets are bitsets of terminal numbers. The bit after the last terminal
+ * stands for the end of the input.
+ *
+ * @author Chuck Tilbury (chucktilbury@gmail.com)
+ * @version 0.0
+ * @date 2024-08-22
+ * @copyright Copyright (c) 2024
+ *
+ */
+#ifndef _ANALYSIS_H_
+#define _ANALYSIS_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "bitset.h"
+#include "ir.h"
+
+typedef struct _analysis_ {
+    // the number of words in each set
+    int words;
+    // the bit for the end of the input
+    int end;
+    // by rule number
+    char* nullable;
+    uint64_t* first;
+    uint64_t* follow;
+    // by production number
+    char* prod_nullable;
+    uint64_t* prod_first;
+} Analysis;
+
+void analyze_grammar(void);
+void destroy_analysis(Analysis* an);
+Analysis* get_analysis(void);
+
+int first_of_elems(Analysis* an, IrProd* prod, size_t start, uint64_t* set);
+int elem_overlap(Analysis* an, IrProd* prod, size_t idx, uint64_t* set);
+IrRule* list_group(IrGrammar* ir, Analysis* an, IrProd* prod, size_t idx);
+
+static inline uint64_t* rule_first(Analysis* an, int rule) {
+
+    return &an->first[(size_t)rule * an->words];
+}
+
+static inline uint64_t* rule_follow(Analysis* an, int rule) {
+
+    return &an->follow[(size_t)rule * an->words];
+}
+
+static inline uint64_t* prod_first(Analysis* an, int prod) {
+
+    return &an->prod_first[(size_t)prod * an->words];
+}
+
+#endif /* _ANALYSIS_H_ */
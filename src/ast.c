@@ -76,6 +76,77 @@ AstNode* create_ast_node(AstNodeType type) {
     return ptr;
 }
 
+static void destroy_ast_list(PtrLst* lst) {
+
+    int mark = 0;
+    AstNode* node;
+
+    while(NULL != (node = iterate_ptr_lst(lst, &mark)))
+        destroy_ast(node);
+    destroy_ptr_lst(lst);
+}
+
+/**
+ * @brief Free a node and everything under it.
+ *
+ * @param node
+ */
+void destroy_ast(AstNode* node) {
+
+    if(node == NULL)
+        return;
+
+    switch(node->type) {
+        case AST_TERMINAL:
+            destroy_string(((ast_terminal_t*)node)->tok);
+            destroy_string(((ast_terminal_t*)node)->name);
+            break;
+        case AST_NON_TERMINAL:
+            destroy_string(((ast_non_terminal_t*)node)->tok);
+            destroy_string(((ast_non_terminal_t*)node)->name);
+            break;
+        case AST_ZERO_OR_ONE:
+            destroy_ast((AstNode*)((ast_zero_or_one_t*)node)->group);
+            break;
+        case AST_ONE_OR_MORE:
+            destroy_ast((AstNode*)((ast_one_or_more_t*)node)->group);
+            break;
+        case AST_ZERO_OR_MORE:
+            destroy_ast((AstNode*)((ast_zero_or_more_t*)node)->group);
+            break;
+        case AST_GROUP:
+            destroy_ast((AstNode*)((ast_group_t*)node)->prod);
+            break;
+        case AST_GRAMMAR:
+            destroy_ast_list(((ast_grammar_t*)node)->list);
+            break;
+        case AST_RULE:
+            destroy_string(((ast_rule_t*)node)->name);
+            destroy_ast((AstNode*)((ast_rule_t*)node)->list);
+            break;
+        case AST_PRODUCTION_LIST: {
+            ProdVec* vec = ((ast_production_list_t*)node)->list;
+            for(size_t i = 0; i < vec->len; i++)
+                destroy_ast((AstNode*)vec->list[i]);
+            destroy_prod_vec(vec);
+        } break;
+        case AST_PRODUCTION: {
+            ElemVec* vec = ((ast_production_t*)node)->list;
+            for(size_t i = 0; i < vec->len; i++)
+                destroy_ast((AstNode*)vec->list[i]);
+            destroy_elem_vec(vec);
+        } break;
+        case AST_PROD_ELEM:
+            destroy_ast(((ast_prod_elem_t*)node)->node);
+            break;
+        default:
+            fprintf(stderr, "FATAL: invalid state in %s: %d\n", __func__, node->type);
+            abort();
+    }
+
+    _FREE(node);
+}
+
 void ast_terminal(ast_terminal_t* node, AstPassFunc pre, AstPassFunc post) {
 
     CALL_PRE(node);
@@ -129,10 +200,8 @@ void ast_production_list(ast_production_list_t* node, AstPassFunc pre, AstPassFu
     CALL_PRE(node);
 
     AST_TRACE("%s", ast_node_type_to_str(node->type.type));
-    int mark = 0;
-    struct _ast_production_* prod;
-    while(NULL != (prod = iterate_ptr_lst(node->list, &mark)))
-        ast_production(prod, pre, post);
+    for(size_t i = 0; i < node->list->len; i++)
+        ast_production(node->list->list[i], pre, post);
     state_count++;
 
     CALL_POST(node);
@@ -143,10 +212,8 @@ void ast_production(ast_production_t* node, AstPassFunc pre, AstPassFunc post) {
     CALL_PRE(node);
 
     AST_TRACE("%s", ast_node_type_to_str(node->type.type));
-    int mark = 0;
-    struct _ast_prod_elem_* elem;
-    while(NULL != (elem = iterate_ptr_lst(node->list, &mark)))
-        ast_prod_elem(elem, pre, post);
+    for(size_t i = 0; i < node->list->len; i++)
+        ast_prod_elem(node->list->list[i], pre, post);
     state_count++;
 
     CALL_POST(node);
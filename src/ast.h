@@ -6,6 +6,7 @@
 
 #include "ptr_lst.h"
 #include "str.h"
+#include "vec.h"
 
 typedef enum {
     // defined by the grammar grammar
@@ -24,6 +25,11 @@ typedef enum {
 } AstNodeType;
 
 
+// most productions have a few elements and most rules have a few
+// productions, so these are kept in the node until they grow
+VEC_TYPE(ElemVec, elem_vec, struct _ast_prod_elem_*, 4)
+VEC_TYPE(ProdVec, prod_vec, struct _ast_production_*, 4)
+
 typedef struct _ast_node_ {
     AstNodeType type;
 } AstNode;
@@ -32,12 +38,17 @@ typedef struct _ast_terminal_ {
     AstNode type;
     String* tok;
     String* name;
+    // dense terminal number set by resolve_symbols()
+    int id;
 } ast_terminal_t;
 
 typedef struct _ast_non_terminal_ {
     AstNode type;
     String* tok;
     String* name;
+    // the rule that is referenced, set by resolve_symbols()
+    int id;
+    struct _ast_rule_* rule;
 } ast_non_terminal_t;
 
 typedef struct _ast_zero_or_one_ {
@@ -65,6 +76,10 @@ typedef struct _ast_grammar_ {
     AstNode type;
     // List of rules.
     PtrLst* list;
+    // created by resolve_symbols()
+    struct _symbol_table_* symbols;
+    // created by lower_grammar()
+    struct _ir_grammar_* ir;
 } ast_grammar_t;
 
 typedef struct _ast_rule_ {
@@ -72,18 +87,20 @@ typedef struct _ast_rule_ {
     // a rule definition
     String* name;
     struct _ast_production_list_* list;
+    // dense rule number set by resolve_symbols()
+    int id;
 } ast_rule_t;
 
 typedef struct _ast_production_list_ {
     AstNode type;
     // list of productions
-    PtrLst* list;
+    ProdVec* list;
 } ast_production_list_t;
 
 typedef struct _ast_production_ {
     AstNode type;
     // list of ast_prod_elem_t
-    PtrLst* list;
+    ElemVec* list;
 } ast_production_t;
 
 typedef struct _ast_prod_elem_ {
@@ -97,6 +114,7 @@ typedef int (*AstPassFunc)(AstNode*);
 
 void traverse_ast(AstPassFunc pre, AstPassFunc post);
 AstNode* create_ast_node(AstNodeType type);
+void destroy_ast(AstNode* node);
 
 void ast_terminal(ast_terminal_t* node, AstPassFunc pre, AstPassFunc post);
 void ast_non_terminal(ast_non_terminal_t* node, AstPassFunc pre, AstPassFunc post);
@@ -0,0 +1,68 @@
+/**
+ * @file bitset.h
+ *
+ * @brief Sets of small numbers, such as terminal numbers, packed into 64 bit
+ * words. A set is an array of words and the caller keeps the number of words
+ * that each set has.
+ *
+ * @author Chuck Tilbury (chucktilbury@gmail.com)
+ * @version 0.0
+ * @date 2024-08-22
+ * @copyright Copyright (c) 2024
+ *
+ */
+#ifndef _BITSET_H_
+#define _BITSET_H_
+
+#include <stdint.h>
+
+// the number of words in a set that can hold 0 to n - 1
+#define BITSET_WORDS(n) (((n) + 63) / 64)
+
+static inline void set_bit(uint64_t* set, int bit) {
+
+    set[bit >> 6] |= (uint64_t)1 << (bit & 63);
+}
+
+static inline int test_bit(const uint64_t* set, int bit) {
+
+    return (set[bit >> 6] >> (bit & 63)) & 1;
+}
+
+/*
+ * Add everything in src to dst. Returns non-zero if dst changed.
+ */
+static inline int union_bits(uint64_t* dst, const uint64_t* src, int words) {
+
+    uint64_t changed = 0;
+
+    for(int i = 0; i < words; i++) {
+        changed |= src[i] & ~dst[i];
+        dst[i] |= src[i];
+    }
+
+    return changed != 0;
+}
+
+/*
+ * Returns non-zero if the sets have nothing in common.
+ */
+static inline int disjoint_bits(const uint64_t* a, const uint64_t* b, int words) {
+
+    for(int i = 0; i < words; i++)
+        if(a[i] & b[i])
+            return 0;
+
+    return 1;
+}
+
+static inline int empty_bits(const uint64_t* set, int words) {
+
+    for(int i = 0; i < words; i++)
+        if(set[i] != 0)
+            return 0;
+
+    return 1;
+}
+
+#endif /* _BITSET_H_ */
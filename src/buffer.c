@@ -17,6 +17,7 @@
 #include "buffer.h"
 #include "memory.h"
 #include "myassert.h"
+#include "simd.h"
 
 #define MIN(l, r) (((l) < (r)) ? (l) : (r))
 
@@ -95,6 +96,20 @@ void destroy_buffer(Buffer* buf) {
     }
 }
 
+/**
+ * @brief Make room for at least length more bytes, so that adding them does
+ * not need to allocate.
+ *
+ * @param buf
+ * @param length
+ */
+void reserve_buffer(Buffer* buf, size_t length) {
+
+    ASSERT(buf != NULL);
+
+    resize_buffer(buf, length);
+}
+
 /**
  * @brief Add the bytes to the end of the buffer. Resize the buffer as needed.
  *
@@ -279,19 +294,9 @@ void* clip_buffer(Buffer* buf, int start, int end) {
  */
 int search_buffer(Buffer* buf, void* bytes, size_t len) {
 
-    int retv = -1;
+    size_t idx = search_bytes(buf->buffer, buf->length, bytes, len);
 
-    if(buf->length >= len) {
-        int run = buf->length - len;
-        for(int i = 0; i <= run; i++) {
-            if(!memcmp(&buf->buffer[i], bytes, len)) {
-                retv = i;
-                break;
-            }
-        }
-    }
-
-    return retv;
+    return (idx == SEARCH_NONE) ? -1 : (int)idx;
 }
 
 /**
@@ -22,6 +22,7 @@ typedef struct {
 
 Buffer* create_buffer(void* bytes, size_t length);
 void destroy_buffer(Buffer* buf);
+void reserve_buffer(Buffer* buf, size_t length);
 void append_buffer(Buffer* buf, void* bytes, size_t length);
 void prepend_buffer(Buffer* buf, void* bytes, size_t length);
 void insert_buffer(Buffer* buf, void* bytes, size_t len, int index);
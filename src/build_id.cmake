@@ -0,0 +1,25 @@
+# Write build_id.h with a hash of the sources of the generator. It is run
+# by the build every time that one of them changes, and the header is only
+# written when the hash is different, so version.c is only compiled again
+# when it has to be.
+#
+#   cmake -DSOURCES="a.c|b.c|..." -DOUTPUT=build_id.h -P build_id.cmake
+
+string(REPLACE "|" ";" files "${SOURCES}")
+set(text "")
+foreach(name ${files})
+    file(SHA1 ${name} hash)
+    string(APPEND text "${hash}")
+endforeach()
+
+string(SHA1 id "${text}")
+string(SUBSTRING ${id} 0 16 id)
+set(content "#define PARGEN_BUILD_ID \"${id}\"\n")
+
+set(old "")
+if(EXISTS ${OUTPUT})
+    file(READ ${OUTPUT} old)
+endif()
+if(NOT old STREQUAL content)
+    file(WRITE ${OUTPUT} "${content}")
+endif()
@@ -159,7 +159,9 @@ static int parse_short(void) {
 
             case 1:
                 // expect a command option or EOS, else error
-                if(isprint(ch) && !is_a_token(ch)) {
+                if(ch == EOS)
+                    state = 100;
+                else if(isprint(ch) && !is_a_token(ch)) {
                     opt = search_short(ch);
                     if(opt != NULL) {
                         if(opt->callback != NULL)
@@ -173,8 +175,6 @@ static int parse_short(void) {
                             opt->flag |= CMD_SEEN;
                         consume_char();
                     }
-                    else if(ch == EOS)
-                        state = 100;
                     else
                         error("unknown short command option: '%s'", crnt_opt());
                 }
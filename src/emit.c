@@ -1,8 +1,15 @@
 /**
  * @file emit.c
  *
- * @brief This is the over all emitter that retrieves the emitter
- * configuration from the command line parser and calls the other emitters.
+ * @brief This is the over all emitter that calls the other emitters with the
+ * names of the files that they generate.
+ *
+ * Generated files are built in memory and only written to the disk when the
+ * content is different from what is already there. That way the time stamp
+ * on an output only changes when the content does and the build system does
+ * not rebuild things that did not change. An output that did not change but
+ * is older than one of the inputs has its time set to now, so that make
+ * sees that it is up to date and does not run the generator again.
  *
  * @author Chuck Tilbury (chucktilbury@gmail.com)
  * @version 0.0
@@ -10,25 +17,373 @@
  * @copyright Copyright (c) 2024
  *
  */
+#define _POSIX_C_SOURCE 200809L
+#include <errno.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <utime.h>
 
+#include "emit.h"
 #include "emit_ast_header.h"
 #include "emit_ast_source.h"
 #include "emit_parse_header.h"
 #include "emit_parse_source.h"
+#include "fragment.h"
+#include "memory.h"
+#include "module.h"
+#include "ptr_lst.h"
+#include "str.h"
+#include "str_lst.h"
+#include "template.h"
+
+typedef struct {
+    String* name;
+    FILE* fh;
+    char* buffer;
+    size_t size;
+} _output_t_;
+
+// outputs that were opened by the current call to emit()
+static PtrLst* outputs = NULL;
+
+// outputs that could not be opened by the current call to emit()
+static int output_errors = 0;
+
+/*
+ * Return non-zero if the file on disk does not hold exactly the bytes in
+ * the buffer.
+ */
+static int is_different(const char* name, const char* buffer, size_t size) {
+
+    FILE* fp = fopen(name, "rb");
+    if(fp == NULL)
+        return 1;
+
+    int retv = 1;
+    if(fseek(fp, 0, SEEK_END) == 0 && (size_t)ftell(fp) == size) {
+        rewind(fp);
+        char* tmp = _ALLOC(size + 1);
+        if(fread(tmp, 1, size, fp) == size)
+            retv = memcmp(tmp, buffer, size) != 0;
+        _FREE(tmp);
+    }
+    fclose(fp);
+
+    return retv;
+}
+
+static int is_older(struct timespec a, struct timespec b) {
+
+    return a.tv_sec < b.tv_sec || (a.tv_sec == b.tv_sec && a.tv_nsec < b.tv_nsec);
+}
 
-void emit(void) {
+/*
+ * Return the time of the newest file in the list, or zero.
+ */
+static struct timespec newest_input(StrLst* inputs) {
+
+    struct timespec newest = {0, 0};
+    int mark               = 0;
+    String* str;
+    struct stat st;
+
+    while(inputs != NULL && NULL != (str = iterate_str_lst(inputs, &mark)))
+        if(stat(raw_string(str), &st) == 0 && is_older(newest, st.st_mtim))
+            newest = st.st_mtim;
+
+    return newest;
+}
+
+/*
+ * Write the output if the content changed. Returns 1 if the file was written,
+ * zero if it did not change and -1 if it could not be written. An output
+ * that did not change is touched if it is older than the newest input.
+ */
+static int write_output(_output_t_* out, struct timespec newest) {
+
+    const char* name = raw_string(out->name);
+    if(!is_different(name, out->buffer, out->size)) {
+        struct stat st;
+        if(stat(name, &st) == 0 && is_older(st.st_mtim, newest) && utime(name, NULL) != 0) {
+            fprintf(stderr, "error: cannot touch output file: '%s': %s\n", name, strerror(errno));
+            return -1;
+        }
+        return 0;
+    }
+
+    // Write a new file and rename it over the old one, so that a file that
+    // is hard linked into the output cache is never written through.
+    String* tmp = create_string(name);
+    append_string_str(tmp, ".tmp");
+
+    int retv = 1;
+    FILE* fp = fopen(raw_string(tmp), "wb");
+    if(fp == NULL) {
+        fprintf(stderr, "error: cannot open output file: '%s': %s\n", name, strerror(errno));
+        retv = -1;
+    }
+    else {
+        fwrite(out->buffer, 1, out->size, fp);
+        if(fclose(fp) != 0 || rename(raw_string(tmp), name) != 0) {
+            fprintf(stderr, "error: cannot write output file: '%s': %s\n", name,
+                    strerror(errno));
+            remove(raw_string(tmp));
+            retv = -1;
+        }
+    }
+    destroy_string(tmp);
+
+    return retv;
+}
 
-    emit_ast_header();
+/**
+ * @brief Call all of the emitters. The outputs are built in memory and they
+ * are not written until write_outputs() is called. Returns the number of
+ * outputs that could not be made.
+ *
+ * @param ast_name
+ * @param parse_name
+ * @param memo the rules that the parser memoizes, or NULL
+ * @param elide leave the nodes that only pass one child through out of the AST
+ * @return int
+ */
+int emit(const char* ast_name, const char* parse_name, const char* memo, int elide) {
+
+    destroy_outputs();
+    outputs       = create_ptr_lst();
+    output_errors = 0;
+
+    emit_ast_header(ast_name, elide);
     emit_ast_source();
-    emit_parse_header();
-    emit_parse_source();
+    emit_parse_header(parse_name, ast_name);
+    emit_parse_source(parse_name, memo, elide);
+
+    // rules that are not in the grammar any more
+    prune_fragments(get_fragments());
+
+    return output_errors;
+}
+
+/**
+ * @brief Write every output whose content is different from the file that
+ * is on the disk. The ones that are the same are touched if they are older
+ * than one of the inputs, which can be NULL. Returns the number of files
+ * that were written, or -1 if one of them could not be written. The others
+ * are written anyway.
+ *
+ * @param inputs
+ * @return int
+ */
+int write_outputs(StrLst* inputs) {
+
+    struct timespec newest = newest_input(inputs);
+    int changed            = 0;
+    int failed             = 0;
+    int mark               = 0;
+    _output_t_* out;
+
+    while(outputs != NULL && NULL != (out = iterate_ptr_lst(outputs, &mark))) {
+        int retv = write_output(out, newest);
+        if(retv < 0)
+            failed++;
+        else
+            changed += retv;
+    }
+
+    if(failed > 0)
+        return -1;
+
+    return changed;
+}
+
+/**
+ * @brief Free the outputs.
+ */
+void destroy_outputs(void) {
+
+    if(outputs != NULL) {
+        int mark = 0;
+        _output_t_* out;
+        while(NULL != (out = iterate_ptr_lst(outputs, &mark))) {
+            if(out->fh != NULL)
+                fclose(out->fh);
+            destroy_string(out->name);
+            free(out->buffer); // allocated by open_memstream()
+            _FREE(out);
+        }
+        destroy_ptr_lst(outputs);
+        outputs = NULL;
+    }
 }
 
-void emit_block(FILE* fh, const char* const* block) {
+/**
+ * @brief Free the outputs and the templates that the emitters compiled. This
+ * is what the emitters keep between calls to emit().
+ */
+void destroy_emitters(void) {
 
-    for(int i = 0; block[i] != NULL; i++) {
-        fprintf(fh, "%s\n", block[i]);
-    } 
-}
\ No newline at end of file
+    destroy_outputs();
+    destroy_ast_header_templates();
+    destroy_parse_header_template();
+    destroy_parse_source_template();
+}
+
+/**
+ * @brief Render a template with the data into an output.
+ *
+ * @param fh
+ * @param tpl
+ * @param data
+ */
+void emit_template(FILE* fh, Template* tpl, TplData* data) {
+
+    if(fh == NULL)
+        return; // open_output() failed and said so
+
+    String* str = create_string(NULL);
+    render_template(tpl, data, str);
+    fwrite(raw_string(str), 1, str->length, fh);
+    destroy_string(str);
+}
+
+/*
+ * Write a file name the way make and ninja expect it in a depfile.
+ */
+static void write_dep_name(FILE* fh, const char* name) {
+
+    for(const char* ptr = name; *ptr != '\0'; ptr++) {
+        if(*ptr == ' ' || *ptr == '#' || *ptr == '\\')
+            fputc('\\', fh);
+        else if(*ptr == '$')
+            fputc('$', fh);
+        fputc(*ptr, fh);
+    }
+}
+
+/**
+ * @brief Return the name and content of the outputs that were generated by
+ * the last call to emit(), one at a time. The mark must be zero for the first
+ * call. Returns zero when there are no more.
+ *
+ * @param mark
+ * @param name
+ * @param buffer
+ * @param size
+ * @return int
+ */
+int iterate_outputs(int* mark, const char** name, const char** buffer, size_t* size) {
+
+    _output_t_* out = (outputs != NULL) ? iterate_ptr_lst(outputs, mark) : NULL;
+    if(out == NULL)
+        return 0;
+
+    *name   = raw_string(out->name);
+    *buffer = out->buffer;
+    *size   = out->size;
+
+    return 1;
+}
+
+/**
+ * @brief Write a depfile that says the targets depend on every file in the
+ * list of inputs. Every input also gets a rule with no prerequisites so that
+ * make does not fail when an included file is removed from the grammar. Like
+ * the other outputs, it is written by write_outputs(). Returns non-zero if
+ * the output could not be made.
+ *
+ * @param name
+ * @param targets
+ * @param inputs
+ * @return int
+ */
+int emit_depfile(const char* name, StrLst* targets, StrLst* inputs) {
+
+    if(outputs == NULL)
+        outputs = create_ptr_lst();
+
+    FILE* fh = open_output(name);
+    if(fh == NULL)
+        return 1;
+
+    int mark = 0;
+    String* str;
+    while(NULL != (str = iterate_str_lst(targets, &mark))) {
+        if(mark > 1)
+            fputc(' ', fh);
+        write_dep_name(fh, raw_string(str));
+    }
+    fputc(':', fh);
+
+    mark = 0;
+    while(NULL != (str = iterate_str_lst(inputs, &mark))) {
+        fprintf(fh, " \\\n  ");
+        write_dep_name(fh, raw_string(str));
+    }
+    fputc('\n', fh);
+
+    mark = 0;
+    while(NULL != (str = iterate_str_lst(inputs, &mark))) {
+        fputc('\n', fh);
+        write_dep_name(fh, raw_string(str));
+        fprintf(fh, ":\n");
+    }
+
+    close_output(fh);
+
+    return 0;
+}
+
+/**
+ * @brief Open an output file. The stream that is returned writes to memory
+ * and the file is written by write_outputs(). Returns NULL if the stream
+ * cannot be made. The error is counted and returned by emit(), and the
+ * functions in this file do nothing with a NULL stream.
+ *
+ * @param name
+ * @return FILE*
+ */
+FILE* open_output(const char* name) {
+
+    _output_t_* out = _ALLOC_DS(_output_t_);
+    out->fh         = open_memstream(&out->buffer, &out->size);
+    if(out->fh == NULL) {
+        fprintf(stderr, "error: cannot create output stream: '%s': %s\n", name, strerror(errno));
+        output_errors++;
+        _FREE(out);
+        return NULL;
+    }
+    out->name = create_string(name);
+
+    append_ptr_lst(outputs, out);
+    return out->fh;
+}
+
+/**
+ * @brief Close a stream returned by open_output(). The content is kept in
+ * memory until the outputs are written or freed.
+ *
+ * @param fh
+ */
+void close_output(FILE* fh) {
+
+    if(fh == NULL)
+        return;
+
+    int mark = 0;
+    _output_t_* out;
+
+    while(NULL != (out = iterate_ptr_lst(outputs, &mark))) {
+        if(out->fh == fh)
+            break;
+    }
+
+    if(out == NULL) {
+        fprintf(stderr, "Fatal internal error: %s: stream is not an output\n", __func__);
+        abort();
+    }
+
+    fclose(out->fh);
+    out->fh = NULL;
+}
@@ -16,7 +16,18 @@
 
 #include <stdio.h>
 
-void emit(void);
-void emit_block(FILE* fh, const char* const* block);
+#include "str_lst.h"
+#include "template.h"
+
+int emit(const char* ast_name, const char* parse_name, const char* memo, int elide);
+int write_outputs(StrLst* inputs);
+void destroy_outputs(void);
+void destroy_emitters(void);
+int emit_depfile(const char* name, StrLst* targets, StrLst* inputs);
+void emit_template(FILE* fh, Template* tpl, TplData* data);
+
+FILE* open_output(const char* name);
+void close_output(FILE* fh);
+int iterate_outputs(int* mark, const char** name, const char** buffer, size_t* size);
 
 #endif  /* _EMIT_H_ */
@@ -1,9 +1,17 @@
 /**
  * @file emit_ast_header.c
  *
- * @brief This is a AST traverse pass that emits the AST source code and the
- * AST header file. This relies on the command line features to retrieve the
- * configuration.
+ * @brief This emits the AST header file. The data structures for the rules
+ * are made from the grammar IR. The struct for a rule is only made again when
+ * the lowered form of the rule changed. Otherwise the text that was made the
+ * last time is taken from the fragment store.
+ *
+ * When the nodes that only pass one child through are elided, a field that
+ * refers to a rule that can do that is an AstNode*, because the node that is
+ * in it can be the child. The type in the node tells which one it is.
+ *
+ * The items of a list that list_group() finds are kept in an array that is
+ * the size of the list, with a field for the count.
  *
  * @author Chuck Tilbury (chucktilbury@gmail.com)
  * @version 0.0
@@ -11,351 +19,451 @@
  * @copyright Copyright (c) 2024
  *
  */
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-#include <errno.h>
-#include <time.h>
 
-#include "emit.h"
+#include "analysis.h"
 #include "ast.h"
+#include "emit.h"
+#include "fragment.h"
+#include "hash.h"
+#include "ir.h"
+#include "memory.h"
+#include "module.h"
 #include "str.h"
 #include "str_lst.h"
-#include "cmdline.h"
-
-static const char* file_pre[] = {
-    " */",
-    "#ifndef _EMIT_AST_HEADER_H_",
-    "#define _EMIT_AST_HEADER_H_",
-    "",
-    "#include \"ptr_lst.h\"",
-    "#include \"str.h\"",
-    "",
-    "void traverse_ast(AstPassFunc pre, AstPassFunc post);",
-    "AstNode* create_ast_node(AstNodeType type);",
-    "",
-    "typedef int (*AstPassFunc)(AstNode*);",
-    "",
-    NULL
-};
-
-static const char* ds_pre[] = {
-    "/*",
-    " * These data structures are determined by the input file syntax.",
-    " */",
-    "typedef struct _ast_node_ {",
-    "    AstNodeType type;",
-    "} AstNode;",
-    "",
-    "typedef struct _ast_terminal_ {",
-    "    AstNode type;",
-    "    String* tok;",
-    "    String* name;",
-    "} ast_terminal_t;",
-    "",
-    "typedef struct _ast_non_terminal_ {",
-    "    AstNode type;",
-    "    String* tok;",
-    "    String* name;",
-    "} ast_non_terminal_t;",
-    "",
-    "typedef struct _ast_zero_or_one_ {",
-    "    AstNode type;",
-    "    struct _ast_group_* group;",
-    "} ast_zero_or_one_t;",
-    "",
-    "typedef struct _ast_one_or_more_ {",
-    "    AstNode type;",
-    "    struct _ast_group_* group;",
-    "} ast_one_or_more_t;",
-    "",
-    "typedef struct _ast_zero_or_more_ {",
-    "    AstNode type;",
-    "    struct _ast_group_* group;",
-    "} ast_zero_or_more_t;",
-    "",
-    "typedef struct _ast_group_ {",
-    "    AstNode type;",
-    "    // list of one or more ast_prod_elem_t",
-    "    struct _ast_production_* prod;",
-    "} ast_group_t;",
-    "",
-    "typedef struct _ast_production_list_ {",
-    "    AstNode type;",
-    "    // list of productions",
-    "    PtrLst* list;",
-    "} ast_production_list_t;",
-    "",
-    "typedef struct _ast_production_ {",
-    "    AstNode type;",
-    "    // list of ast_prod_elem_t",
-    "    PtrLst* list;",
-    "} ast_production_t;",
-    "",
-    "typedef struct _ast_prod_elem_ {",
-    "    AstNode type;",
-    "    // a single item that could be a repetition function, another",
-    "    // non-terminal or a terminal",
-    "    AstNode* node;",
-    "} ast_prod_elem_t;",
-    "",
-    "typedef struct _ast_grammar_ {",
-    "    AstNode type;",
-    "    // List of rules.",
-    "    PtrLst* list;",
-    "} ast_grammar_t;",
-    "",
-    "typedef struct _ast_rule_ {",
-    "    AstNode type;",
-    "    // a rule definition",
-    "    String* name;",
-    "    struct _ast_production_list_* list;",
-    "} ast_rule_t;",
-    "",
-    "/*",
-    " * User defined non-terminals.",
-    " */",
-    NULL
-};
-
-static const char* file_post[] = {
-    "",
-    "#endif /* _EMIT_AST_HEADER_H_ */",
-    "",
-    "/*",
-    " * End of generated file.",
-    " */",
-    "",
-    NULL
-};
-
-static const char* types_pre[] = {
-    "typedef enum {",
-    "    /*",
-    "     * These are a result of the input grammar syntax.",
-    "     */",
-    "    AST_TERMINAL = 100,",
-    "    AST_NON_TERMINAL,",
-    "    AST_ZERO_OR_ONE,",
-    "    AST_ONE_OR_MORE,",
-    "    AST_ZERO_OR_MORE,",
-    "    AST_GROUP,",
-    "    AST_PRODUCTION_LIST,",
-    "    AST_PRODUCTION,",
-    "    AST_PROD_ELEM,",
-    "    AST_GRAMMAR,",
-    "    AST_RULE,",
-    "",
-    "    /*",
-    "     * These are from the user's input grammar.",
-    "     */",
-    NULL
-};
-
-static const char* types_post[] = {
-    "} AstNodeType;\n\n",
-    NULL
-};
-
-static const char* protos[] = {
-    "/*",
-    " * These protos are defined by the syntax of the input file.",
-    " */",
-    "void ast_terminal(ast_terminal_t* node, AstPassFunc pre, AstPassFunc post);",
-    "void ast_non_terminal(ast_non_terminal_t* node, AstPassFunc pre, AstPassFunc post);",
-    "void ast_grammar(ast_grammar_t* node, AstPassFunc pre, AstPassFunc post);",
-    "void ast_rule(ast_rule_t* node, AstPassFunc pre, AstPassFunc post);",
-    "void ast_production_list(ast_production_list_t* node, AstPassFunc pre, AstPassFunc post);",
-    "void ast_production(ast_production_t* node, AstPassFunc pre, AstPassFunc post);",
-    "void ast_prod_elem(ast_prod_elem_t* node, AstPassFunc pre, AstPassFunc post);",
-    "void ast_zero_or_one(ast_zero_or_one_t* node, AstPassFunc pre, AstPassFunc post);",
-    "void ast_one_or_more(ast_one_or_more_t* node, AstPassFunc pre, AstPassFunc post);",
-    "void ast_zero_or_more(ast_zero_or_more_t* node, AstPassFunc pre, AstPassFunc post);",
-    "void ast_group(ast_group_t* node, AstPassFunc pre, AstPassFunc post);",
-    "",
-    "/*",
-    " * These protos are defined by the input grammar.",
-    " */",
-    NULL
-};
+#include "template.h"
+
+/*
+ * The header is rendered from this template. There is one item in the list
+ * of non-terminals for every name in the sorted list and one item in the
+ * list of rules for every grammar rule, with the text of its struct.
+ */
+static const char* header_text =
+    "/*\n"
+    " * This file is generated by pargen. Changes will be lost.\n"
+    " */\n"
+    "#ifndef _EMIT_AST_HEADER_H_\n"
+    "#define _EMIT_AST_HEADER_H_\n"
+    "\n"
+    "#include \"ptr_lst.h\"\n"
+    "#include \"str.h\"\n"
+    "\n"
+    "void traverse_ast(AstPassFunc pre, AstPassFunc post);\n"
+    "AstNode* create_ast_node(AstNodeType type);\n"
+    "\n"
+    "typedef int (*AstPassFunc)(AstNode*);\n"
+    "\n"
+    "typedef enum {\n"
+    "    /*\n"
+    "     * These are a result of the input grammar syntax.\n"
+    "     */\n"
+    "    AST_TERMINAL = 100,\n"
+    "    AST_NON_TERMINAL,\n"
+    "    AST_ZERO_OR_ONE,\n"
+    "    AST_ONE_OR_MORE,\n"
+    "    AST_ZERO_OR_MORE,\n"
+    "    AST_GROUP,\n"
+    "    AST_PRODUCTION_LIST,\n"
+    "    AST_PRODUCTION,\n"
+    "    AST_PROD_ELEM,\n"
+    "    AST_GRAMMAR,\n"
+    "    AST_RULE,\n"
+    "\n"
+    "    /*\n"
+    "     * These are from the user's input grammar.\n"
+    "     */\n"
+    "{{#each nterms}}\n"
+    "    AST_{{upper}},\n"
+    "{{/each}}\n"
+    "} AstNodeType;\n"
+    "\n"
+    "\n"
+    "/*\n"
+    " * These data structures are determined by the input file syntax.\n"
+    " */\n"
+    "typedef struct _ast_node_ {\n"
+    "    AstNodeType type;\n"
+    "} AstNode;\n"
+    "\n"
+    "typedef struct _ast_terminal_ {\n"
+    "    AstNode type;\n"
+    "    String* tok;\n"
+    "    String* name;\n"
+    "} ast_terminal_t;\n"
+    "\n"
+    "typedef struct _ast_non_terminal_ {\n"
+    "    AstNode type;\n"
+    "    String* tok;\n"
+    "    String* name;\n"
+    "} ast_non_terminal_t;\n"
+    "\n"
+    "typedef struct _ast_zero_or_one_ {\n"
+    "    AstNode type;\n"
+    "    struct _ast_group_* group;\n"
+    "} ast_zero_or_one_t;\n"
+    "\n"
+    "typedef struct _ast_one_or_more_ {\n"
+    "    AstNode type;\n"
+    "    struct _ast_group_* group;\n"
+    "} ast_one_or_more_t;\n"
+    "\n"
+    "typedef struct _ast_zero_or_more_ {\n"
+    "    AstNode type;\n"
+    "    struct _ast_group_* group;\n"
+    "} ast_zero_or_more_t;\n"
+    "\n"
+    "typedef struct _ast_group_ {\n"
+    "    AstNode type;\n"
+    "    // list of one or more ast_prod_elem_t\n"
+    "    struct _ast_production_* prod;\n"
+    "} ast_group_t;\n"
+    "\n"
+    "typedef struct _ast_production_list_ {\n"
+    "    AstNode type;\n"
+    "    // list of productions\n"
+    "    PtrLst* list;\n"
+    "} ast_production_list_t;\n"
+    "\n"
+    "typedef struct _ast_production_ {\n"
+    "    AstNode type;\n"
+    "    // list of ast_prod_elem_t\n"
+    "    PtrLst* list;\n"
+    "} ast_production_t;\n"
+    "\n"
+    "typedef struct _ast_prod_elem_ {\n"
+    "    AstNode type;\n"
+    "    // a single item that could be a repetition function, another\n"
+    "    // non-terminal or a terminal\n"
+    "    AstNode* node;\n"
+    "} ast_prod_elem_t;\n"
+    "\n"
+    "typedef struct _ast_grammar_ {\n"
+    "    AstNode type;\n"
+    "    // List of rules.\n"
+    "    PtrLst* list;\n"
+    "} ast_grammar_t;\n"
+    "\n"
+    "typedef struct _ast_rule_ {\n"
+    "    AstNode type;\n"
+    "    // a rule definition\n"
+    "    String* name;\n"
+    "    struct _ast_production_list_* list;\n"
+    "} ast_rule_t;\n"
+    "\n"
+    "/*\n"
+    " * User defined non-terminals.\n"
+    " */\n"
+    "{{#each rules}}\n"
+    "{{struct}}\n"
+    "\n"
+    "{{/each}}\n"
+    "/*\n"
+    " * These protos are defined by the syntax of the input file.\n"
+    " */\n"
+    "void ast_terminal(ast_terminal_t* node, AstPassFunc pre, AstPassFunc post);\n"
+    "void ast_non_terminal(ast_non_terminal_t* node, AstPassFunc pre, AstPassFunc post);\n"
+    "void ast_grammar(ast_grammar_t* node, AstPassFunc pre, AstPassFunc post);\n"
+    "void ast_rule(ast_rule_t* node, AstPassFunc pre, AstPassFunc post);\n"
+    "void ast_production_list(ast_production_list_t* node, AstPassFunc pre, AstPassFunc post);\n"
+    "void ast_production(ast_production_t* node, AstPassFunc pre, AstPassFunc post);\n"
+    "void ast_prod_elem(ast_prod_elem_t* node, AstPassFunc pre, AstPassFunc post);\n"
+    "void ast_zero_or_one(ast_zero_or_one_t* node, AstPassFunc pre, AstPassFunc post);\n"
+    "void ast_one_or_more(ast_one_or_more_t* node, AstPassFunc pre, AstPassFunc post);\n"
+    "void ast_zero_or_more(ast_zero_or_more_t* node, AstPassFunc pre, AstPassFunc post);\n"
+    "void ast_group(ast_group_t* node, AstPassFunc pre, AstPassFunc post);\n"
+    "\n"
+    "/*\n"
+    " * These protos are defined by the input grammar.\n"
+    " */\n"
+    "{{#each nterms}}\n"
+    "void ast_{{name}}(ast_{{name}}_t* node, AstPassFunc pre, AstPassFunc post);\n"
+    "{{/each}}\n"
+    "\n"
+    "#endif /* _EMIT_AST_HEADER_H_ */\n"
+    "\n"
+    "/*\n"
+    " * End of generated file.\n"
+    " */\n"
+    "\n";
+
+static const char* struct_text =
+    "typedef struct _ast_{{name}}_ {\n"
+    "    AstNode type;\n"
+    "{{#each fields}}\n"
+    "    {{type}} {{field}};\n"
+    "{{/each}}\n"
+    "} ast_{{name}}_t;";
 
 /*
- * These are the lists that were generated when the parser ran.
+ * This is the list that was generated when the parser ran.
  */
-extern StrLst* terms;
 extern StrLst* nterms;
 
-// output file handle for the ast header file that is generated by this module.
-static FILE* outfile = NULL;
-static int in_rule = 0;
-static int in_group = 0;
+// the templates are compiled the first time that they are used
+static Template* header_tpl = NULL;
+static Template* struct_tpl = NULL;
+// the struct that is being made and the names of the fields in it
+static TplData* ds_data  = NULL;
+static HashTable* fields = NULL;
+// the rules whose node can be elided, or NULL
+static char* passes = NULL;
 
+/*
+ * A field is only written the first time that its name is seen in a struct.
+ * The productions of a rule share the fields that have the same name. A name
+ * that is used again in one production was given a number by
+ * name_ir_fields(), so it is a field of its own.
+ */
+static void emit_field(const char* type, const char* name) {
 
-static int _error(const char* fn, int state) {
-    fprintf(stderr, "Fatal internal error: invalid state in %s: %d\n", fn, state);
-    abort();
+    if(insert_hashtable(fields, name, NULL, 0) == HASH_OK) {
+        TplData* item = add_tpl_item(ds_data, "fields");
+        set_tpl_str(item, "type", type);
+        set_tpl_str(item, "field", name);
+    }
 }
 
-static int dummy(void) {
-    // do nothing.
-    return 0;
-}
+static void emit_term_field(IrElem* elem) {
 
-static int pre_rule(AstNode* node) {
+    if(raw_string(elem->tok)[0] != 'S')
+        emit_field("TokenType", raw_string(elem->field));
+    else
+        emit_field("String*", raw_string(elem->field));
+}
 
-    fprintf(outfile, "typedef struct _ast_%s_ {\n    AstNode type;\n", 
-            raw_string(((ast_rule_t*)node)->name));
-    in_rule++;
+/*
+ * The type of the field that refers to a grammar rule.
+ */
+static void ref_type(IrRule* ref, String* type) {
 
-    return 0;
+    clear_string(type);
+    if(passes != NULL && passes[ref->id])
+        append_string_str(type, "AstNode*");
+    else
+        append_string_fmt(type, "struct _ast_%s_*", raw_string(ref->name));
 }
 
-static int post_rule(AstNode* node) {
+/*
+ * The array of the items of a list and the count of them. The terminal that
+ * separates them has its field where it had one before.
+ */
+static void emit_list_fields(IrGrammar* ir, IrProd* prod, size_t idx, IrRule* list) {
 
-    fprintf(outfile, "} ast_%s_t;\n\n", 
-            raw_string(((ast_rule_t*)node)->name));
-    in_rule--;
+    int separated    = (prod->elems->list[idx]->sym != list->id);
+    IrElemVec* items = list->prods->list[0]->elems;
+    IrElem* item     = items->list[separated ? 1 : 0];
+    String* name     = item->field;
+    String* field    = create_string(NULL);
+    String* type     = create_string(NULL);
 
-    return 0;
-}
+    ref_type(ir->rules[item->sym], type);
+    append_string_char(type, '*');
+    append_string_fmt(field, "%s_items", raw_string(name));
+    emit_field(raw_string(type), raw_string(field));
 
-static int pre_group() {
+    clear_string(field);
+    append_string_fmt(field, "%s_count", raw_string(name));
+    emit_field("size_t", raw_string(field));
 
-    in_group++;
-    return 0;
-}
+    if(list->depth == 1)
+        emit_term_field(items->list[separated ? 0 : 1]);
 
-static int post_group() {
-    
-    in_group--;
-    return 0;
+    destroy_string(type);
+    destroy_string(field);
 }
 
-static int pre_nterm(AstNode* node) {
-
-    if(in_rule > 0 && in_group < 2) {
-        const char* tok = raw_string(((ast_non_terminal_t*)node)->tok);
-        const char* name = raw_string(((ast_non_terminal_t*)node)->name);
-        fprintf(outfile, "    struct _ast_%s_* %s;\n", tok, name? name: tok);
+/*
+ * The fields of a rule are the symbols in its productions and the symbols
+ * in the groups right under them. Groups that are nested deeper than that
+ * are not part of the struct.
+ */
+static void emit_fields(IrGrammar* ir, IrRule* rule) {
+
+    for(size_t i = 0; i < rule->prods->len; i++) {
+        IrProd* prod = rule->prods->list[i];
+        for(size_t j = 0; j < prod->elems->len; j++) {
+            IrElem* elem = prod->elems->list[j];
+            IrRule* ref  = (elem->type != IR_TERMINAL) ? ir->rules[elem->sym] : NULL;
+
+            IrRule* list = (ref != NULL) ? list_group(ir, get_analysis(), prod, j) : NULL;
+
+            if(list != NULL) {
+                emit_list_fields(ir, prod, j, list);
+                // the loop of a separated list is the next element
+                j += (elem->sym != list->id);
+            }
+            else if(elem->type == IR_TERMINAL)
+                emit_term_field(elem);
+            else if(ref->parent < 0) {
+                String* type = create_string(NULL);
+                ref_type(ref, type);
+                emit_field(raw_string(type), raw_string(elem->field));
+                destroy_string(type);
+            }
+            else if(ref->depth == 1)
+                emit_fields(ir, ref);
+        }
     }
-
-    return 0;
 }
 
-static int pre_term(AstNode* node) {
+/*
+ * Make the struct for a grammar rule.
+ */
+static String* make_ds(IrGrammar* ir, IrRule* rule) {
 
-    if(in_rule > 0 && in_group < 2) {
-        String* str = ((ast_terminal_t*)node)->tok;
-        String* tmp = copy_string(str);
-        lower_string(tmp);
-        const char* tstr = raw_string(tmp);
+    String* str = create_string(NULL);
+    ds_data     = create_tpl_data();
+    fields      = create_hashtable();
 
-        if(tstr[0] != 's')
-            fprintf(outfile, "    TokenType %s_type;\n", &tstr[4]);
-        else
-            fprintf(outfile, "    String* %s_str;\n", &tstr[4]);
-        destroy_string(tmp);
-    }
+    set_tpl_string(ds_data, "name", rule->name);
+    emit_fields(ir, rule);
+    render_template(struct_tpl, ds_data, str);
 
-    return 0;
-}
+    destroy_hashtable(fields);
+    destroy_tpl_data(ds_data);
+    fields  = NULL;
+    ds_data = NULL;
 
-static int ast_ds_pre(AstNode* node) {
-
-    return (node->type == AST_TERMINAL)         ? pre_term(node) :
-            (node->type == AST_NON_TERMINAL) ? pre_nterm(node) :
-            (node->type == AST_ZERO_OR_ONE)     ? dummy() :
-            (node->type == AST_ONE_OR_MORE)     ? dummy() :
-            (node->type == AST_ZERO_OR_MORE)    ? dummy() :
-            (node->type == AST_GROUP)           ? pre_group() :
-            (node->type == AST_GRAMMAR)         ? dummy() :
-            (node->type == AST_RULE)            ? pre_rule(node) :
-            (node->type == AST_PRODUCTION_LIST) ? dummy() :
-            (node->type == AST_PRODUCTION)      ? dummy() :
-            (node->type == AST_PROD_ELEM)       ? dummy() :
-                                                  _error(__func__, node->type);
+    return str;
 }
 
-static int ast_ds_post(AstNode* node) {
-
-    return (node->type == AST_TERMINAL)         ? dummy() :
-            (node->type == AST_NON_TERMINAL) ? dummy() :
-            (node->type == AST_ZERO_OR_ONE)     ? dummy() :
-            (node->type == AST_ONE_OR_MORE)     ? dummy() :
-            (node->type == AST_ZERO_OR_MORE)    ? dummy() :
-            (node->type == AST_GROUP)           ? post_group() :
-            (node->type == AST_GRAMMAR)         ? dummy() :
-            (node->type == AST_RULE)            ? post_rule(node) :
-            (node->type == AST_PRODUCTION_LIST) ? dummy() :
-            (node->type == AST_PRODUCTION)      ? dummy() :
-            (node->type == AST_PROD_ELEM)       ? dummy() :
-                                                  _error(__func__, node->type);
+/*
+ * The names of the rules that the fields refer to and whose node can be
+ * elided. The struct changes when one of them changes.
+ */
+static void elided_refs(IrGrammar* ir, IrRule* rule, String* str) {
+
+    for(size_t i = 0; i < rule->prods->len; i++) {
+        IrProd* prod = rule->prods->list[i];
+        for(size_t j = 0; j < prod->elems->len; j++) {
+            IrElem* elem = prod->elems->list[j];
+            IrRule* ref  = (elem->type != IR_TERMINAL) ? ir->rules[elem->sym] : NULL;
+
+            if(ref != NULL && ref->parent < 0 && passes[ref->id])
+                append_string_fmt(str, "%s ", raw_string(ref->name));
+            else if(ref != NULL && ref->depth == 1)
+                elided_refs(ir, ref, str);
+        }
+    }
 }
 
-static void emit_ds(void) {
-
-    emit_block(outfile, ds_pre);
-    traverse_ast(ast_ds_pre, ast_ds_post);
+/*
+ * Where the lists of the rule are. They depend on what can come after the
+ * rule, so the struct can change when the rule did not.
+ */
+static void list_marks(IrGrammar* ir, IrRule* rule, String* str) {
+
+    for(size_t i = 0; i < rule->prods->len; i++) {
+        IrProd* prod = rule->prods->list[i];
+        for(size_t j = 0; j < prod->elems->len; j++) {
+            IrElem* elem = prod->elems->list[j];
+            if(elem->type == IR_TERMINAL)
+                continue;
+            if(list_group(ir, get_analysis(), prod, j) != NULL)
+                append_string_fmt(str, "list %s %zu %zu ", raw_string(rule->name), i, j);
+            else if(ir->rules[elem->sym]->depth == 1 && ir->rules[elem->sym]->parent >= 0)
+                list_marks(ir, ir->rules[elem->sym], str);
+        }
+    }
 }
 
-static void emit_protos(void) {
-
-    int mark = 0;
-    String* str;
-
-    emit_block(outfile, protos);
-
-    while(NULL != (str = iterate_str_lst(nterms, &mark))) {
-        const char* tpt = raw_string(str);
-        fprintf(outfile, "void ast_%s(ast_%s_t* node, AstPassFunc pre, AstPassFunc post);\n",
-            tpt, tpt);
+/*
+ * Add the rules to the data for the header. The struct for a rule is taken
+ * from the fragment store if the rule and the template did not change.
+ */
+static void add_rules(TplData* data, const char* fname) {
+
+    IrGrammar* ir    = get_ir();
+    Fragments* frags = get_fragments();
+    String* key      = create_string(NULL);
+    uint64_t tpl_fp  = hash_bytes(struct_text, strlen(struct_text));
+
+    for(int i = 0; i < ir->num_grammar_rules; i++) {
+        IrRule* rule = ir->rules[i];
+        uint64_t fp  = fingerprint_rule(ir, rule) ^ tpl_fp;
+
+        clear_string(key);
+        if(passes != NULL) {
+            append_string_str(key, "elide ");
+            elided_refs(ir, rule, key);
+        }
+        list_marks(ir, rule, key);
+        if(key->length > 0)
+            fp ^= hash_bytes(raw_string(key), key->length);
+
+        clear_string(key);
+        append_string_fmt(key, "%s/%s", fname, raw_string(rule->name));
+
+        String* str = find_fragment(frags, raw_string(key), fp);
+        if(str == NULL) {
+            str = make_ds(ir, rule);
+            save_fragment(frags, raw_string(key), fp, str);
+        }
+
+        set_tpl_string(add_tpl_item(data, "rules"), "struct", str);
     }
+
+    destroy_string(key);
 }
 
-static void emit_type_list(void) {
+/*
+ * The node types and the protos are in the order of the sorted list of
+ * non-terminals.
+ */
+static void add_nterms(TplData* data) {
 
     int mark = 0;
     String* str;
 
-    emit_block(outfile, types_pre);
-
     while(NULL != (str = iterate_str_lst(nterms, &mark))) {
-        String* cpy_ptr = copy_string(str);
-        upper_string(cpy_ptr);
-        fprintf(outfile, "    AST_%s,\n", raw_string(cpy_ptr));
-        destroy_string(cpy_ptr);
-    }
+        String* upper = copy_string(str);
+        upper_string(upper);
 
-    emit_block(outfile, types_post);
+        TplData* item = add_tpl_item(data, "nterms");
+        set_tpl_string(item, "name", str);
+        set_tpl_string(item, "upper", upper);
+        destroy_string(upper);
+    }
 }
 
-void emit_ast_header(void) {
-
-    String* str = create_string(get_cmdline("ast_name"));
-    append_string_str(str, ".h");
+void emit_ast_header(const char* name, int elide) {
 
-    outfile = fopen(raw_string(str), "w");
-    if(outfile == NULL) {
-        fprintf(stderr, "Fatal error: cannot open output file: '%s': %s\n",
-                raw_string(str), strerror(errno));
-        exit(1);
+    if(header_tpl == NULL) {
+        header_tpl = create_template("ast header", header_text);
+        struct_tpl = create_template("ast struct", struct_text);
     }
-    clear_string(str);
 
-    time_t t = time(NULL);
-
-    fprintf(outfile, "/*\n");
-    char* tmp = ctime(&t);
-    tmp[strlen(tmp)-1] = '\0';
-    fprintf(outfile, " * File generated on %s.\n", tmp);
-    emit_block(outfile, file_pre);
+    String* str = create_string(name);
+    append_string_str(str, ".h");
 
-    emit_type_list();
+    // The file is only written when the content changes, so there is no
+    // time stamp in it.
+    TplData* data = create_tpl_data();
+    passes        = elide ? find_pass_through(get_ir()) : NULL;
+    add_nterms(data);
+    add_rules(data, raw_string(str));
+    _FREE(passes);
+    passes = NULL;
 
-    emit_ds();
-    emit_protos();
+    FILE* outfile = open_output(raw_string(str));
+    emit_template(outfile, header_tpl, data);
+    close_output(outfile);
 
-    emit_block(outfile, file_post);
+    destroy_tpl_data(data);
     destroy_string(str);
 }
 
+/**
+ * @brief Free the templates. They are compiled again the next time that the
+ * header is emitted.
+ */
+void destroy_ast_header_templates(void) {
+
+    destroy_template(header_tpl);
+    destroy_template(struct_tpl);
+    header_tpl = NULL;
+    struct_tpl = NULL;
+}
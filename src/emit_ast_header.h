@@ -12,6 +12,7 @@
 #ifndef _EMIT_AST_HEADER_H_
 #define _EMIT_AST_HEADER_H_
 
-void emit_ast_header(void);
+void emit_ast_header(const char* name, int elide);
+void destroy_ast_header_templates(void);
 
 #endif  /* _EMIT_AST_HEADER_H_ */
@@ -1,8 +1,9 @@
 /**
  * @file emit_parse_header.c
  *
- * @brief This emits the parser source code. It is a pass on the AST that
- * emits the source file and the header file.
+ * @brief This emits the parser header file. It has the token numbers, the
+ * functions that the scanner has to supply and the entry point of the
+ * parser.
  *
  * @author Chuck Tilbury (chucktilbury@gmail.com)
  * @version 0.0
@@ -12,53 +13,100 @@
  */
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
-#include "ast.h"
+#include "emit.h"
+#include "emit_parse_header.h"
+#include "ir.h"
+#include "str.h"
+#include "template.h"
 
-static int error(const char* fn, int state) {
-    fprintf(stderr, "Fatal internal error: invalid state in %s: %d\n", fn, state);
-    abort();
-}
+/*
+ * The token numbers are the terminal numbers, so the end of the input is
+ * the one after the last terminal.
+ */
+static const char* header_text =
+    "/*\n"
+    " * This file is generated by pargen. Changes will be lost.\n"
+    " */\n"
+    "#ifndef _EMIT_PARSE_HEADER_H_\n"
+    "#define _EMIT_PARSE_HEADER_H_\n"
+    "\n"
+    "typedef enum {\n"
+    "{{#each terms}}\n"
+    "    {{name}},\n"
+    "{{/each}}\n"
+    "    END_OF_INPUT,\n"
+    "} TokenType;\n"
+    "\n"
+    "#include \"{{ast_header}}\"\n"
+    "\n"
+    "/*\n"
+    " * These are supplied by the scanner. A mark is a place in the input that\n"
+    " * the parser can go back to. A parser that memoizes rules also goes\n"
+    " * forward to a mark, past the tokens that a saved result matched.\n"
+    " */\n"
+    "TokenType crnt_token(void);\n"
+    "String* crnt_token_str(void);\n"
+    "void consume_token(void);\n"
+    "int mark_tokens(void);\n"
+    "void reset_tokens(int mark);\n"
+    "\n"
+    "/*\n"
+    " * Parse the whole input. Returns NULL if there is a syntax error.\n"
+    " */\n"
+    "ast_{{start}}_t* run_parser(void);\n"
+    "\n"
+    "#endif /* _EMIT_PARSE_HEADER_H_ */\n"
+    "\n"
+    "/*\n"
+    " * End of generated file.\n"
+    " */\n"
+    "\n";
 
-static int dummy(void) {
-    // do nothing.
-    return 0;
-}
+static Template* header_tpl = NULL;
 
-static int parse_header_pre(AstNode* node) {
+/*
+ * The generated files are included by their names, without the directory.
+ */
+static const char* base_name(const char* name) {
 
-    return (node->type == AST_TERMINAL)         ? dummy() :
-            (node->type == AST_NON_TERMINAL) ? dummy() :
-            (node->type == AST_ZERO_OR_ONE)     ? dummy() :
-            (node->type == AST_ONE_OR_MORE)     ? dummy() :
-            (node->type == AST_ZERO_OR_MORE)    ? dummy() :
-            (node->type == AST_GROUP)           ? dummy() :
-            (node->type == AST_GRAMMAR)         ? dummy() :
-            (node->type == AST_RULE)            ? dummy() :
-            (node->type == AST_PRODUCTION_LIST) ? dummy() :
-            (node->type == AST_PRODUCTION)      ? dummy() :
-            (node->type == AST_PROD_ELEM)       ? dummy() :
-                                                  error(__func__, node->type);
+    const char* ptr = strrchr(name, '/');
+    return (ptr != NULL) ? ptr + 1 : name;
 }
 
-static int parse_header_post(AstNode* node) {
+void emit_parse_header(const char* name, const char* ast_name) {
 
-    return (node->type == AST_TERMINAL)         ? dummy() :
-            (node->type == AST_NON_TERMINAL) ? dummy() :
-            (node->type == AST_ZERO_OR_ONE)     ? dummy() :
-            (node->type == AST_ONE_OR_MORE)     ? dummy() :
-            (node->type == AST_ZERO_OR_MORE)    ? dummy() :
-            (node->type == AST_GROUP)           ? dummy() :
-            (node->type == AST_GRAMMAR)         ? dummy() :
-            (node->type == AST_RULE)            ? dummy() :
-            (node->type == AST_PRODUCTION_LIST) ? dummy() :
-            (node->type == AST_PRODUCTION)      ? dummy() :
-            (node->type == AST_PROD_ELEM)       ? dummy() :
-                                                  error(__func__, node->type);
-}
+    if(header_tpl == NULL)
+        header_tpl = create_template("parse header", header_text);
+
+    IrGrammar* ir = get_ir();
+    TplData* data = create_tpl_data();
+    String* str   = create_string(ast_name);
+    append_string_str(str, ".h");
 
-void emit_parse_header(void) {
+    for(int i = 0; i < ir->num_terms; i++)
+        set_tpl_string(add_tpl_item(data, "terms"), "name", ir->terms[i]);
+    set_tpl_str(data, "ast_header", base_name(raw_string(str)));
+    set_tpl_string(data, "start", ir->rules[0]->name);
 
-    traverse_ast(parse_header_pre, parse_header_post);
+    clear_string(str);
+    append_string_fmt(str, "%s.h", name);
+
+    FILE* outfile = open_output(raw_string(str));
+    emit_template(outfile, header_tpl, data);
+    close_output(outfile);
+
+    destroy_tpl_data(data);
+    destroy_string(str);
 }
 
+/**
+ * @brief Free the template. It is compiled again the next time that the
+ * header is emitted.
+ */
+void destroy_parse_header_template(void) {
+
+    destroy_template(header_tpl);
+    header_tpl = NULL;
+}
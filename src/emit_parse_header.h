@@ -12,7 +12,8 @@
 #ifndef _EMIT_PARSE_HEADER_H_
 #define _EMIT_PARSE_HEADER_H_
 
-void emit_parse_header(void);
+void emit_parse_header(const char* name, const char* ast_name);
+void destroy_parse_header_template(void);
 
 
 #endif  /* _EMIT_PARSE_HEADER_H_ */
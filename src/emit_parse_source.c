@@ -1,8 +1,57 @@
 /**
  * @file emit_parse_source.c
  *
- * @brief This emits the parser source code. It is a pass on the AST that
- * emits the source file and the header file.
+ * @brief This emits the parser source code. It is a recursive descent parser
+ * that is made from the grammar IR, with one function for every rule that
+ * can be reached from the first rule and one function for every production
+ * of a grammar rule.
+ *
+ * The alternatives of a rule are chosen with a switch on the current token.
+ * Every token that can start only one of the alternatives jumps straight to
+ * it. Only the tokens that can start more than one of them try those
+ * alternatives in order, going back to where they started after one that
+ * failed. One that matched but is followed by a token that cannot come after
+ * the rule counts as failed, unless it is the last one. A group that is optional or that repeats is decided the same way,
+ * against the tokens that can come after it.
+ *
+ * The alternatives that are tried are a decision that is predicted. The
+ * first time that some tokens come, the decision tries the alternatives in
+ * order. The tokens that the ones that failed looked at are then saved in a
+ * DFA, along with the alternative that came after them. The next time that
+ * the same tokens come, the DFA skips the alternatives that are known to
+ * fail. So each decision explores the alternatives one time for every
+ * different lookahead, not every time that it is parsed.
+ *
+ * A cascade of rules that each add operators to the one under them, as
+ * find_cascades() finds them, is parsed with precedence climbing. The
+ * operand is parsed first and then a loop looks up the level of each
+ * operator and makes the nodes of the levels up to it. The nodes are the
+ * same as if every level was called, but a literal does not go through a
+ * function for every level to get there.
+ *
+ * When the nodes that only pass one child through are elided, a rule that
+ * has such a production returns an AstNode*. The node is made on the stack
+ * and the production returns a number that says if it only passed its child
+ * through. In that case the child is returned in place of the node, and
+ * otherwise the node is copied into one that is allocated.
+ *
+ * A small grammar rule that cannot reach itself is inlined. The statements
+ * that match it are put in the function that calls it, in a block where the
+ * node is the one of the rule, so the AST is the same but there is no call.
+ * The functions of the rule are only made when something else still calls
+ * it, like a loop, or an inlined rule that is already as deep as it can be.
+ *
+ * Going back can parse the same rule at the same token more than one time.
+ * The grammar rules that are named by the memo option keep what they parsed
+ * in a table of a fixed size, by rule and by token, and the second time the
+ * result is taken from there. "auto" names the rules that can be started at
+ * the same token by two of the alternatives that are tried.
+ *
+ * The functions of a rule are kept in the fragment store. They are only made
+ * again when the lowered form of the rule changed, or what the analysis
+ * found for it and for the rules that it refers to, or what was chosen for
+ * them. A fragment numbers its token sets and its decisions from one, and
+ * they are given the numbers in the file when it is used.
  *
  * @author Chuck Tilbury (chucktilbury@gmail.com)
  * @version 0.0
@@ -10,54 +59,2106 @@
  * @copyright Copyright (c) 2024
  *
  */
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+
+#include "analysis.h"
+#include "emit.h"
+#include "emit_parse_source.h"
+#include "fragment.h"
+#include "hash.h"
+#include "ir.h"
+#include "memory.h"
+#include "module.h"
+#include "precedence.h"
+#include "ptr_lst.h"
+#include "replace.h"
+#include "str.h"
+#include "template.h"
+
+// the most elements that a rule that is inlined can have, counting the ones
+// in its groups, and how many rules can be inlined into each other
+#define INLINE_SIZE 4
+#define INLINE_DEPTH 2
+
+static const char* source_text =
+    "/*\n"
+    " * This file is generated by pargen. Changes will be lost.\n"
+    " */\n"
+    "#include <stddef.h>\n"
+    "{{#if lists}}\n"
+    "#include <stdlib.h>\n"
+    "{{/if}}\n"
+    "#include <string.h>\n"
+    "\n"
+    "#include \"{{header}}\"\n"
+    "\n"
+    "{{#each protos}}\n"
+    "{{proto}};\n"
+    "{{/each}}\n"
+    "\n"
+    "{{#if decisions}}\n"
+    "/*\n"
+    " * The DFA of the decisions. A state has the first alternative that is not\n"
+    " * known to fail, and an edge for every token that was seen after it. The\n"
+    " * first states are the start states of the decisions. The DFA is kept from\n"
+    " * one parse to the next and it stops growing when it is full.\n"
+    " */\n"
+    "#ifndef DFA_STATES\n"
+    "#define DFA_STATES 4096\n"
+    "#endif\n"
+    "#define DFA_EDGES (DFA_STATES * 2)\n"
+    "\n"
+    "typedef struct {\n"
+    "    int state;\n"
+    "    TokenType token;\n"
+    "    int next;\n"
+    "} dfa_edge_t;\n"
+    "\n"
+    "static dfa_edge_t dfa_edges[DFA_EDGES];\n"
+    "static int dfa_alts[DFA_STATES];\n"
+    "static int dfa_count = {{decisions}} + 1;\n"
+    "\n"
+    "// the furthest token that the alternatives that are tried looked at\n"
+    "static int furthest = 0;\n"
+    "\n"
+    "static int go_back(int mark) {\n"
+    "\n"
+    "    int pos = mark_tokens();\n"
+    "    if(pos > furthest)\n"
+    "        furthest = pos;\n"
+    "    reset_tokens(mark);\n"
+    "\n"
+    "    return furthest;\n"
+    "}\n"
+    "\n"
+    "/*\n"
+    " * There are more edges than states, so an edge is always found.\n"
+    " */\n"
+    "static dfa_edge_t* find_edge(int state, TokenType token) {\n"
+    "\n"
+    "    unsigned int hash = ((unsigned int)state * 31u + (unsigned int)token) * 2654435761u;\n"
+    "    dfa_edge_t* edge;\n"
+    "\n"
+    "    hash ^= hash >> 16;\n"
+    "    for(;; hash++) {\n"
+    "        edge = &dfa_edges[hash % DFA_EDGES];\n"
+    "        if(edge->state == 0 || (edge->state == state && edge->token == token))\n"
+    "            return edge;\n"
+    "    }\n"
+    "}\n"
+    "\n"
+    "/*\n"
+    " * Follow the tokens in the DFA of the decision and return the first\n"
+    " * alternative that is not known to fail. The alternatives that are skipped\n"
+    " * are skipped because of the tokens up to the state that said so, so the\n"
+    " * decision starts out having looked that far.\n"
+    " */\n"
+    "static int predict(int decision) {\n"
+    "\n"
+    "    int mark  = mark_tokens();\n"
+    "    int state = decision;\n"
+    "    int alt   = 0;\n"
+    "\n"
+    "    furthest = mark;\n"
+    "    for(;;) {\n"
+    "        TokenType token  = crnt_token();\n"
+    "        dfa_edge_t* edge = find_edge(state, token);\n"
+    "        if(edge->state == 0)\n"
+    "            break;\n"
+    "        state = edge->next;\n"
+    "        if(dfa_alts[state] > alt) {\n"
+    "            alt      = dfa_alts[state];\n"
+    "            furthest = mark_tokens();\n"
+    "        }\n"
+    "        if(token == END_OF_INPUT)\n"
+    "            break;\n"
+    "        consume_token();\n"
+    "    }\n"
+    "    reset_tokens(mark);\n"
+    "\n"
+    "    return (alt > 0) ? alt - 1 : 0;\n"
+    "}\n"
+    "\n"
+    "/*\n"
+    " * Save that the alternatives before alt fail when the tokens from the mark\n"
+    " * to the extent come.\n"
+    " */\n"
+    "static void learn(int decision, int mark, int extent, int alt) {\n"
+    "\n"
+    "    int end   = mark_tokens();\n"
+    "    int state = decision;\n"
+    "\n"
+    "    reset_tokens(mark);\n"
+    "    while(state != 0 && mark_tokens() <= extent) {\n"
+    "        TokenType token  = crnt_token();\n"
+    "        dfa_edge_t* edge = find_edge(state, token);\n"
+    "        if(edge->state == 0) {\n"
+    "            if(dfa_count >= DFA_STATES) {\n"
+    "                state = 0;\n"
+    "                break;\n"
+    "            }\n"
+    "            edge->state = state;\n"
+    "            edge->token = token;\n"
+    "            edge->next  = dfa_count++;\n"
+    "        }\n"
+    "        state = edge->next;\n"
+    "        if(token == END_OF_INPUT)\n"
+    "            break;\n"
+    "        consume_token();\n"
+    "    }\n"
+    "    if(state != 0 && dfa_alts[state] < alt + 1)\n"
+    "        dfa_alts[state] = alt + 1;\n"
+    "    reset_tokens(end);\n"
+    "}\n"
+    "\n"
+    "/*\n"
+    " * Learn from the alternatives that failed and put back how far the tokens\n"
+    " * were looked at before the decision.\n"
+    " */\n"
+    "static void end_decision(int decision, int mark, int saved, int first, int alt, int extent) {\n"
+    "\n"
+    "    if(alt > first)\n"
+    "        learn(decision, mark, extent, alt);\n"
+    "    if(saved > furthest)\n"
+    "        furthest = saved;\n"
+    "}\n"
+    "\n"
+    "{{/if}}\n"
+    "{{#if memo}}\n"
+    "/*\n"
+    " * The results of the rules that are memoized, by rule and by the mark of\n"
+    " * the token that they started at. The table does not grow. When all of the\n"
+    " * places that a result can go in are used, the one that started the\n"
+    " * furthest back in the input is replaced. The size must be a power of\n"
+    " * two.\n"
+    " */\n"
+    "#ifndef MEMO_SIZE\n"
+    "#define MEMO_SIZE 4096\n"
+    "#endif\n"
+    "#if (MEMO_SIZE & (MEMO_SIZE - 1)) != 0\n"
+    "#error \"MEMO_SIZE must be a power of two\"\n"
+    "#endif\n"    "#define MEMO_PROBES 8\n"
+    "\n"
+    "typedef struct {\n"
+    "    int rule;\n"
+    "    int start;\n"
+    "    int end;\n"
+    "{{#if decisions}}\n"
+    "    int far;\n"
+    "{{/if}}\n"
+    "    AstNode* node;\n"
+    "} memo_t;\n"
+    "\n"
+    "static memo_t memo_table[MEMO_SIZE];\n"
+    "\n"
+    "/*\n"
+    " * Return the result of the rule at the token, or an empty entry for it.\n"
+    " */\n"
+    "static memo_t* find_memo(int rule, int start) {\n"
+    "\n"
+    "    unsigned int hash = ((unsigned int)start * {{memo}}u + (unsigned int)rule) * 2654435761u;\n"
+    "    memo_t* oldest    = NULL;\n"
+    "\n"
+    "    hash ^= hash >> 16;\n"
+    "    for(int i = 0; i < MEMO_PROBES; i++) {\n"
+    "        memo_t* memo = &memo_table[(hash + i) & (MEMO_SIZE - 1)];\n"
+    "        if(memo->rule == 0 || (memo->rule == rule && memo->start == start))\n"
+    "            return memo;\n"
+    "        if(oldest == NULL || memo->start < oldest->start)\n"
+    "            oldest = memo;\n"
+    "    }\n"
+    "\n"
+    "    oldest->rule = 0;\n"
+    "    return oldest;\n"
+    "}\n"
+    "\n"
+    "static void save_memo(int rule, int start, AstNode* node) {\n"
+    "\n"
+    "    memo_t* memo = find_memo(rule, start);\n"
+    "    memo->rule   = rule;\n"
+    "    memo->start  = start;\n"
+    "    memo->end    = mark_tokens();\n"
+    "{{#if decisions}}\n"
+    "    memo->far    = furthest;\n"
+    "{{/if}}\n"
+    "    memo->node   = node;\n"
+    "}\n"
+    "\n"
+    "{{/if}}\n"
+    "{{#if lists}}\n"
+    "/*\n"
+    " * Make room for one more item at the end of a list. The room doubles, so\n"
+    " * a long list is not copied every time that it grows. When there is no\n"
+    " * more memory it returns NULL and the list is left as it was.\n"
+    " */\n"
+    "static void* grow_list(void* items, size_t count, size_t* size) {\n"
+    "\n"
+    "    if(count < *size)\n"
+    "        return items;\n"
+    "\n"
+    "    size_t more = (*size > 0) ? *size * 2 : 4;\n"
+    "    void* grown = realloc(items, more * sizeof(void*));\n"
+    "    if(grown != NULL)\n"
+    "        *size = more;\n"
+    "\n"
+    "    return grown;\n"
+    "}\n"
+    "\n"
+    "/*\n"
+    " * Give back the room at the end of a list that was not used.\n"
+    " */\n"
+    "static void* fit_list(void* items, size_t count) {\n"
+    "\n"
+    "    void* fit = (count > 0) ? realloc(items, count * sizeof(void*)) : NULL;\n"
+    "\n"
+    "    return (fit != NULL) ? fit : items;\n"
+    "}\n"
+    "\n"
+    "{{/if}}\n"
+    "{{#each sets}}\n"
+    "{{code}}\n"
+    "\n"
+    "{{/each}}\n"
+    "{{#each funcs}}\n"
+    "{{code}}\n"
+    "\n"
+    "{{/each}}\n"
+    "ast_{{start}}_t* run_parser(void) {\n"
+    "\n"
+    "{{#if memo}}\n"
+    "    memset(memo_table, 0, sizeof(memo_table));\n"
+    "{{/if}}\n"
+    "    ast_{{start}}_t* node = parse_{{start}}();\n"
+    "\n"
+    "    if(node == NULL || crnt_token() != END_OF_INPUT)\n"
+    "        return NULL;\n"
+    "\n"
+    "    return node;\n"
+    "}\n"
+    "\n"
+    "/*\n"
+    " * End of generated file.\n"
+    " */\n"
+    "\n";
+
+// a set of tokens that has the same alternatives in a switch
+typedef struct {
+    int* prods;
+    int count;
+    String* labels;
+} _case_t_;
+
+static Template* source_tpl = NULL;
+static IrGrammar* ir        = NULL;
+static Analysis* an         = NULL;
+static TplData* data        = NULL;
+// the number of every token set that a function was made for, by content
+static HashTable* set_ids = NULL;
+static int num_sets       = 0;
+// the number that the result of each rule is saved under, or 0
+static int* memo_ids = NULL;
+static int num_memos = 0;
+// set if the parser predicts the decisions, and the number of them
+static int predicting    = 0;
+static int num_decisions = 0;
+// the cascade that each rule is a level of, or -1 for the loop of a level,
+// the number of the level and if it is called from outside of the cascade
+static PtrLst* cascades = NULL;
+static int* climb_ids   = NULL;
+static int* climb_nums  = NULL;
+static char* climb_outs = NULL;
+// the grammar rules whose node is elided when it only has one child, or NULL
+static char* passes = NULL;
+// the grammar rules that are inlined, the ones that are still called, and
+// the number of the last block of an inlined rule in the function
+static char* inlines = NULL;
+static char* calls   = NULL;
+static int num_subs  = 0;
+// the groups of the lists that are parsed into an array, and the number of
+// the last list in the function
+static char* lists   = NULL;
+static int num_lists = 0;
+// the fragment of the rule that is being made: the records of the sets, the
+// decisions and the calls, and then the records of the protos and the
+// functions. The sets are numbered in the fragment.
+static String* piece_head   = NULL;
+static String* piece_code   = NULL;
+static HashTable* piece_ids = NULL;
+static int piece_sets       = 0;
+static int piece_decisions  = 0;
+static char* piece_calls    = NULL;
+// the number of every rule, by name
+static HashTable* rule_ids = NULL;
+
+static const char* token_name(int tok) {
+
+    return (tok == an->end) ? "END_OF_INPUT" : raw_string(ir->terms[tok]);
+}
+
+static void add_case_labels(String* str, const uint64_t* set, const char* indent) {
+
+    for(int i = 0; i <= an->end; i++)
+        if(test_bit(set, i))
+            append_string_fmt(str, "%scase %s:\n", indent, token_name(i));
+}
+
+/*
+ * Add a record to the fragment that is being made. It is the type, the
+ * length of the text and a newline, and then the text.
+ */
+static void add_record(String* str, int type, const char* text, size_t len) {
+
+    append_string_fmt(str, "%c%zu\n", type, len);
+    append_buffer(str, (void*)text, len);
+}
+
+/*
+ * Return the number of the function that tests for the set in the fragment.
+ * The code writes it as @S<number>@ and use_fragment() puts the number that
+ * the set has in the file in its place.
+ */
+static int set_id(const uint64_t* set) {
+
+    String* key = create_string(NULL);
+    for(int i = 0; i < an->words; i++)
+        append_string_fmt(key, "%016llx", (unsigned long long)set[i]);
+
+    int id;
+    if(find_hashtable(piece_ids, raw_string(key), &id, sizeof(id)) != HASH_OK) {
+        id = ++piece_sets;
+        insert_hashtable(piece_ids, raw_string(key), &id, sizeof(id));
+        add_record(piece_head, 's', raw_string(key), key->length);
+    }
+
+    destroy_string(key);
+    return id;
+}
+
+/*
+ * Return the number of the function in the file that tests for the set that
+ * the key was made from. The function is made the first time that the set
+ * is used.
+ */
+static int file_set_id(String* key) {
+
+    int id;
+    if(find_hashtable(set_ids, raw_string(key), &id, sizeof(id)) == HASH_OK)
+        return id;
+
+    id = ++num_sets;
+    insert_hashtable(set_ids, raw_string(key), &id, sizeof(id));
+
+    uint64_t* set   = _ALLOC_DS_ARRAY(uint64_t, an->words);
+    const char* ptr = raw_string(key);
+    char word[17]   = {0};
+    for(int i = 0; i < an->words; i++) {
+        memcpy(word, &ptr[i * 16], 16);
+        set[i] = strtoull(word, NULL, 16);
+    }
+
+    String* code = create_string(NULL);
+    append_string_fmt(code, "static int in_set_%d(TokenType tok) {\n\n", id);
+    append_string_str(code, "    switch(tok) {\n");
+    add_case_labels(code, set, "        ");
+    append_string_str(code, "            return 1;\n");
+    append_string_str(code, "        default:\n");
+    append_string_str(code, "            return 0;\n");
+    append_string_str(code, "    }\n}");
+    set_tpl_string(add_tpl_item(data, "sets"), "code", code);
+
+    destroy_string(code);
+    _FREE(set);
+    return id;
+}
+
+/*
+ * Save that the fragment calls the function of the rule, so that a rule
+ * that is inlined still gets its function.
+ */
+static void call_rule(int sym) {
+
+    if(!piece_calls[sym]) {
+        piece_calls[sym] = 1;
+        add_record(piece_head, 'c', raw_string(ir->rules[sym]->name),
+                   ir->rules[sym]->name->length);
+    }
+}
+
+static IrRule* top_rule(IrRule* rule) {
+
+    while(rule->parent >= 0)
+        rule = ir->rules[rule->parent];
+
+    return rule;
+}
+
+static int elided(int sym) {
+
+    return passes != NULL && passes[sym];
+}
+
+/*
+ * The type of the node that the parser of a grammar rule returns.
+ */
+static const char* node_type(IrRule* rule, String* buf) {
+
+    clear_string(buf);
+    if(elided(rule->id))
+        append_string_str(buf, "AstNode");
+    else
+        append_string_fmt(buf, "ast_%s_t", raw_string(rule->name));
+
+    return raw_string(buf);
+}
+
+static void add_proto(String* str) {
+
+    add_record(piece_code, 'p', raw_string(str), str->length);
+}
+
+static void add_func(String* str) {
+
+    add_record(piece_code, 'f', raw_string(str), str->length);
+}
+
+/*
+ * The name of the field of the node that the element is kept in. This is the
+ * same name that the AST header gives it.
+ */
+static const char* field_name(IrElem* elem) {
+
+    return raw_string(elem->field);
+}
+
+static void emit_term(String* str, IrElem* elem, int store, const char* fail) {
+
+    const char* tok = raw_string(elem->tok);
+
+    append_string_fmt(str, "    if(crnt_token() != %s)\n        %s\n", tok, fail);
+    if(store) {
+        if(tok[0] != 'S')
+            append_string_fmt(str, "    node->%s = %s;\n", field_name(elem), tok);
+        else
+            append_string_fmt(str, "    node->%s = crnt_token_str();\n", field_name(elem));
+    }
+    append_string_str(str, "    consume_token();\n");
+}
+
+/*
+ * The expression that is true if the rule that the element refers to did
+ * not match.
+ */
+static String* fail_expr(IrElem* elem, int store) {
+
+    IrRule* ref = ir->rules[elem->sym];
+    String* str = create_string(NULL);
+
+    call_rule(ref->id);
+    if(ref->parent >= 0)
+        append_string_fmt(str, "!parse_%s(node)", raw_string(ref->name));
+    else if(store)
+        append_string_fmt(str, "NULL == (node->%s = parse_%s())", field_name(elem),
+                          raw_string(ref->name));
+    else
+        append_string_fmt(str, "NULL == parse_%s()", raw_string(ref->name));
+
+    return str;
+}
+
+/*
+ * A rule that is optional or that repeats is entered when the token can
+ * start it. Where the token can also come after it, it is tried and the
+ * input is put back if it did not match.
+ */
+static void emit_repeat(String* str, IrProd* prod, size_t idx, int store, const char* ret) {
+
+    IrElem* elem    = prod->elems->list[idx];
+    String* fail    = fail_expr(elem, store);
+    uint64_t* after = _ALLOC_DS_ARRAY(uint64_t, an->words);
+
+    int enter   = set_id(rule_first(an, elem->sym));
+    int overlap = elem_overlap(an, prod, idx, after) ? set_id(after) : 0;
+    int many    = (elem->max == IR_MANY);
+    // going back is how far a decision looked
+    const char* back = predicting ? "go_back" : "reset_tokens";
+
+    if(elem->min > 0)
+        append_string_fmt(str, "    if(%s)\n        %s\n", raw_string(fail), ret);
+
+    if(overlap == 0 && !many)
+        append_string_fmt(str, "    if(in_set_@S%d@(crnt_token()) && %s)\n        %s\n", enter,
+                          raw_string(fail), ret);
+    else if(!many)
+        append_string_fmt(str,
+                          "    if(in_set_@S%d@(crnt_token())) {\n"
+                          "        int mark = mark_tokens();\n"
+                          "        if(%s)\n"
+                          "            %s(mark);\n"
+                          "    }\n"
+                          "    else if(in_set_@S%d@(crnt_token()) && %s)\n"
+                          "        %s\n",
+                          overlap, raw_string(fail), back, enter, raw_string(fail), ret);
+    else {
+        // a rule that can match nothing stops the loop when it does
+        int empty = an->nullable[elem->sym];
+
+        append_string_fmt(str, "    while(in_set_@S%d@(crnt_token())) {\n", enter);
+        if(overlap != 0 || empty)
+            append_string_str(str, "        int mark = mark_tokens();\n");
+        if(overlap != 0)
+            append_string_fmt(str,
+                              "        if(in_set_@S%d@(crnt_token())) {\n"
+                              "            if(%s) {\n"
+                              "                %s(mark);\n"
+                              "                break;\n"
+                              "            }\n"
+                              "        }\n"
+                              "        else if(%s)\n"
+                              "            %s\n",
+                              overlap, raw_string(fail), back, raw_string(fail), ret);
+        else
+            append_string_fmt(str, "        if(%s)\n            %s\n", raw_string(fail), ret);
+        if(empty)
+            append_string_str(str, "        if(mark == mark_tokens())\n            break;\n");
+        append_string_str(str, "    }\n");
+    }
+
+    _FREE(after);
+    destroy_string(fail);
+}
+
+/*
+ * The node of a rule that had its left recursion removed is moved into a new
+ * node, which it becomes the left side of. It is put back if the rest of the
+ * production does not match.
+ */
+static void emit_left(String* str, IrElem* elem) {
+
+    IrRule* ref   = ir->rules[elem->sym];
+    String* upper = copy_string(ref->name);
+    upper_string(upper);
+
+    append_string_fmt(str,
+                      "    ast_%s_t* left = (ast_%s_t*)create_ast_node(AST_%s);\n"
+                      "    *left = *node;\n"
+                      "    memset(node, 0, sizeof(*node));\n"
+                      "    node->type = left->type;\n"
+                      "    node->%s = %sleft;\n",
+                      raw_string(ref->name), raw_string(ref->name), raw_string(upper),
+                      field_name(elem), elided(ref->id) ? "(AstNode*)" : "");
+
+    destroy_string(upper);
+}
+
+/*
+ * A production that passes its child through returns 2 and up, by the
+ * number of the production, so that the rule knows which field the child is
+ * in. The loop after the child can make nodes, and then the node that it
+ * started with only has the child, so that one is elided from the bottom
+ * of the nodes that the loop made.
+ */
+static void emit_pass(String* str, IrProd* prod) {
+
+    IrRule* rule = ir->rules[prod->rule];
+    IrElem* base = pass_through_elem(ir, prod);
+    size_t idx   = 0;
+
+    while(rule->prods->list[idx] != prod)
+        idx++;
+
+    if(prod->elems->len == 1) {
+        append_string_fmt(str, "\n    return %zu;\n", idx + 2);
+        return;
+    }
+
+    IrElem* left     = ir->rules[prod->elems->list[1]->sym]->prods->list[0]->elems->list[0];
+    const char* name = raw_string(rule->name);
+    const char* lf   = field_name(left);
+
+    append_string_fmt(str,
+                      "\n"
+                      "    if(node->%s == NULL)\n"
+                      "        return %zu;\n"
+                      "\n"
+                      "    ast_%s_t* first = node;\n"
+                      "    while(((ast_%s_t*)first->%s)->%s != NULL)\n"
+                      "        first = (ast_%s_t*)first->%s;\n"
+                      "    first->%s = (AstNode*)((ast_%s_t*)first->%s)->%s;\n"
+                      "\n"
+                      "    return 1;\n",
+                      lf, idx + 2, name, name, lf, lf, name, lf, lf, name, lf, field_name(base));
+}
+
+/*
+ * Sort the tokens that can start the productions by which productions they
+ * can start.
+ */
+static PtrLst* make_cases(IrRule* rule) {
+
+    PtrLst* cases  = create_ptr_lst();
+    int* prods     = _ALLOC_DS_ARRAY(int, rule->prods->len);
+    uint64_t* sets = _ALLOC_DS_ARRAY(uint64_t, rule->prods->len * an->words);
+
+    // the tokens that can start a production, or come after it if it can
+    // match nothing
+    for(size_t i = 0; i < rule->prods->len; i++) {
+        IrProd* prod = rule->prods->list[i];
+        union_bits(&sets[i * an->words], prod_first(an, prod->id), an->words);
+        if(an->prod_nullable[prod->id])
+            union_bits(&sets[i * an->words], rule_follow(an, rule->id), an->words);
+    }
+
+    for(int tok = 0; tok <= an->end; tok++) {
+        // the productions that start with the token are tried before the
+        // ones that match nothing
+        int count = 0;
+        for(size_t i = 0; i < rule->prods->len; i++)
+            if(test_bit(prod_first(an, rule->prods->list[i]->id), tok))
+                prods[count++] = i;
+        for(size_t i = 0; i < rule->prods->len; i++)
+            if(test_bit(&sets[i * an->words], tok) &&
+               !test_bit(prod_first(an, rule->prods->list[i]->id), tok))
+                prods[count++] = i;
+        if(count == 0)
+            continue;
+
+        int mark = 0;
+        _case_t_* cs;
+        while(NULL != (cs = iterate_ptr_lst(cases, &mark)))
+            if(cs->count == count && !memcmp(cs->prods, prods, count * sizeof(int)))
+                break;
+
+        if(cs == NULL) {
+            cs         = _ALLOC_DS(_case_t_);
+            cs->prods  = _DUP_MEM(prods, count * sizeof(int));
+            cs->count  = count;
+            cs->labels = create_string(NULL);
+            append_ptr_lst(cases, cs);
+        }
+        append_string_fmt(cs->labels, "        case %s:\n", token_name(tok));
+    }
+
+    _FREE(sets);
+    _FREE(prods);
+
+    return cases;
+}
+
+static void destroy_cases(PtrLst* cases) {
+
+    int mark = 0;
+    _case_t_* cs;
+
+    while(NULL != (cs = iterate_ptr_lst(cases, &mark))) {
+        _FREE(cs->prods);
+        destroy_string(cs->labels);
+        _FREE(cs);
+    }
+    destroy_ptr_lst(cases);
+}
+
+/*
+ * Add the code to the string with more indent on every line.
+ */
+static void indent_code(String* str, String* code, const char* indent) {
+
+    const char* ptr = raw_string(code);
+    int start       = 1;
+
+    for(; *ptr != '\0'; ptr++) {
+        if(start && *ptr != '\n')
+            append_string_str(str, indent);
+        append_string_char(str, *ptr);
+        start = (*ptr == '\n');
+    }
+}
+
+/*
+ * A list that list_group() found is parsed with a loop that adds every item
+ * to the array in the node. The array doubles when it is full, and when the
+ * list ends it is made the size of the items that are in it.
+ */
+static void emit_list(String* str, IrProd* prod, size_t idx, IrRule* list, const char* fail) {
+
+    IrElem* elem     = prod->elems->list[idx];
+    int separated    = (elem->sym != list->id);
+    IrElem* rep      = prod->elems->list[separated ? idx + 1 : idx];
+    IrElemVec* items = list->prods->list[0]->elems;
+    IrElem* item     = items->list[separated ? 1 : 0];
+    IrElem* term     = items->list[separated ? 0 : 1];
+    const char* name = field_name(item);
+    int id           = ++num_lists;
+    int enter        = set_id(rule_first(an, list->id));
+    String* push     = create_string(NULL);
+    String* body     = create_string(NULL);
+
+    call_rule(item->sym);
+    append_string_fmt(push,
+                      "    if(NULL == (grown_%d = grow_list(node->%s_items, node->%s_count, "
+                      "&size_%d)))\n"
+                      "        %s\n"
+                      "    node->%s_items = grown_%d;\n"
+                      "    if(NULL == (node->%s_items[node->%s_count++] = parse_%s()))\n"
+                      "        %s\n",
+                      id, name, name, id, fail, name, id, name, name,
+                      raw_string(ir->rules[item->sym]->name), fail);
+
+    if(separated) {
+        emit_term(body, term, list->depth <= 1, fail);
+        append_string_string(body, push);
+    }
+    else {
+        append_string_string(body, push);
+        emit_term(body, term, list->depth <= 1, fail);
+    }
+
+    append_string_fmt(str,
+                      "    size_t size_%d = 0;\n"
+                      "    void* grown_%d;\n\n"
+                      "    node->%s_count = 0;\n",
+                      id, id, name);
+    if(separated)
+        append_string_string(str, push);
+    if(rep->min > 0)
+        append_string_str(str, "    do {\n");
+    else
+        append_string_fmt(str, "    while(in_set_@S%d@(crnt_token())) {\n", enter);
+    indent_code(str, body, "    ");
+    if(rep->min > 0)
+        append_string_fmt(str, "    } while(in_set_@S%d@(crnt_token()));\n", enter);
+    else
+        append_string_str(str, "    }\n");
+    append_string_fmt(str, "    node->%s_items = fit_list(node->%s_items, node->%s_count);\n",
+                      name, name, name);
+
+    destroy_string(push);
+    destroy_string(body);
+}
+
+static void emit_inline(String* str, IrElem* elem, int store, const char* fail, int depth);
+
+/*
+ * The statements that match the elements of a production. The fields are
+ * only set in the grammar rule and in the groups right under it, because
+ * those are the ones that are in the struct.
+ */
+static void emit_matches(String* str, IrProd* prod, const char* fail, int depth) {
+
+    int store = (ir->rules[prod->rule]->depth <= 1);
+
+    for(size_t i = 0; i < prod->elems->len; i++) {
+        IrElem* elem = prod->elems->list[i];
+        int once     = (elem->min == 1 && elem->max == 1);
+        IrRule* list = (elem->type == IR_RULE) ? list_group(ir, an, prod, i) : NULL;
+
+        if(i > 0)
+            append_string_str(str, "\n");
+
+        if(list != NULL) {
+            emit_list(str, prod, i, list, fail);
+            // the loop of a separated list is the next element
+            i += (elem->sym != list->id);
+        }
+        else if(elem->type == IR_LEFT)
+            emit_left(str, elem);
+        else if(elem->type == IR_TERMINAL)
+            emit_term(str, elem, store, fail);
+        else if(once && inlines[elem->sym] && depth < INLINE_DEPTH)
+            emit_inline(str, elem, store, fail, depth + 1);
+        else if(once) {
+            String* expr = fail_expr(elem, store);
+            append_string_fmt(str, "    if(%s)\n        %s\n", raw_string(expr), fail);
+            destroy_string(expr);
+        }
+        else
+            emit_repeat(str, prod, i, store, fail);
+    }
+}
+
+/*
+ * The statements that match a rule that is inlined, in place of the call to
+ * it. The node of the rule is made the same as its function makes it. A rule
+ * with more than one production has the switch of its function, with the
+ * statements of the production in each case.
+ */
+static void emit_inline(String* str, IrElem* elem, int store, const char* fail, int depth) {
+
+    IrRule* rule     = ir->rules[elem->sym];
+    const char* name = raw_string(rule->name);
+    String* upper    = copy_string(rule->name);
+    String* code     = create_string(NULL);
+    int id           = ++num_subs;
+
+    upper_string(upper);
+    append_string_fmt(str,
+                      "    ast_%s_t* sub_%d = (ast_%s_t*)create_ast_node(AST_%s);\n"
+                      "    {\n"
+                      "        ast_%s_t* node = sub_%d;\n"
+                      "\n",
+                      name, id, name, raw_string(upper), name, id);
+
+    if(rule->prods->len == 1) {
+        emit_matches(code, rule->prods->list[0], fail, depth);
+        indent_code(str, code, "    ");
+    }
+    else {
+        PtrLst* cases = make_cases(rule);
+        int mark      = 0;
+        _case_t_* cs;
+
+        append_string_str(str, "        switch(crnt_token()) {\n");
+        while(NULL != (cs = iterate_ptr_lst(cases, &mark))) {
+            // the statements are in a block after the last label
+            StrSlice labels = {raw_string(cs->labels), cs->labels->length - 1};
+            clear_string(code);
+            append_string_slice(code, labels);
+            append_string_str(code, " {\n");
+            indent_code(str, code, "    ");
+
+            clear_string(code);
+            emit_matches(code, rule->prods->list[cs->prods[0]], fail, depth);
+            indent_code(str, code, "            ");
+            append_string_str(str,
+                              "                break;\n"
+                              "            }\n");
+        }
+        append_string_fmt(str,
+                          "            default:\n"
+                          "                %s\n"
+                          "        }\n",
+                          fail);
+        destroy_cases(cases);
+    }
+
+    append_string_str(str, "    }\n");
+    if(store)
+        append_string_fmt(str, "    node->%s = sub_%d;\n", field_name(elem), id);
+
+    destroy_string(code);
+    destroy_string(upper);
+}
+
+/*
+ * The body of the function of a production.
+ */
+static void emit_elems(String* str, IrProd* prod) {
+
+    int left         = (prod->elems->list[0]->type == IR_LEFT);
+    const char* fail = left ? "goto undo;" : "return 0;";
+
+    num_subs  = 0;
+    num_lists = 0;
+    emit_matches(str, prod, fail, 0);
+
+    if(elided(prod->rule) && pass_through_elem(ir, prod) != NULL)
+        emit_pass(str, prod);
+    else
+        append_string_str(str, "\n    return 1;\n");
+    if(left)
+        append_string_str(str, "\nundo:\n    *node = *left;\n    return 0;\n");
+    append_string_str(str, "}");
+}
+
+/*
+ * One function for every production of the rule. The node is the one of the
+ * grammar rule that the rule is in.
+ */
+static void emit_prods(IrRule* rule) {
+
+    const char* name = raw_string(rule->name);
+    String* str      = create_string(NULL);
+
+    for(size_t i = 0; i < rule->prods->len; i++) {
+        clear_string(str);
+        append_string_fmt(str, "static int prod_%s_%zu(ast_%s_t* node)", name, i + 1,
+                          raw_string(top_rule(rule)->name));
+        add_proto(str);
+        append_string_str(str, " {\n\n");
+        emit_elems(str, rule->prods->list[i]);
+        add_func(str);
+    }
+
+    destroy_string(str);
+}
+
+/*
+ * The function for a decision tries the alternatives from the first one that
+ * is not known to fail, and the ones that fail are learned. An alternative
+ * that matched is only taken if the token after it can come after the rule,
+ * so that a shorter one that matches the start of a later one, like IDENT
+ * before IDENT '[' ... ']', does not make the parse fail after it. The last
+ * alternative is taken as it is, because there is nothing else to try.
+ */
+static int emit_decision(IrRule* rule, _case_t_* cs) {
+
+    const char* name = raw_string(rule->name);
+    String* str      = create_string(NULL);
+    int id           = ++piece_decisions;
+    int follow       = set_id(rule_follow(an, rule->id));
+
+    add_record(piece_head, 'd', "", 0);
+    append_string_fmt(str, "static int decide_@D%d@(ast_%s_t* node)", id,
+                      raw_string(top_rule(rule)->name));
+    add_proto(str);
+    append_string_fmt(str,
+                      " {\n\n"
+                      "    int mark   = mark_tokens();\n"
+                      "    int saved  = furthest;\n"
+                      "    int first  = predict(@D%d@);\n"
+                      "    int alt    = first;\n"
+                      "    int extent = mark;\n"
+                      "    int found  = 0;\n"
+                      "\n"
+                      "    switch(first) {\n",
+                      id);
+
+    for(int i = 0; i < cs->count; i++) {
+        if(i > 0)
+            append_string_str(str, "            // fall through\n");
+        append_string_fmt(str,
+                          "        case %d:\n"
+                          "            if(0 != (found = prod_%s_%d(node))",
+                          i, name, cs->prods[i] + 1);
+        if(i + 1 < cs->count)
+            append_string_fmt(str, " && in_set_@S%d@(crnt_token())", follow);
+        append_string_fmt(str,
+                          ")\n"
+                          "                break;\n"
+                          "            extent = go_back(mark);\n"
+                          "            alt    = %d;\n",
+                          i + 1);
+    }
+
+    append_string_fmt(str,
+                      "    }\n"
+                      "\n"
+                      "    end_decision(@D%d@, mark, saved, first, alt, extent);\n"
+                      "    return found;\n"
+                      "}",
+                      id);
+    add_func(str);
+    destroy_string(str);
+
+    return id;
+}
+
+/*
+ * Choose the production with a switch on the current token. The statement is
+ * what is done when one of them matched. What the production returned is
+ * kept in found when the node of the rule can be elided.
+ */
+static void emit_switch(String* str, IrRule* rule, const char* matched) {
+
+    const char* name = raw_string(rule->name);
+    String* call     = create_string(NULL);
+    PtrLst* cases    = make_cases(rule);
+    int mark         = 0;
+    _case_t_* cs;
+
+    append_string_str(str, "\n    switch(crnt_token()) {\n");
+    while(NULL != (cs = iterate_ptr_lst(cases, &mark))) {
+        append_string_str(str, raw_string(cs->labels));
+        clear_string(call);
+        if(cs->count > 1)
+            append_string_fmt(call, "decide_@D%d@(node)", emit_decision(rule, cs));
+        else
+            append_string_fmt(call, "prod_%s_%d(node)", name, cs->prods[0] + 1);
+        if(elided(rule->id))
+            append_string_fmt(str, "            if(0 != (found = %s))\n", raw_string(call));
+        else
+            append_string_fmt(str, "            if(%s)\n", raw_string(call));
+        append_string_fmt(str, "                %s\n", matched);
+        append_string_str(str, "            break;\n");
+    }
+    append_string_str(str, "        default:\n            break;\n    }\n");
+
+    destroy_string(call);
+    destroy_cases(cases);
+}
+
+/*
+ * A group has one production, so the function for it is the production. A
+ * rule that was made by remove_left_recursion() can have more than one.
+ */
+static void emit_group(IrRule* rule) {
+
+    if(rule->prods->len > 1)
+        emit_prods(rule);
+
+    String* str = create_string(NULL);
+    append_string_fmt(str, "static int parse_%s(ast_%s_t* node)", raw_string(rule->name),
+                      raw_string(top_rule(rule)->name));
+    add_proto(str);
+
+    if(rule->prods->len > 1) {
+        append_string_str(str, " {\n");
+        emit_switch(str, rule, "return 1;");
+        append_string_str(str, "\n    return 0;\n}");
+    }
+    else {
+        append_string_str(str, " {\n\n");
+        if(rule->depth > 1)
+            append_string_str(str, "    (void)node;\n\n");
+        emit_elems(str, rule->prods->list[0]);
+    }
+
+    add_func(str);
+    destroy_string(str);
+}
+
+/*
+ * The name of the rule in upper case, as it is in the AST_ number of its
+ * node.
+ */
+static void node_names(IrRule* rule, String* upper) {
+
+    clear_string(upper);
+    append_string_string(upper, rule->name);
+    upper_string(upper);
+}
+
+/*
+ * The statements that store the operator that is the current token and then
+ * parse what comes after it into the field of the element.
+ */
+static void emit_operator(String* str, Cascade* cascade, int id, IrElem* op, IrElem* elem) {
+
+    const char* tok = raw_string(op->tok);
+    IrRule* ref     = ir->rules[elem->sym];
+
+    if(tok[0] != 'S')
+        append_string_fmt(str, "            node->%s = %s;\n", field_name(op), tok);
+    else
+        append_string_fmt(str, "            node->%s = crnt_token_str();\n", field_name(op));
+    append_string_str(str, "            consume_token();\n");
+
+    if(elem->sym == cascade->operand)
+        append_string_fmt(str, "            if(NULL == (node->%s = parse_%s()))\n",
+                          field_name(elem), raw_string(ref->name));
+    else if(elided(elem->sym))
+        append_string_fmt(str, "            if(NULL == (node->%s = climb_%d(%d)))\n",
+                          field_name(elem), id, climb_nums[elem->sym]);
+    else
+        append_string_fmt(str, "            if(NULL == (node->%s = (ast_%s_t*)climb_%d(%d)))\n",
+                          field_name(elem), raw_string(ref->name), id,
+                          climb_nums[elem->sym]);
+    append_string_str(str,
+                      "                return NULL;\n"
+                      "            return (AstNode*)node;\n"
+                      "        }\n");
+}
+
+/*
+ * The case that makes the node of the level for an operator.
+ */
+static void emit_operator_case(String* str, IrRule* rule, IrElem* op, String* upper) {
+
+    node_names(rule, upper);
+    append_string_fmt(str,
+                      "        case %s: {\n"
+                      "            ast_%s_t* node = (ast_%s_t*)create_ast_node(AST_%s);\n",
+                      raw_string(op->tok), raw_string(rule->name), raw_string(rule->name),
+                      raw_string(upper));
+}
+
+/*
+ * The function that returns the level of an operator, or 0.
+ */
+static void emit_power(Cascade* cascade, int id, const char* kind) {
+
+    String* str = create_string(NULL);
+    int infix   = (kind[0] == 'i');
+
+    append_string_fmt(str, "static int %s_power_%d(TokenType tok)", kind, id);
+    add_proto(str);
+    append_string_str(str, " {\n\n    switch(tok) {\n");
+
+    for(size_t i = 0; i < cascade->levels->len; i++) {
+        IrRule* rule = ir->rules[cascade->levels->list[i]];
+        IrRule* tail = level_tail(ir, rule);
+        int found    = 0;
+
+        if(infix && tail == NULL)
+            continue;
+        IrProdVec* prods = infix ? tail->prods : rule->prods;
+        for(size_t j = 0; j < prods->len; j++) {
+            IrElem* op = prods->list[j]->elems->list[infix];
+            if(op->type == IR_TERMINAL) {
+                append_string_fmt(str, "        case %s:\n", raw_string(op->tok));
+                found = 1;
+            }
+        }
+        if(found)
+            append_string_fmt(str, "            return %zu;\n", i + 1);
+    }
+
+    append_string_str(str, "        default:\n            return 0;\n    }\n}");
+    add_func(str);
+    destroy_string(str);
+}
+
+/*
+ * The function that makes the node of a level that only has the node of the
+ * level under it. A level whose node is elided does not make one. Without
+ * elide every level has a node in the AST, so an operand gets one of these
+ * for every level that it passes and the cascade only saves the calls.
+ */
+static void emit_wrap(Cascade* cascade, int id, String* upper) {
+
+    String* str = create_string(NULL);
+
+    append_string_fmt(str, "static AstNode* wrap_%d(AstNode* node, int level)", id);
+    add_proto(str);
+    append_string_str(str, " {\n\n    switch(level) {\n");
+    for(size_t i = 0; i < cascade->levels->len; i++) {
+        IrRule* rule = ir->rules[cascade->levels->list[i]];
+        IrElem* base = level_base(rule);
+        if(elided(rule->id))
+            continue;
+        node_names(rule, upper);
+        append_string_fmt(str,
+                          "        case %zu: {\n"
+                          "            ast_%s_t* up = (ast_%s_t*)create_ast_node(AST_%s);\n",
+                          i + 1, raw_string(rule->name), raw_string(rule->name),
+                          raw_string(upper));
+        if(elided(base->sym))
+            append_string_fmt(str, "            up->%s = node;\n", field_name(base));
+        else
+            append_string_fmt(str, "            up->%s = (ast_%s_t*)node;\n", field_name(base),
+                              raw_string(ir->rules[base->sym]->name));
+        append_string_str(str,
+                          "            return (AstNode*)up;\n"
+                          "        }\n");
+    }
+    append_string_str(str, "        default:\n            return node;\n    }\n}");
+    add_func(str);
+
+    destroy_string(str);
+}
+
+/*
+ * When the node of every level is elided, the levels that are passed on the
+ * way to an operator make no nodes, so the climb does not keep track of
+ * them.
+ */
+static void emit_climb_elided(String* str, int id, IrRule* operand, int prefixes, int infixes) {
+
+    if(prefixes)
+        append_string_fmt(str,
+                          "    AstNode* node;\n"
+                          "\n"
+                          "    if(prefix_power_%d(crnt_token()) >= level)\n"
+                          "        node = prefix_%d();\n"
+                          "    else\n"
+                          "        node = (AstNode*)parse_%s();\n",
+                          id, id, raw_string(operand->name));
+    else
+        append_string_fmt(str, "    AstNode* node = (AstNode*)parse_%s();\n",
+                          raw_string(operand->name));
+    if(infixes)
+        append_string_fmt(str,
+                          "\n"
+                          "    while(node != NULL && infix_power_%d(crnt_token()) >= level)\n"
+                          "        node = infix_%d(node);\n",
+                          id, id);
+}
+
+/*
+ * The functions that parse the levels of a cascade with precedence
+ * climbing. climb_N() returns the node of the level that it is given.
+ */
+static void emit_cascade(Cascade* cascade, int id) {
 
-#include "ast.h"
+    String* str     = create_string(NULL);
+    String* upper   = create_string(NULL);
+    IntVec* levels  = cascade->levels;
+    IrRule* operand = ir->rules[cascade->operand];
+    int prefixes    = 0;
+    int infixes     = 0;
+    int wraps       = 0;
 
-static int error(const char* fn, int state) {
-    fprintf(stderr, "Fatal internal error: invalid state in %s: %d\n", fn, state);
-    abort();
+    for(size_t i = 0; i < levels->len; i++) {
+        IrRule* rule = ir->rules[levels->list[i]];
+        prefixes |= (rule->prods->len > 1);
+        infixes |= (level_tail(ir, rule) != NULL);
+        wraps |= !elided(rule->id);
+    }
+
+    if(wraps)
+        emit_wrap(cascade, id, upper);
+
+    if(prefixes) {
+        emit_power(cascade, id, "prefix");
+        clear_string(str);
+        append_string_fmt(str, "static AstNode* prefix_%d(void)", id);
+        add_proto(str);
+        append_string_str(str, " {\n\n    switch(crnt_token()) {\n");
+        for(size_t i = 0; i < levels->len; i++) {
+            IrRule* rule = ir->rules[levels->list[i]];
+            for(size_t j = 0; j < rule->prods->len; j++) {
+                IrElemVec* elems = rule->prods->list[j]->elems;
+                if(elems->list[0]->type != IR_TERMINAL)
+                    continue;
+                emit_operator_case(str, rule, elems->list[0], upper);
+                emit_operator(str, cascade, id, elems->list[0], elems->list[1]);
+            }
+        }
+        append_string_str(str, "        default:\n            return NULL;\n    }\n}");
+        add_func(str);
+    }
+
+    if(infixes) {
+        emit_power(cascade, id, "infix");
+        clear_string(str);
+        append_string_fmt(str, "static AstNode* infix_%d(AstNode* left)", id);
+        add_proto(str);
+        append_string_str(str, " {\n\n    switch(crnt_token()) {\n");
+        for(size_t i = 0; i < levels->len; i++) {
+            IrRule* rule = ir->rules[levels->list[i]];
+            IrRule* tail = level_tail(ir, rule);
+            for(size_t j = 0; tail != NULL && j < tail->prods->len; j++) {
+                IrElemVec* elems = tail->prods->list[j]->elems;
+                emit_operator_case(str, rule, elems->list[1], upper);
+                if(elided(rule->id))
+                    append_string_fmt(str, "            node->%s = left;\n",
+                                      field_name(elems->list[0]));
+                else
+                    append_string_fmt(str, "            node->%s = (ast_%s_t*)left;\n",
+                                      field_name(elems->list[0]), raw_string(rule->name));
+                emit_operator(str, cascade, id, elems->list[1], elems->list[2]);
+            }
+        }
+        append_string_str(str, "        default:\n            return NULL;\n    }\n}");
+        add_func(str);
+    }
+
+    clear_string(str);
+    append_string_fmt(str, "static AstNode* climb_%d(int level)", id);
+    add_proto(str);
+    append_string_str(str, " {\n\n");
+    call_rule(operand->id);
+    if(!wraps)
+        emit_climb_elided(str, id, operand, prefixes, infixes);
+    else if(prefixes)
+        append_string_fmt(str,
+                          "    AstNode* node;\n"
+                          "    int at = prefix_power_%d(crnt_token());\n"
+                          "\n"
+                          "    if(at >= level)\n"
+                          "        node = prefix_%d();\n"
+                          "    else {\n"
+                          "        node = (AstNode*)parse_%s();\n"
+                          "        at   = %zu;\n"
+                          "    }\n",
+                          id, id, raw_string(operand->name), levels->len + 1);
+    else
+        append_string_fmt(str,
+                          "    AstNode* node = (AstNode*)parse_%s();\n"
+                          "    int at        = %zu;\n",
+                          raw_string(operand->name), levels->len + 1);
+    if(wraps && infixes)
+        append_string_fmt(str,
+                          "\n"
+                          "    int power;\n"
+                          "    while(node != NULL && (power = infix_power_%d(crnt_token())) >= level) {\n"
+                          "        for(; at > power; at--)\n"
+                          "            node = wrap_%d(node, at - 1);\n"
+                          "        node = infix_%d(node);\n"
+                          "    }\n",
+                          id, id, id);
+    if(wraps)
+        append_string_fmt(str,
+                          "\n"
+                          "    for(; node != NULL && at > level; at--)\n"
+                          "        node = wrap_%d(node, at - 1);\n",
+                          id);
+    append_string_str(str, "\n    return node;\n}");
+    add_func(str);
+
+    destroy_string(str);
+    destroy_string(upper);
 }
 
-static int dummy(void) {
-    // do nothing.
+/*
+ * Find the cascades in the rules that are used and not memoized, and number
+ * their levels.
+ */
+static void find_climbs(const char* used) {
+
+    char* allowed = _ALLOC_DS_ARRAY(char, ir->num_rules);
+    for(int i = 0; i < ir->num_rules; i++)
+        allowed[i] = used[i] && memo_ids[i] == 0;
+
+    cascades   = find_cascades(ir, an, allowed);
+    climb_ids  = _ALLOC_DS_ARRAY(int, ir->num_rules);
+    climb_nums = _ALLOC_DS_ARRAY(int, ir->num_rules);
+
+    int mark = 0;
+    Cascade* cascade;
+    for(int id = 1; NULL != (cascade = iterate_ptr_lst(cascades, &mark)); id++) {
+        for(size_t i = 0; i < cascade->levels->len; i++) {
+            IrRule* rule         = ir->rules[cascade->levels->list[i]];
+            IrRule* tail         = level_tail(ir, rule);
+            climb_ids[rule->id]  = id;
+            climb_nums[rule->id] = i + 1;
+            if(tail != NULL)
+                climb_ids[tail->id] = -1;
+        }
+    }
+
+    // the levels call each other with climb_N() and not with parse_X()
+    climb_outs    = _ALLOC_DS_ARRAY(char, ir->num_rules);
+    climb_outs[0] = 1;
+    for(int i = 0; i < ir->num_rules; i++) {
+        IrRule* rule = ir->rules[i];
+        int owner    = (climb_ids[i] < 0) ? climb_ids[rule->parent] : climb_ids[i];
+        for(size_t j = 0; used[i] && j < rule->prods->len; j++) {
+            IrElemVec* elems = rule->prods->list[j]->elems;
+            for(size_t k = 0; k < elems->len; k++) {
+                int sym = elems->list[k]->sym;
+                if(elems->list[k]->type != IR_TERMINAL && (owner == 0 || climb_ids[sym] != owner))
+                    climb_outs[sym] = 1;
+            }
+        }
+    }
+
+    _FREE(allowed);
+}
+
+/*
+ * Returns non-zero if the target can be reached from the elements of the
+ * rule.
+ */
+static int reaches(IrRule* rule, int target, char* seen) {
+
+    for(size_t i = 0; i < rule->prods->len; i++) {
+        IrElemVec* elems = rule->prods->list[i]->elems;
+        for(size_t j = 0; j < elems->len; j++) {
+            int sym = elems->list[j]->sym;
+            if(elems->list[j]->type == IR_TERMINAL || seen[sym])
+                continue;
+            if(sym == target)
+                return 1;
+            seen[sym] = 1;
+            if(reaches(ir->rules[sym], target, seen))
+                return 1;
+        }
+    }
+
     return 0;
 }
 
-static int parse_source_pre(AstNode* node) {
+/*
+ * The number of elements in the rule and in its groups.
+ */
+static int rule_size(IrRule* rule) {
+
+    int size = 0;
+
+    for(size_t i = 0; i < rule->prods->len; i++) {
+        IrElemVec* elems = rule->prods->list[i]->elems;
+        for(size_t j = 0; j < elems->len; j++) {
+            IrElem* elem = elems->list[j];
+            size++;
+            if(elem->type == IR_RULE && ir->rules[elem->sym]->parent == rule->id)
+                size += rule_size(ir->rules[elem->sym]);
+        }
+    }
+
+    return size;
+}
+
+/*
+ * Mark the grammar rules that are inlined. They are small, they cannot reach
+ * themselves, and the switch that chooses their production has no
+ * decisions. A rule that is memoized, a level of a cascade or elided keeps
+ * its function.
+ */
+static void find_inlines(const char* used) {
+
+    char* seen = _ALLOC_DS_ARRAY(char, ir->num_rules);
+    inlines    = _ALLOC_DS_ARRAY(char, ir->num_rules);
+    calls      = _ALLOC_DS_ARRAY(char, ir->num_rules);
+
+    for(int i = 1; i < ir->num_grammar_rules; i++) {
+        IrRule* rule = ir->rules[i];
+        if(!used[i] || memo_ids[i] != 0 || climb_ids[i] != 0 || elided(i) ||
+           rule_size(rule) > INLINE_SIZE)
+            continue;
+
+        PtrLst* cases = make_cases(rule);
+        int mark      = 0;
+        int simple    = 1;
+        _case_t_* cs;
+        while(NULL != (cs = iterate_ptr_lst(cases, &mark)))
+            simple &= (cs->count == 1);
+        destroy_cases(cases);
+
+        memset(seen, 0, ir->num_rules);
+        inlines[i] = simple && !reaches(rule, i, seen);
+    }
+
+    _FREE(seen);
+}
+
+/*
+ * Mark the groups of the lists in the rules that are used. Returns non-zero
+ * if there are any.
+ */
+static int find_lists(const char* used) {
+
+    int found = 0;
+
+    lists = _ALLOC_DS_ARRAY(char, ir->num_rules);
+    for(int i = 0; i < ir->num_rules; i++) {
+        IrProdVec* prods = ir->rules[i]->prods;
+        for(size_t j = 0; used[i] && j < prods->len; j++) {
+            for(size_t k = 0; k < prods->list[j]->elems->len; k++) {
+                IrRule* list = list_group(ir, an, prods->list[j], k);
+                if(list != NULL)
+                    lists[list->id] = found = 1;
+            }
+        }
+    }
+
+    return found;
+}
+
+/*
+ * A level of a cascade climbs from its own level. The first one makes the
+ * functions of the cascade. A level that only the cascade calls has no
+ * function of its own.
+ */
+static void emit_level(IrRule* rule) {
+
+    const char* name = raw_string(rule->name);
+    int id           = climb_ids[rule->id];
+    String* str      = create_string(NULL);
+
+    if(climb_nums[rule->id] == 1)
+        emit_cascade(get_ptr_lst(cascades, id - 1), id);
+    if(!climb_outs[rule->id]) {
+        destroy_string(str);
+        return;
+    }
+
+    if(elided(rule->id)) {
+        append_string_fmt(str, "static AstNode* parse_%s(void)", name);
+        add_proto(str);
+        append_string_fmt(str, " {\n\n    return climb_%d(%d);\n}", id, climb_nums[rule->id]);
+    }
+    else {
+        append_string_fmt(str, "static ast_%s_t* parse_%s(void)", name, name);
+        add_proto(str);
+        append_string_fmt(str, " {\n\n    return (ast_%s_t*)climb_%d(%d);\n}", name, id,
+                          climb_nums[rule->id]);
+    }
+    add_func(str);
+    destroy_string(str);
+}
+
+/*
+ * The function that returns the node of a rule whose node can be elided. It
+ * is the child when the production only passed it through, or else a copy
+ * of the node that was made on the stack.
+ */
+static void emit_keep(IrRule* rule, String* upper) {
+
+    const char* name = raw_string(rule->name);
+    String* str      = create_string(NULL);
+
+    append_string_fmt(str, "static AstNode* keep_%s(ast_%s_t* node, int found)", name, name);
+    add_proto(str);
+    append_string_str(str, " {\n\n    switch(found) {\n");
+    for(size_t i = 0; i < rule->prods->len; i++) {
+        IrElem* elem = pass_through_elem(ir, rule->prods->list[i]);
+        if(elem != NULL)
+            append_string_fmt(str, "        case %zu:\n            return (AstNode*)node->%s;\n",
+                              i + 2, field_name(elem));
+    }
+    append_string_fmt(str,
+                      "        default:\n"
+                      "            break;\n"
+                      "    }\n"
+                      "\n"
+                      "    ast_%s_t* copy = (ast_%s_t*)create_ast_node(AST_%s);\n"
+                      "    *copy = *node;\n"
+                      "\n"
+                      "    return (AstNode*)copy;\n"
+                      "}",
+                      name, name, raw_string(upper));
+    add_func(str);
+
+    destroy_string(str);
+}
+
+static void emit_rule(IrRule* rule) {
+
+    const char* name = raw_string(rule->name);
+    String* upper    = copy_string(rule->name);
+    String* str      = create_string(NULL);
+    String* type     = create_string(NULL);
+    upper_string(upper);
+
+    emit_prods(rule);
+
+    append_string_fmt(str, "static %s* %s_%s(void)", node_type(rule, type),
+                      (memo_ids[rule->id] != 0) ? "match" : "parse", name);
+    add_proto(str);
+    append_string_str(str, " {\n\n");
+
+    if(elided(rule->id)) {
+        emit_keep(rule, upper);
+        append_string_fmt(str,
+                          "    ast_%s_t tmp;\n"
+                          "    ast_%s_t* node = &tmp;\n"
+                          "    int found;\n"
+                          "\n"
+                          "    memset(node, 0, sizeof(tmp));\n"
+                          "    node->type.type = AST_%s;\n",
+                          name, name, raw_string(upper));
+        clear_string(type);
+        append_string_fmt(type, "return keep_%s(node, found);", name);
+        if(rule->prods->len == 1)
+            append_string_fmt(str, "\n    if(0 != (found = prod_%s_1(node)))\n        %s\n", name,
+                              raw_string(type));
+        else
+            emit_switch(str, rule, raw_string(type));
+    }
+    else {
+        append_string_fmt(str, "    ast_%s_t* node = (ast_%s_t*)create_ast_node(AST_%s);\n",
+                          name, name, raw_string(upper));
+        if(rule->prods->len == 1)
+            append_string_fmt(str, "\n    if(prod_%s_1(node))\n        return node;\n", name);
+        else
+            emit_switch(str, rule, "return node;");
+    }
+
+    append_string_str(str, "\n    return NULL;\n}");
+    add_func(str);
+
+    if(memo_ids[rule->id] != 0) {
+        int id = memo_ids[rule->id];
+        // how far the rule looked is needed when it is in a decision
+        const char* far = !predicting ? "" :
+                                         "        if(memo->far > furthest)\n"
+                                         "            furthest = memo->far;\n";
+        node_type(rule, type);
+        clear_string(str);
+        append_string_fmt(str, "static %s* parse_%s(void)", raw_string(type), name);
+        add_proto(str);
+        append_string_fmt(str,
+                          " {\n\n"
+                          "    int start    = mark_tokens();\n"
+                          "    memo_t* memo = find_memo(%d, start);\n"
+                          "\n"
+                          "    if(memo->rule == %d) {\n"
+                          "%s"
+                          "        if(memo->node != NULL)\n"
+                          "            reset_tokens(memo->end);\n"
+                          "        return (%s*)memo->node;\n"
+                          "    }\n"
+                          "\n"
+                          "    %s* node = match_%s();\n"
+                          "    save_memo(%d, start, (AstNode*)node);\n"
+                          "\n"
+                          "    return node;\n"
+                          "}",
+                          id, id, far, raw_string(type), raw_string(type), name, id);
+        add_func(str);
+    }
+
+    destroy_string(str);
+    destroy_string(type);
+    destroy_string(upper);
+}
+
+static void add_key_set(String* key, const uint64_t* set) {
+
+    for(int i = 0; i < an->words; i++)
+        append_string_fmt(key, "%016llx", (unsigned long long)set[i]);
+    append_string_str(key, "\n");
+}
+
+/*
+ * Add what the code of a rule depends on, other than its lowered form, to
+ * the key of its fragment. That is what the analysis found for the rule and
+ * for the rules that it refers to, and what was chosen for them. A rule that
+ * is inlined is added with its lowered form, as deep as it is inlined.
+ */
+static void rule_context(IrRule* rule, String* key, int depth) {
+
+    uint64_t* after = _ALLOC_DS_ARRAY(uint64_t, an->words);
+    int id          = rule->id;
+
+    append_string_fmt(key, "%s %d %d %d %d %d %d\n", raw_string(rule->name), memo_ids[id],
+                      climb_ids[id], climb_nums[id], climb_outs[id], elided(id), inlines[id]);
+    add_key_set(key, rule_follow(an, id));
+
+    for(size_t i = 0; i < rule->prods->len; i++) {
+        IrProd* prod = rule->prods->list[i];
+        append_string_fmt(key, "| %d ", an->prod_nullable[prod->id]);
+        add_key_set(key, prod_first(an, prod->id));
+
+        for(size_t j = 0; j < prod->elems->len; j++) {
+            IrElem* elem = prod->elems->list[j];
+            if(elem->type == IR_TERMINAL)
+                continue;
+
+            IrRule* ref  = ir->rules[elem->sym];
+            IrRule* list = NULL;
+            int overlap  = 0;
+            memset(after, 0, an->words * sizeof(uint64_t));
+            if(elem->type == IR_RULE) {
+                list    = list_group(ir, an, prod, j);
+                overlap = elem_overlap(an, prod, j, after);
+            }
+
+            append_string_fmt(key, "  %s %d %d %d %d %d %s %d ", raw_string(ref->name),
+                              an->nullable[ref->id], elided(ref->id), inlines[ref->id],
+                              climb_ids[ref->id], climb_nums[ref->id],
+                              (list != NULL) ? raw_string(list->name) : "-", overlap);
+            add_key_set(key, rule_first(an, ref->id));
+            add_key_set(key, after);
+            if(list != NULL)
+                add_key_set(key, rule_first(an, list->id));
+
+            if(inlines[ref->id] && depth < INLINE_DEPTH) {
+                append_string_fmt(key, "inline %016llx\n",
+                                  (unsigned long long)fingerprint_rule(ir, ref));
+                rule_context(ref, key, depth + 1);
+            }
+        }
+    }
+
+    _FREE(after);
+}
+
+/*
+ * Make the functions of a rule into a new fragment. The first level of a
+ * cascade makes the functions of the whole cascade.
+ */
+static String* make_fragment(IrRule* rule) {
+
+    piece_head      = create_string(NULL);
+    piece_code      = create_string(NULL);
+    piece_ids       = create_hashtable();
+    piece_sets      = 0;
+    piece_decisions = 0;
+    memset(piece_calls, 0, ir->num_rules);
+
+    if(climb_ids[rule->id] > 0)
+        emit_level(rule);
+    else if(rule->parent >= 0)
+        emit_group(rule);
+    else
+        emit_rule(rule);
+
+    String* text = piece_head;
+    append_string_string(text, piece_code);
+    destroy_string(piece_code);
+    destroy_hashtable(piece_ids);
+    piece_head = NULL;
+    piece_code = NULL;
+    piece_ids  = NULL;
+
+    return text;
+}
+
+/*
+ * Add the protos and the functions in the fragment to the file. The numbers
+ * of the sets and the decisions in them are the ones in the fragment, so
+ * they are all replaced with the numbers in the file in one pass over each
+ * of the functions.
+ */
+static void use_fragment(String* frag) {
+
+    ReplaceTable* tab = create_replace_table();
+    String* find      = create_string(NULL);
+    const char* ptr   = raw_string(frag);
+    const char* end   = ptr + frag->length;
+    int sets          = 0;
+    int decisions     = 0;
+    int id;
+
+    while(ptr < end) {
+        char* next;
+        int type   = *ptr;
+        size_t len = strtoull(ptr + 1, &next, 10);
+        if(*next != '\n' || (size_t)(end - next - 1) < len)
+            break;
+
+        String* str = create_buffer((void*)(next + 1), len);
+        ptr         = next + 1 + len;
+
+        clear_string(find);
+        switch(type) {
+            case 's':
+                append_string_fmt(find, "@S%d@", ++sets);
+                add_replace_fmt(tab, raw_string(find), "%d", file_set_id(str));
+                break;
+            case 'd':
+                append_string_fmt(find, "@D%d@", ++decisions);
+                add_replace_fmt(tab, raw_string(find), "%d", ++num_decisions);
+                break;
+            case 'c':
+                if(find_hashtable(rule_ids, raw_string(str), &id, sizeof(id)) == HASH_OK)
+                    calls[id] = 1;
+                break;
+            case 'p':
+            case 'f':
+                if(sets + decisions > 0)
+                    replace_string_table(str, tab);
+                if(type == 'p')
+                    set_tpl_string(add_tpl_item(data, "protos"), "proto", str);
+                else
+                    set_tpl_string(add_tpl_item(data, "funcs"), "code", str);
+                break;
+            default:
+                fprintf(stderr, "Fatal internal error: invalid state in %s: %d\n", __func__,
+                        type);
+                abort();
+        }
+        destroy_string(str);
+    }
+
+    destroy_string(find);
+    destroy_replace_table(tab);
+}
+
+/*
+ * Add the functions of a rule to the file. They are taken from the fragment
+ * store when the rule, what the analysis found for the rules around it and
+ * what was chosen for them did not change. Otherwise they are made again.
+ */
+static void emit_unit(IrRule* rule, const char* fname, const char* base) {
+
+    Fragments* frags = get_fragments();
+    String* key      = create_string(base);
+
+    append_string_fmt(key, "%016llx\n", (unsigned long long)fingerprint_rule(ir, top_rule(rule)));
+    rule_context(rule, key, 0);
+    if(climb_nums[rule->id] == 1) {
+        Cascade* cascade = get_ptr_lst(cascades, climb_ids[rule->id] - 1);
+        for(size_t i = 0; i < cascade->levels->len; i++) {
+            IrRule* level = ir->rules[cascade->levels->list[i]];
+            IrRule* tail  = level_tail(ir, level);
+            append_string_fmt(key, "level %016llx\n",
+                              (unsigned long long)fingerprint_rule(ir, level));
+            rule_context(level, key, INLINE_DEPTH);
+            if(tail != NULL)
+                rule_context(tail, key, INLINE_DEPTH);
+        }
+    }
+    uint64_t fp = hash_bytes(raw_string(key), key->length);
+
+    clear_string(key);
+    append_string_fmt(key, "%s/%s", fname, raw_string(rule->name));
+
+    String* text = find_fragment(frags, raw_string(key), fp);
+    if(text == NULL) {
+        text = make_fragment(rule);
+        save_fragment(frags, raw_string(key), fp, text);
+    }
+    use_fragment(text);
+
+    destroy_string(key);
+}
+
+/*
+ * Add the grammar rules that can be started at the same token as the
+ * elements from idx on to the set. Returns non-zero if the set changed.
+ */
+static int starts_of_elems(IrProd* prod, size_t idx, uint64_t* starts, uint64_t* set, int words) {
+
+    int changed = 0;
 
-    return (node->type == AST_TERMINAL)         ? dummy() :
-            (node->type == AST_NON_TERMINAL) ? dummy() :
-            (node->type == AST_ZERO_OR_ONE)     ? dummy() :
-            (node->type == AST_ONE_OR_MORE)     ? dummy() :
-            (node->type == AST_ZERO_OR_MORE)    ? dummy() :
-            (node->type == AST_GROUP)           ? dummy() :
-            (node->type == AST_GRAMMAR)         ? dummy() :
-            (node->type == AST_RULE)            ? dummy() :
-            (node->type == AST_PRODUCTION_LIST) ? dummy() :
-            (node->type == AST_PRODUCTION)      ? dummy() :
-            (node->type == AST_PROD_ELEM)       ? dummy() :
-                                                  error(__func__, node->type);
+    for(size_t i = idx; i < prod->elems->len; i++) {
+        IrElem* elem = prod->elems->list[i];
+        if(elem->type == IR_LEFT)
+            continue;
+        if(elem->type == IR_TERMINAL)
+            break;
+        changed |= union_bits(set, &starts[(size_t)elem->sym * words], words);
+        if(elem->min > 0 && !an->nullable[elem->sym])
+            break;
+    }
+
+    return changed;
 }
 
-static int parse_source_post(AstNode* node) {
+/*
+ * Mark the grammar rules that are in both sets.
+ */
+static void mark_both(char* marks, const uint64_t* a, const uint64_t* b) {
 
-    return (node->type == AST_TERMINAL)         ? dummy() :
-            (node->type == AST_NON_TERMINAL) ? dummy() :
-            (node->type == AST_ZERO_OR_ONE)     ? dummy() :
-            (node->type == AST_ONE_OR_MORE)     ? dummy() :
-            (node->type == AST_ZERO_OR_MORE)    ? dummy() :
-            (node->type == AST_GROUP)           ? dummy() :
-            (node->type == AST_GRAMMAR)         ? dummy() :
-            (node->type == AST_RULE)            ? dummy() :
-            (node->type == AST_PRODUCTION_LIST) ? dummy() :
-            (node->type == AST_PRODUCTION)      ? dummy() :
-            (node->type == AST_PROD_ELEM)       ? dummy() :
-                                                  error(__func__, node->type);
+    for(int i = 0; i < ir->num_grammar_rules; i++)
+        if(test_bit(a, i) && test_bit(b, i))
+            marks[i] = 1;
 }
 
-void emit_parse_source(void) {
+/*
+ * Mark the grammar rules that can be started at the same token by two
+ * alternatives that are tried one after the other, or by a group that is
+ * tried and the elements after it.
+ */
+static void find_reentered(char* marks) {
+
+    int words        = BITSET_WORDS(ir->num_rules);
+    uint64_t* starts = _ALLOC_DS_ARRAY(uint64_t, (size_t)ir->num_rules * words);
+    uint64_t* tried  = _ALLOC_DS_ARRAY(uint64_t, words);
+    uint64_t* next   = _ALLOC_DS_ARRAY(uint64_t, words);
+    uint64_t* after  = _ALLOC_DS_ARRAY(uint64_t, an->words);
+
+    // the grammar rules that each rule can start with, including itself
+    for(int i = 0; i < ir->num_grammar_rules; i++)
+        set_bit(&starts[(size_t)i * words], i);
+    for(int changed = 1; changed;) {
+        changed = 0;
+        for(int i = 0; i < ir->num_rules; i++) {
+            IrProdVec* prods = ir->rules[i]->prods;
+            uint64_t* set    = &starts[(size_t)i * words];
+            for(size_t j = 0; j < prods->len; j++)
+                changed |= starts_of_elems(prods->list[j], 0, starts, set, words);
+        }
+    }
+
+    for(int i = 0; i < ir->num_rules; i++) {
+        IrRule* rule = ir->rules[i];
+
+        if(rule->prods->len > 1) {
+            PtrLst* cases = make_cases(rule);
+            int mark      = 0;
+            _case_t_* cs;
+            while(NULL != (cs = iterate_ptr_lst(cases, &mark))) {
+                memset(tried, 0, words * sizeof(uint64_t));
+                for(int j = 0; j < cs->count; j++) {
+                    memset(next, 0, words * sizeof(uint64_t));
+                    starts_of_elems(rule->prods->list[cs->prods[j]], 0, starts, next, words);
+                    mark_both(marks, tried, next);
+                    union_bits(tried, next, words);
+                }
+            }
+            destroy_cases(cases);
+        }
+
+        for(size_t j = 0; j < rule->prods->len; j++) {
+            IrProd* prod = rule->prods->list[j];
+            for(size_t k = 0; k < prod->elems->len; k++) {
+                IrElem* elem = prod->elems->list[k];
+                if(elem->type != IR_RULE || (elem->min == 1 && elem->max == 1))
+                    continue;
+                memset(after, 0, an->words * sizeof(uint64_t));
+                if(!elem_overlap(an, prod, k, after))
+                    continue;
+                memset(next, 0, words * sizeof(uint64_t));
+                starts_of_elems(prod, k + 1, starts, next, words);
+                mark_both(marks, &starts[(size_t)elem->sym * words], next);
+            }
+        }
+    }
+
+    _FREE(starts);
+    _FREE(tried);
+    _FREE(next);
+    _FREE(after);
+}
+
+/*
+ * Returns non-zero if any of the rules that are used has a decision that is
+ * predicted.
+ */
+static int has_decisions(const char* used) {
+
+    int found = 0;
+
+    for(int i = 0; i < ir->num_rules && !found; i++) {
+        if(!used[i] || ir->rules[i]->prods->len < 2)
+            continue;
+        PtrLst* cases = make_cases(ir->rules[i]);
+        int mark      = 0;
+        _case_t_* cs;
+        while(NULL != (cs = iterate_ptr_lst(cases, &mark)))
+            found |= (cs->count > 1);
+        destroy_cases(cases);
+    }
+
+    return found;
+}
+
+/*
+ * Number the grammar rules that are memoized and used. The spec is a list
+ * of rule names and "auto", separated by commas.
+ */
+static void find_memo_rules(const char* spec, const char* used) {
+
+    memo_ids  = _ALLOC_DS_ARRAY(int, ir->num_rules);
+    num_memos = 0;
+    if(spec == NULL)
+        return;
+
+    char* marks = _ALLOC_DS_ARRAY(char, ir->num_rules);
+    String* str = create_string(spec);
+    int post    = 0;
+    StrSlice tok;
+
+    while(NULL != (tok = tokenize_string(str, &post, ", ")).ptr) {
+        String* name = create_string_slice(tok);
+        int i;
+        for(i = 0; i < ir->num_grammar_rules; i++)
+            if(!comp_string_string(name, ir->rules[i]->name))
+                break;
+
+        if(!comp_string_str(name, "auto"))
+            find_reentered(marks);
+        else if(i < ir->num_grammar_rules)
+            marks[i] = 1;
+        else
+            fprintf(stderr, "warning: there is no rule named '%s' to memoize\n",
+                    raw_string(name));
+        destroy_string(name);
+    }
+
+    for(int i = 0; i < ir->num_rules; i++)
+        if(marks[i] && used[i])
+            memo_ids[i] = ++num_memos;
+
+    destroy_string(str);
+    _FREE(marks);
+}
+
+/*
+ * Mark the rules that the first rule uses, and the ones that they use.
+ */
+static void find_used(IrRule* rule, char* used) {
+
+    used[rule->id] = 1;
+    for(size_t i = 0; i < rule->prods->len; i++) {
+        IrProd* prod = rule->prods->list[i];
+        for(size_t j = 0; j < prod->elems->len; j++) {
+            IrElem* elem = prod->elems->list[j];
+            if(elem->type == IR_RULE && !used[elem->sym])
+                find_used(ir->rules[elem->sym], used);
+        }
+    }
+}
+
+void emit_parse_source(const char* name, const char* memo, int elide) {
+
+    if(source_tpl == NULL)
+        source_tpl = create_template("parse source", source_text);
+
+    ir       = get_ir();
+    an       = get_analysis();
+    data     = create_tpl_data();
+    set_ids  = create_hashtable();
+    num_sets = 0;
+
+    String* str = create_string(name);
+    append_string_str(str, ".h");
+    const char* ptr = strrchr(raw_string(str), '/');
+    set_tpl_str(data, "header", (ptr != NULL) ? ptr + 1 : raw_string(str));
+    set_tpl_string(data, "start", ir->rules[0]->name);
+
+    char* used = _ALLOC_DS_ARRAY(char, ir->num_rules);
+    find_used(ir->rules[0], used);
+    find_memo_rules(memo, used);
+    predicting    = has_decisions(used);
+    num_decisions = 0;
+    find_climbs(used);
+    passes = elide ? find_pass_through(ir) : NULL;
+    find_inlines(used);
+    if(find_lists(used))
+        set_tpl_str(data, "lists", "1");
+    if(num_memos > 0) {
+        clear_string(str);
+        append_string_fmt(str, "%d", num_memos);
+        set_tpl_string(data, "memo", str);
+    }
+
+    // what the code of every rule depends on
+    String* base = create_string(NULL);
+    append_string_fmt(base, "%016llx %d\n",
+                      (unsigned long long)hash_bytes(source_text, strlen(source_text)),
+                      predicting);
+    for(int i = 0; i < an->end; i++)
+        append_string_fmt(base, "%s ", raw_string(ir->terms[i]));
+    append_string_str(base, "\n");
+
+    rule_ids    = create_hashtable();
+    piece_calls = _ALLOC_DS_ARRAY(char, ir->num_rules);
+    for(int i = 0; i < ir->num_rules; i++)
+        insert_hashtable(rule_ids, raw_string(ir->rules[i]->name), &i, sizeof(i));
+
+    clear_string(str);
+    append_string_fmt(str, "%s.c", name);
+    for(int i = 0; i < ir->num_rules; i++) {
+        if(!used[i] || climb_ids[i] < 0 || inlines[i] || lists[i])
+            continue;
+        emit_unit(ir->rules[i], raw_string(str), raw_string(base));
+    }
+    // the rules that are inlined and still called, which can call others
+    char* made = _ALLOC_DS_ARRAY(char, ir->num_rules);
+    for(int changed = 1; changed;) {
+        changed = 0;
+        for(int i = 0; i < ir->num_rules; i++) {
+            if(inlines[i] && calls[i] && !made[i]) {
+                emit_unit(ir->rules[i], raw_string(str), raw_string(base));
+                made[i] = changed = 1;
+            }
+        }
+    }
+    _FREE(made);
+    _FREE(piece_calls);
+    destroy_hashtable(rule_ids);
+    destroy_string(base);
+    piece_calls = NULL;
+    rule_ids    = NULL;
+    _FREE(used);
+    _FREE(memo_ids);
+    _FREE(climb_ids);
+    _FREE(climb_nums);
+    _FREE(climb_outs);
+    _FREE(passes);
+    _FREE(inlines);
+    _FREE(calls);
+    _FREE(lists);
+    passes  = NULL;
+    inlines = NULL;
+    calls   = NULL;
+    lists   = NULL;
+    destroy_cascades(cascades);
+    cascades = NULL;
+
+    if(num_decisions > 0) {
+        clear_string(str);
+        append_string_fmt(str, "%d", num_decisions);
+        set_tpl_string(data, "decisions", str);
+    }
+
+    clear_string(str);
+    append_string_fmt(str, "%s.c", name);
+
+    FILE* outfile = open_output(raw_string(str));
+    emit_template(outfile, source_tpl, data);
+    close_output(outfile);
+
+    destroy_string(str);
+    destroy_hashtable(set_ids);
+    destroy_tpl_data(data);
+    set_ids = NULL;
+    data    = NULL;
+}
+
+/**
+ * @brief Free the template. It is compiled again the next time that the
+ * source is emitted.
+ */
+void destroy_parse_source_template(void) {
 
-    traverse_ast(parse_source_pre, parse_source_post);
+    destroy_template(source_tpl);
+    source_tpl = NULL;
 }
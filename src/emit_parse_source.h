@@ -12,7 +12,8 @@
 #ifndef _EMIT_PARSE_SOURCE_H_
 #define _EMIT_PARSE_SOURCE_H_
 
-void emit_parse_source(void);
+void emit_parse_source(const char* name, const char* memo, int elide);
+void destroy_parse_source_template(void);
 
 
 #endif  /* _EMIT_PARSE_SOURCE_H_ */
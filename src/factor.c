@@ -0,0 +1,251 @@
+/**
+ * @file factor.c
+ *
+ * @brief Left factor the productions of the grammar rules, so that a prefix
+ * that several alternatives start with is parsed one time.
+ *
+ *   assignment : ref '=' item | ref '+=' item | ref '-=' expr ;
+ *
+ * becomes a rule that matches the prefix and then chooses the rest.
+ *
+ *   assignment : ref assignment_suffix ;
+ *   assignment_suffix : '=' item | '+=' item | '-=' expr ;
+ *
+ * The rest is a synthetic rule at depth 1, so its fields are in the struct of
+ * the grammar rule and the AST does not change. Only productions that are
+ * next to each other are factored. That keeps the order that the
+ * alternatives are tried in and the order of the fields in the struct.
+ *
+ * An alternative that is only the prefix matches whenever the prefix does,
+ * so the ones after it are never tried. It can only be factored when it is
+ * the last one, and then the rest is optional. In
+ *
+ *   item : IDENT | IDENT '(' ')' ;
+ *
+ * the second one is never matched, and the rule is left the way it is.
+ *
+ * @author Chuck Tilbury (chucktilbury@gmail.com)
+ * @version 0.0
+ * @date 2024-08-24
+ * @copyright Copyright (c) 2024
+ *
+ */
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "analysis.h"
+#include "factor.h"
+#include "ir.h"
+#include "memory.h"
+#include "str.h"
+
+// set when a production was factored
+static int changed = 0;
+
+static int same_rule(IrGrammar* ir, IrRule* a, IrRule* b);
+
+static int same_name(String* a, String* b) {
+
+    if(a == NULL || b == NULL)
+        return a == b;
+
+    return !comp_string_string(a, b);
+}
+
+/*
+ * Elements are the same if they match the same thing the same number of
+ * times and store it in the same field. Groups are compared by what is in
+ * them, because every group is a rule of its own.
+ */
+static int same_elem(IrGrammar* ir, IrElem* a, IrElem* b) {
+
+    if(a->type != b->type || a->type == IR_LEFT || a->min != b->min || a->max != b->max ||
+       !same_name(a->name, b->name))
+        return 0;
+
+    if(a->sym == b->sym)
+        return 1;
+
+    if(a->type == IR_TERMINAL || ir->rules[a->sym]->parent < 0 || ir->rules[b->sym]->parent < 0)
+        return 0;
+
+    return same_rule(ir, ir->rules[a->sym], ir->rules[b->sym]);
+}
+
+static int same_rule(IrGrammar* ir, IrRule* a, IrRule* b) {
+
+    if(a->prods->len != b->prods->len)
+        return 0;
+
+    for(size_t i = 0; i < a->prods->len; i++) {
+        IrElemVec* x = a->prods->list[i]->elems;
+        IrElemVec* y = b->prods->list[i]->elems;
+        if(x->len != y->len)
+            return 0;
+        for(size_t j = 0; j < x->len; j++)
+            if(!same_elem(ir, x->list[j], y->list[j]))
+                return 0;
+    }
+
+    return 1;
+}
+
+/*
+ * The number of elements that the productions from first to last all start
+ * with.
+ */
+static size_t prefix_len(IrGrammar* ir, IrProdVec* prods, size_t first, size_t last) {
+
+    IrElemVec* elems = prods->list[first]->elems;
+    size_t len;
+
+    for(len = 0; len < elems->len; len++) {
+        for(size_t i = first + 1; i < last; i++) {
+            IrElemVec* other = prods->list[i]->elems;
+            if(len >= other->len || !same_elem(ir, elems->list[len], other->list[len]))
+                return len;
+        }
+    }
+
+    return len;
+}
+
+/*
+ * The number of the productions from first to last that can be factored. The
+ * run stops at the first one that is only the prefix, because the ones
+ * after it are never tried.
+ */
+static size_t prefix_run(IrGrammar* ir, IrProdVec* prods, size_t first, size_t last) {
+
+    size_t len = prefix_len(ir, prods, first, last);
+
+    for(size_t i = first; i < last; i++)
+        if(prods->list[i]->elems->len == len)
+            return i - first + 1;
+
+    return last - first;
+}
+
+/*
+ * Take the prefix off of the production. The elements of the first one are
+ * kept for the production that matches the prefix.
+ */
+static void remove_prefix(IrProd* prod, size_t len, int keep) {
+
+    IrElemVec* elems = create_ir_elem_vec();
+
+    for(size_t i = 0; i < prod->elems->len; i++) {
+        if(i >= len)
+            append_ir_elem_vec(elems, prod->elems->list[i]);
+        else if(!keep)
+            destroy_ir_elem(prod->elems->list[i]);
+    }
+
+    destroy_ir_elem_vec(prod->elems);
+    prod->elems = elems;
+}
+
+static void factor_rule(IrGrammar* ir, IrRule* rule, IrRule* top);
+
+/*
+ * Replace the productions from first to last with one that matches the
+ * prefix and then a rule that matches the rest of them.
+ */
+static IrProd* factor_prods(IrGrammar* ir, IrRule* rule, IrRule* top, size_t first, size_t last) {
+
+    IrProdVec* prods = rule->prods;
+    size_t len       = prefix_len(ir, prods, first, last);
+
+    IrProd* prod = _ALLOC_DS(IrProd);
+    prod->rule   = rule->id;
+    prod->elems  = create_ir_elem_vec();
+    for(size_t i = 0; i < len; i++)
+        append_ir_elem_vec(prod->elems, prods->list[first]->elems->list[i]);
+
+    // only the last production can be the prefix alone, then the rest is optional
+    IrRule* rest = NULL;
+    for(size_t i = first; i < last && rest == NULL; i++)
+        if(prods->list[i]->elems->len > len)
+            rest = add_ir_rule(ir, ir_rule_name(ir, top, "suffix"), rule->id, 1);
+
+    int empty = 0;
+    for(size_t i = first; i < last; i++) {
+        IrProd* ptr = prods->list[i];
+        remove_prefix(ptr, len, i == first);
+        if(ptr->elems->len > 0) {
+            ptr->rule = rest->id;
+            append_ir_prod_vec(rest->prods, ptr);
+        }
+        else {
+            destroy_ir_elem_vec(ptr->elems);
+            _FREE(ptr);
+            empty = 1;
+        }
+    }
+
+    if(rest != NULL) {
+        IrElem* elem = create_ir_elem(IR_RULE, rest->id, rest->name, NULL);
+        elem->min    = empty ? 0 : 1;
+        append_ir_elem_vec(prod->elems, elem);
+        factor_rule(ir, rest, top);
+    }
+
+    changed = 1;
+    return prod;
+}
+
+/*
+ * The rest of the productions can share a prefix as well, so the rules that
+ * are made for them are factored too.
+ */
+static void factor_rule(IrGrammar* ir, IrRule* rule, IrRule* top) {
+
+    IrProdVec* prods = create_ir_prod_vec();
+    size_t first     = 0;
+
+    while(first < rule->prods->len) {
+        IrProd* prod = rule->prods->list[first];
+        size_t last  = first + 1;
+
+        if(prod->elems->len > 0)
+            while(last < rule->prods->len && rule->prods->list[last]->elems->len > 0 &&
+                  same_elem(ir, prod->elems->list[0], rule->prods->list[last]->elems->list[0]))
+                last++;
+        last = first + prefix_run(ir, rule->prods, first, last);
+
+        if(last - first > 1)
+            append_ir_prod_vec(prods, factor_prods(ir, rule, top, first, last));
+        else
+            append_ir_prod_vec(prods, prod);
+        first = last;
+    }
+
+    destroy_ir_prod_vec(rule->prods);
+    rule->prods = prods;
+}
+
+/******************************************************************************
+ *
+ * Public Interface
+ *
+ */
+
+/**
+ * @brief Left factor the grammar rules of the IR. The grammar is analyzed
+ * again if anything changed.
+ */
+void factor_grammar(void) {
+
+    IrGrammar* ir = get_ir();
+    if(ir == NULL)
+        return;
+
+    changed = 0;
+    for(int i = 0; i < ir->num_grammar_rules; i++)
+        factor_rule(ir, ir->rules[i], ir->rules[i]);
+
+    if(changed) {
+        number_ir_prods(ir);
+        analyze_grammar();
+    }
+}
@@ -0,0 +1,17 @@
+/**
+ * @file factor.h
+ *
+ * @brief Public interface to left factoring the productions of the IR.
+ *
+ * @author Chuck Tilbury (chucktilbury@gmail.com)
+ * @version 0.0
+ * @date 2024-08-24
+ * @copyright Copyright (c) 2024
+ *
+ */
+#ifndef _FACTOR_H_
+#define _FACTOR_H_
+
+void factor_grammar(void);
+
+#endif /* _FACTOR_H_ */
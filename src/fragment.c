@@ -0,0 +1,330 @@
+/**
+ * @file fragment.c
+ *
+ * @brief The fragment store keeps the text that the emitters made for each
+ * rule, so that only the rules that changed are generated again. The store
+ * belongs to the loader state, so it lasts as long as the parsed modules do,
+ * such as between the runs in watch mode. If there is a cache directory then
+ * it is also saved there for the next run.
+ *
+ *   <cache>/fragments/<hash of name>.frag
+ *
+ * Fragments that were not used by the last call to emit() are dropped so
+ * that rules that were removed from the grammar do not stay in the store.
+ *
+ * @author Chuck Tilbury (chucktilbury@gmail.com)
+ * @version 0.0
+ * @date 2024-08-18
+ * @copyright Copyright (c) 2024
+ *
+ */
+#define _POSIX_C_SOURCE 200809L
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "fragment.h"
+#include "hash.h"
+#include "memory.h"
+#include "ptr_lst.h"
+#include "str.h"
+#include "version.h"
+
+// followed by the build id, because the code of a rule that was saved by
+// another build of pargen can be different
+#define FRAGMENT_MAGIC "pargen fragments 1"
+
+typedef struct {
+    String* key;
+    uint64_t fingerprint;
+    String* text;
+    int used;
+} _fragment_t_;
+
+struct _fragments_ {
+    PtrLst* list;
+    // key -> index in the list
+    HashTable* index;
+    int loaded;
+    int dirty;
+};
+
+static void destroy_fragment(_fragment_t_* frag) {
+
+    destroy_string(frag->key);
+    destroy_string(frag->text);
+    _FREE(frag);
+}
+
+static _fragment_t_* find(Fragments* frags, const char* key) {
+
+    int idx;
+
+    if(find_hashtable(frags->index, key, &idx, sizeof(idx)) != HASH_OK)
+        return NULL;
+
+    return frags->list->list[idx];
+}
+
+static void add(Fragments* frags, _fragment_t_* frag) {
+
+    int idx = frags->list->len;
+    append_ptr_lst(frags->list, frag);
+    insert_hashtable(frags->index, raw_string(frag->key), &idx, sizeof(idx));
+}
+
+static String* store_name(const char* cache_dir, const char* name) {
+
+    String* str = create_string(cache_dir);
+    append_string_fmt(str, "/fragments/%016llx.frag",
+                      (unsigned long long)hash_bytes(name, strlen(name)));
+
+    return str;
+}
+
+static String* magic_line(void) {
+
+    String* str = create_string(FRAGMENT_MAGIC);
+    append_string_fmt(str, " %s\n", pargen_build_id());
+
+    return str;
+}
+
+static void make_dir(const char* name) {
+
+    if(mkdir(name, 0777) != 0 && errno != EEXIST)
+        fprintf(stderr, "Warning: cannot create cache directory '%s': %s\n", name,
+                strerror(errno));
+}
+
+/******************************************************************************
+ *
+ * Public Interface
+ *
+ */
+
+/**
+ * @brief Create an empty fragment store.
+ *
+ * @return Fragments*
+ */
+Fragments* create_fragments(void) {
+
+    Fragments* frags = _ALLOC_DS(Fragments);
+    frags->list      = create_ptr_lst();
+    frags->index     = create_hashtable();
+
+    return frags;
+}
+
+/**
+ * @brief Free the store and all of the fragments in it.
+ *
+ * @param frags
+ */
+void destroy_fragments(Fragments* frags) {
+
+    if(frags != NULL) {
+        int mark = 0;
+        _fragment_t_* frag;
+        while(NULL != (frag = iterate_ptr_lst(frags->list, &mark)))
+            destroy_fragment(frag);
+        destroy_ptr_lst(frags->list);
+        destroy_hashtable(frags->index);
+        _FREE(frags);
+    }
+}
+
+/**
+ * @brief Return the text that was saved with the key, if it was saved with
+ * the same fingerprint. Otherwise, return NULL and the text must be made
+ * again.
+ *
+ * @param frags
+ * @param key
+ * @param fingerprint
+ * @return String*
+ */
+String* find_fragment(Fragments* frags, const char* key, uint64_t fingerprint) {
+
+    _fragment_t_* frag = find(frags, key);
+
+    if(frag == NULL || frag->fingerprint != fingerprint)
+        return NULL;
+
+    frag->used = 1;
+    return frag->text;
+}
+
+/**
+ * @brief Save the text with the key and the fingerprint. The store owns the
+ * text after this.
+ *
+ * @param frags
+ * @param key
+ * @param fingerprint
+ * @param text
+ */
+void save_fragment(Fragments* frags, const char* key, uint64_t fingerprint, String* text) {
+
+    _fragment_t_* frag = find(frags, key);
+
+    if(frag == NULL) {
+        frag      = _ALLOC_DS(_fragment_t_);
+        frag->key = create_string(key);
+        add(frags, frag);
+    }
+    else
+        destroy_string(frag->text);
+
+    frag->fingerprint = fingerprint;
+    frag->text        = text;
+    frag->used        = 1;
+    frags->dirty      = 1;
+}
+
+/**
+ * @brief Drop the fragments that were not used since the last time this was
+ * called.
+ *
+ * @param frags
+ */
+void prune_fragments(Fragments* frags) {
+
+    PtrLst* old = frags->list;
+    frags->list = create_ptr_lst();
+    destroy_hashtable(frags->index);
+    frags->index = create_hashtable();
+
+    int mark = 0;
+    _fragment_t_* frag;
+    while(NULL != (frag = iterate_ptr_lst(old, &mark))) {
+        if(frag->used) {
+            frag->used = 0;
+            add(frags, frag);
+        }
+        else {
+            destroy_fragment(frag);
+            frags->dirty = 1;
+        }
+    }
+
+    destroy_ptr_lst(old);
+}
+
+/**
+ * @brief Read the fragments that were saved in the cache directory under the
+ * name. This is only done one time for a store. A file that cannot be read
+ * is ignored.
+ *
+ *   pargen fragments 1 <build id>
+ *   <key length> <text length> <fingerprint>
+ *   <key><text>
+ *   ...
+ *
+ * @param frags
+ * @param cache_dir
+ * @param name
+ */
+void read_fragments(Fragments* frags, const char* cache_dir, const char* name) {
+
+    if(frags->loaded)
+        return;
+    frags->loaded = 1;
+
+    String* fname   = store_name(cache_dir, name);
+    String* content = create_string_file(raw_string(fname));
+    destroy_string(fname);
+    if(content == NULL)
+        return;
+
+    const char* ptr = raw_string(content);
+    const char* end = ptr + content->length;
+    String* magic   = magic_line();
+
+    if(content->length < magic->length || strncmp(ptr, raw_string(magic), magic->length)) {
+        destroy_string(magic);
+        destroy_string(content);
+        return;
+    }
+    ptr += magic->length;
+    destroy_string(magic);
+
+    while(ptr < end) {
+        char* next;
+        size_t klen           = strtoull(ptr, &next, 10);
+        size_t tlen           = strtoull(next, &next, 10);
+        unsigned long long fp = strtoull(next, &next, 16);
+
+        if(*next != '\n' || klen == 0)
+            break;
+        ptr = next + 1;
+        if((size_t)(end - ptr) < klen + tlen)
+            break;
+
+        _fragment_t_* frag = _ALLOC_DS(_fragment_t_);
+        frag->key          = create_buffer((void*)ptr, klen);
+        frag->text         = create_buffer((void*)(ptr + klen), tlen);
+        frag->fingerprint  = fp;
+        ptr += klen + tlen;
+
+        if(find(frags, raw_string(frag->key)) == NULL)
+            add(frags, frag);
+        else
+            destroy_fragment(frag);
+    }
+
+    destroy_string(content);
+}
+
+/**
+ * @brief Save the fragments in the cache directory under the name, if they
+ * changed since they were read.
+ *
+ * @param frags
+ * @param cache_dir
+ * @param name
+ */
+void write_fragments(Fragments* frags, const char* cache_dir, const char* name) {
+
+    if(!frags->dirty)
+        return;
+
+    String* dir = create_string(cache_dir);
+    make_dir(raw_string(dir));
+    append_string_str(dir, "/fragments");
+    make_dir(raw_string(dir));
+    destroy_string(dir);
+
+    String* fname = store_name(cache_dir, name);
+    String* tmp   = copy_string(fname);
+    append_string_fmt(tmp, ".%d", (int)getpid());
+
+    FILE* fp = fopen(raw_string(tmp), "wb");
+    if(fp != NULL) {
+        String* magic = magic_line();
+        fputs(raw_string(magic), fp);
+        destroy_string(magic);
+
+        int mark = 0;
+        _fragment_t_* frag;
+        while(NULL != (frag = iterate_ptr_lst(frags->list, &mark))) {
+            fprintf(fp, "%zu %zu %016llx\n", frag->key->length, frag->text->length,
+                    (unsigned long long)frag->fingerprint);
+            fwrite(frag->key->buffer, 1, frag->key->length, fp);
+            fwrite(frag->text->buffer, 1, frag->text->length, fp);
+        }
+
+        if(fclose(fp) == 0 && rename(raw_string(tmp), raw_string(fname)) == 0)
+            frags->dirty = 0;
+        else
+            remove(raw_string(tmp));
+    }
+
+    destroy_string(tmp);
+    destroy_string(fname);
+}
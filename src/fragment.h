@@ -0,0 +1,34 @@
+/**
+ * @file fragment.h
+ *
+ * @brief Public interface to the fragment store. An emitter saves the text
+ * that it made for a rule with a fingerprint of the rule. When the rule has
+ * the same fingerprint the next time, the saved text is used again instead
+ * of being generated.
+ *
+ * @author Chuck Tilbury (chucktilbury@gmail.com)
+ * @version 0.0
+ * @date 2024-08-18
+ * @copyright Copyright (c) 2024
+ *
+ */
+#ifndef _FRAGMENT_H_
+#define _FRAGMENT_H_
+
+#include <stdint.h>
+
+#include "str.h"
+
+typedef struct _fragments_ Fragments;
+
+Fragments* create_fragments(void);
+void destroy_fragments(Fragments* frags);
+
+String* find_fragment(Fragments* frags, const char* key, uint64_t fingerprint);
+void save_fragment(Fragments* frags, const char* key, uint64_t fingerprint, String* text);
+void prune_fragments(Fragments* frags);
+
+void read_fragments(Fragments* frags, const char* cache_dir, const char* name);
+void write_fragments(Fragments* frags, const char* cache_dir, const char* name);
+
+#endif /* _FRAGMENT_H_ */
@@ -37,15 +37,9 @@
 
 static uint32_t hash_func(const char* key) {
 
-    uint32_t hash = 2166136261u;
-    int slen      = strlen(key);
+    uint64_t hash = hash_bytes(key, strlen(key));
 
-    for(int i = 0; i < slen; i++) {
-        hash ^= (uint8_t)key[i];
-        hash *= 16777619;
-    }
-
-    return hash;
+    return (uint32_t)(hash ^ (hash >> 32));
 }
 
 static int find_slot(HashTable* tab, const char* key) {
@@ -208,6 +202,46 @@ HashResult remove_hashtable(HashTable* tab, const char* key) {
     return HASH_NF;
 }
 
+/*
+ * Hash an arbitrary block of memory, such as the contents of a file, into a
+ * 64 bit number. This is used to tell if the content of something changed
+ * without keeping a copy of it around, and for the keys of the hash tables.
+ * The bytes are taken 8 at a time. (MurmurHash64A)
+ */
+#define HASH_MUL 0xc6a4a7935bd1e995ull
+#define HASH_SHIFT 47
+
+uint64_t hash_bytes(const void* ptr, size_t len) {
+
+    const uint8_t* bytes = (const uint8_t*)ptr;
+    const uint8_t* end   = bytes + (len & ~(size_t)7);
+    uint64_t hash        = 0x9e3779b97f4a7c15ull ^ (len * HASH_MUL);
+    uint64_t word;
+
+    for(; bytes < end; bytes += 8) {
+        memcpy(&word, bytes, 8);
+        word *= HASH_MUL;
+        word ^= word >> HASH_SHIFT;
+        word *= HASH_MUL;
+        hash ^= word;
+        hash *= HASH_MUL;
+    }
+
+    if(len & 7) {
+        word = 0;
+        for(size_t i = len & 7; i > 0; i--)
+            word = (word << 8) | bytes[i - 1];
+        hash ^= word;
+        hash *= HASH_MUL;
+    }
+
+    hash ^= hash >> HASH_SHIFT;
+    hash *= HASH_MUL;
+    hash ^= hash >> HASH_SHIFT;
+
+    return hash;
+}
+
 void dump_hashtable(HashTable* tab) {
 
     int count = 1;
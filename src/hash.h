@@ -4,6 +4,7 @@
 #ifndef _HASH_H_
 #define _HASH_H_
 
+#include <stdint.h>
 #include <stdlib.h> // size_t
 
 typedef struct {
@@ -39,4 +40,6 @@ HashResult remove_hashtable(HashTable* tab, const char* key);
 
 void dump_hashtable(HashTable* tab);
 
+uint64_t hash_bytes(const void* ptr, size_t len);
+
 #endif
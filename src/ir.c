@@ -0,0 +1,607 @@
+/**
+ * @file ir.c
+ *
+ * @brief Lower the AST into the grammar IR. The passes that come after this
+ * work on the IR so that none of them has to know about groups and
+ * repetitions in the AST.
+ *
+ * A group in a rule becomes a synthetic rule with one production. It is named
+ * after the grammar rule that it is in, like "rule_group1". The element that
+ * held the group becomes a reference to the synthetic rule with a min and a
+ * max count that says how many times it is matched. Productions are numbered
+ * across the whole grammar.
+ *
+ * @author Chuck Tilbury (chucktilbury@gmail.com)
+ * @version 0.0
+ * @date 2024-08-17
+ * @copyright Copyright (c) 2024
+ *
+ */
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "analysis.h"
+#include "ast.h"
+#include "hash.h"
+#include "ir.h"
+#include "memory.h"
+#include "ptr_lst.h"
+#include "str.h"
+#include "str_lst.h"
+#include "symbols.h"
+
+extern AstNode* root_node;
+
+// used while the grammar is being lowered
+static SymbolTable* symbols = NULL;
+static PtrLst* rule_lst     = NULL;
+static PtrLst* prod_lst     = NULL;
+
+static IrRule* create_rule(String* name, int parent, int depth) {
+
+    IrRule* rule = _ALLOC_DS(IrRule);
+    rule->id     = rule_lst->len;
+    rule->name   = name;
+    rule->parent = parent;
+    rule->depth  = depth;
+    rule->prods  = create_ir_prod_vec();
+    append_ptr_lst(rule_lst, rule);
+
+    return rule;
+}
+
+/*
+ * Make a name for a synthetic rule that is not the name of any other rule.
+ */
+static String* group_name(IrRule* top, int* count) {
+
+    String* str = create_string(NULL);
+
+    do {
+        clear_string(str);
+        append_string_fmt(str, "%s_group%d", raw_string(top->name), ++(*count));
+    } while(find_rule_id(symbols, raw_string(str)) >= 0);
+
+    return str;
+}
+
+static IrProd* lower_production(IrRule* rule, ast_production_t* prod, IrRule* top, int* count);
+
+static IrElem* lower_group(IrRule* parent, ast_group_t* group, IrRule* top, int* count) {
+
+    IrRule* rule = create_rule(group_name(top, count), parent->id, parent->depth + 1);
+    lower_production(rule, group->prod, top, count);
+
+    return create_ir_elem(IR_RULE, rule->id, rule->name, NULL);
+}
+
+static IrProd* lower_production(IrRule* rule, ast_production_t* prod, IrRule* top, int* count) {
+
+    IrProd* ptr = _ALLOC_DS(IrProd);
+    ptr->id     = prod_lst->len;
+    ptr->rule   = rule->id;
+    ptr->elems  = create_ir_elem_vec();
+    append_ptr_lst(prod_lst, ptr);
+    append_ir_prod_vec(rule->prods, ptr);
+
+    for(size_t i = 0; i < prod->list->len; i++) {
+        AstNode* node = prod->list->list[i]->node;
+        IrElem* elem  = NULL;
+
+        switch(node->type) {
+            case AST_TERMINAL: {
+                    ast_terminal_t* term = (ast_terminal_t*)node;
+                    elem = create_ir_elem(IR_TERMINAL, term->id, term->tok, term->name);
+                }
+                break;
+            case AST_NON_TERMINAL: {
+                    ast_non_terminal_t* nterm = (ast_non_terminal_t*)node;
+                    elem = create_ir_elem(IR_RULE, nterm->id, nterm->tok, nterm->name);
+                }
+                break;
+            case AST_ZERO_OR_ONE:
+                elem      = lower_group(rule, ((ast_zero_or_one_t*)node)->group, top, count);
+                elem->min = 0;
+                break;
+            case AST_ONE_OR_MORE:
+                elem      = lower_group(rule, ((ast_one_or_more_t*)node)->group, top, count);
+                elem->max = IR_MANY;
+                break;
+            case AST_ZERO_OR_MORE:
+                elem      = lower_group(rule, ((ast_zero_or_more_t*)node)->group, top, count);
+                elem->min = 0;
+                elem->max = IR_MANY;
+                break;
+            case AST_GROUP:
+                elem = lower_group(rule, (ast_group_t*)node, top, count);
+                break;
+            default:
+                fprintf(stderr, "Fatal internal error: invalid state in %s: %d\n", __func__,
+                        node->type);
+                abort();
+        }
+        append_ir_elem_vec(ptr->elems, elem);
+    }
+
+    return ptr;
+}
+
+static void destroy_rule(IrRule* rule) {
+
+    for(size_t i = 0; i < rule->prods->len; i++) {
+        IrProd* prod = rule->prods->list[i];
+        for(size_t j = 0; j < prod->elems->len; j++)
+            destroy_ir_elem(prod->elems->list[j]);
+        destroy_ir_elem_vec(prod->elems);
+        _FREE(prod);
+    }
+    destroy_ir_prod_vec(rule->prods);
+
+    // the names of the grammar rules belong to the AST
+    if(rule->parent >= 0)
+        destroy_string(rule->name);
+    _FREE(rule);
+}
+
+/*
+ * Write out everything about a rule that the code for it is made from. The
+ * synthetic rules under it are part of it because they come from the same
+ * grammar rule.
+ */
+static void serialize_rule(IrGrammar* ir, IrRule* rule, String* str) {
+
+    append_string_fmt(str, "rule %s %d\n", raw_string(rule->name), rule->depth);
+    for(size_t i = 0; i < rule->prods->len; i++) {
+        IrProd* prod = rule->prods->list[i];
+        append_string_str(str, "|");
+        for(size_t j = 0; j < prod->elems->len; j++) {
+            IrElem* elem = prod->elems->list[j];
+            append_string_fmt(str, " %d %s %s %d %d", elem->type, raw_string(elem->tok),
+                              (elem->name != NULL) ? raw_string(elem->name) : "-", elem->min,
+                              elem->max);
+            if(elem->type == IR_RULE && ir->rules[elem->sym]->parent >= 0)
+                serialize_rule(ir, ir->rules[elem->sym], str);
+        }
+        append_string_str(str, "\n");
+    }
+}
+
+/******************************************************************************
+ *
+ * Public Interface
+ *
+ */
+
+/**
+ * @brief Make the IR from the grammar that was loaded. The symbols must have
+ * been resolved without errors. The IR is kept in the grammar node.
+ */
+void lower_grammar(void) {
+
+    ast_grammar_t* grammar = (ast_grammar_t*)root_node;
+
+    destroy_ir(grammar->ir);
+    symbols  = grammar->symbols;
+    rule_lst = create_ptr_lst();
+    prod_lst = create_ptr_lst();
+
+    // the grammar rules keep the numbers from the symbol table
+    for(int i = 0; i < symbols->num_rules; i++)
+        create_rule(symbols->rules[i]->name, -1, 0);
+
+    for(int i = 0; i < symbols->num_rules; i++) {
+        IrRule* rule   = rule_lst->list[i];
+        int count      = 0;
+        ProdVec* prods = symbols->rules[i]->list->list;
+        for(size_t j = 0; j < prods->len; j++)
+            lower_production(rule, prods->list[j], rule, &count);
+    }
+
+    IrGrammar* ir         = _ALLOC_DS(IrGrammar);
+    ir->num_grammar_rules = symbols->num_rules;
+    ir->num_rules         = rule_lst->len;
+    ir->rules             = _ALLOC_DS_ARRAY(IrRule*, rule_lst->len + 1);
+    for(size_t i = 0; i < rule_lst->len; i++)
+        ir->rules[i] = rule_lst->list[i];
+
+    ir->num_prods = prod_lst->len;
+    ir->prods     = _ALLOC_DS_ARRAY(IrProd*, prod_lst->len + 1);
+    for(size_t i = 0; i < prod_lst->len; i++)
+        ir->prods[i] = prod_lst->list[i];
+
+    ir->num_terms = symbols->num_terms;
+    ir->terms     = symbols->terms;
+
+    destroy_ptr_lst(rule_lst);
+    destroy_ptr_lst(prod_lst);
+    rule_lst    = NULL;
+    prod_lst    = NULL;
+    symbols     = NULL;
+    grammar->ir = ir;
+}
+
+/**
+ * @brief Free the IR.
+ *
+ * @param ir
+ */
+void destroy_ir(IrGrammar* ir) {
+
+    if(ir != NULL) {
+        for(int i = 0; i < ir->num_rules; i++)
+            destroy_rule(ir->rules[i]);
+        _FREE(ir->rules);
+        _FREE(ir->prods);
+        destroy_analysis(ir->analysis);
+        _FREE(ir);
+    }
+}
+
+/**
+ * @brief Return the IR of the grammar that was loaded, or NULL if it has not
+ * been made.
+ *
+ * @return IrGrammar*
+ */
+IrGrammar* get_ir(void) {
+
+    return (root_node != NULL) ? ((ast_grammar_t*)root_node)->ir : NULL;
+}
+
+/**
+ * @brief Make an element that is matched one time. The strings belong to
+ * the AST or to the rule that is named.
+ *
+ * @param type
+ * @param sym
+ * @param tok
+ * @param name
+ * @return IrElem*
+ */
+IrElem* create_ir_elem(IrElemType type, int sym, String* tok, String* name) {
+
+    IrElem* elem = _ALLOC_DS(IrElem);
+    elem->type   = type;
+    elem->sym    = sym;
+    elem->min    = 1;
+    elem->max    = 1;
+    elem->tok    = tok;
+    elem->name   = name;
+
+    return elem;
+}
+
+/**
+ * @brief Free an element and the name of its field.
+ *
+ * @param elem
+ */
+void destroy_ir_elem(IrElem* elem) {
+
+    destroy_string(elem->field);
+    _FREE(elem);
+}
+
+/**
+ * @brief Add a synthetic rule with no productions to the IR. The rule takes
+ * the name.
+ *
+ * @param ir
+ * @param name
+ * @param parent
+ * @param depth
+ * @return IrRule*
+ */
+IrRule* add_ir_rule(IrGrammar* ir, String* name, int parent, int depth) {
+
+    IrRule* rule = _ALLOC_DS(IrRule);
+    rule->id     = ir->num_rules;
+    rule->name   = name;
+    rule->parent = parent;
+    rule->depth  = depth;
+    rule->prods  = create_ir_prod_vec();
+
+    ir->rules                  = _REALLOC_DS_ARRAY(ir->rules, IrRule*, ir->num_rules + 2);
+    ir->rules[ir->num_rules++] = rule;
+
+    return rule;
+}
+
+/**
+ * @brief Make a name for a synthetic rule from the name of the rule and the
+ * kind of rule it is, like "expr_tail". A number is added if that is already
+ * the name of a rule.
+ *
+ * @param ir
+ * @param rule
+ * @param kind
+ * @return String*
+ */
+String* ir_rule_name(IrGrammar* ir, IrRule* rule, const char* kind) {
+
+    String* str = create_string(NULL);
+
+    for(int count = 0;; count++) {
+        clear_string(str);
+        append_string_fmt(str, "%s_%s", raw_string(rule->name), kind);
+        if(count > 0)
+            append_string_fmt(str, "%d", count);
+
+        int i;
+        for(i = 0; i < ir->num_rules; i++)
+            if(!comp_string_string(str, ir->rules[i]->name))
+                break;
+        if(i == ir->num_rules)
+            return str;
+    }
+}
+
+/**
+ * @brief Number the productions again, in the order of the rules, after
+ * some of them were added or removed.
+ *
+ * @param ir
+ */
+void number_ir_prods(IrGrammar* ir) {
+
+    int count = 0;
+    for(int i = 0; i < ir->num_rules; i++)
+        count += ir->rules[i]->prods->len;
+
+    ir->prods     = _REALLOC_DS_ARRAY(ir->prods, IrProd*, count + 1);
+    ir->num_prods = 0;
+    for(int i = 0; i < ir->num_rules; i++) {
+        IrProdVec* prods = ir->rules[i]->prods;
+        for(size_t j = 0; j < prods->len; j++) {
+            prods->list[j]->id         = ir->num_prods;
+            ir->prods[ir->num_prods++] = prods->list[j];
+        }
+    }
+}
+
+/*
+ * The field of an element if the name is not used anywhere else in the
+ * production. A terminal is kept in the name of its token with "_type" or
+ * "_str" after it, and a rule in the name that was given with '$', or else
+ * in the name of the rule.
+ */
+static String* base_field(IrElem* elem) {
+
+    if(elem->type != IR_TERMINAL)
+        return copy_string((elem->name != NULL) ? elem->name : elem->tok);
+
+    String* tmp = copy_string(elem->tok);
+    lower_string(tmp);
+    const char* tstr = raw_string(tmp);
+
+    String* name = create_string(&tstr[4]);
+    append_string_str(name, (tstr[0] != 's') ? "_type" : "_str");
+    destroy_string(tmp);
+
+    return name;
+}
+
+static int count_used(StrLst* used, String* key) {
+
+    int count = 0;
+    int mark  = 0;
+    String* str;
+
+    while(NULL != (str = iterate_str_lst(used, &mark)))
+        count += !comp_string_string(str, key);
+
+    return count;
+}
+
+/*
+ * Give the element the name of its field, with the number of times that the
+ * key was used before in the production after it, if it was.
+ */
+static void use_field(IrElem* elem, String* key, String* base, StrLst* used) {
+
+    int count = count_used(used, key) + 1;
+    append_str_lst(used, copy_string(key));
+
+    destroy_string(elem->field);
+    elem->field = copy_string(base);
+    if(count > 1)
+        append_string_fmt(elem->field, "_%d", count);
+}
+
+static void name_alts(IrGrammar* ir, Analysis* an, IrRule* rule, StrLst* used);
+
+/*
+ * Name the fields of the elements in the order that the AST header makes
+ * them, with the groups right under the grammar rule.
+ */
+static void name_prod(IrGrammar* ir, Analysis* an, IrProd* prod, StrLst* used) {
+
+    for(size_t i = 0; i < prod->elems->len; i++) {
+        IrElem* elem = prod->elems->list[i];
+        IrRule* ref  = (elem->type != IR_TERMINAL) ? ir->rules[elem->sym] : NULL;
+        IrRule* list = (ref != NULL) ? list_group(ir, an, prod, i) : NULL;
+        String* base = base_field(elem);
+
+        if(list != NULL) {
+            // the list has the fields of the items, and the separator
+            int separated    = (elem->sym != list->id);
+            IrElemVec* items = list->prods->list[0]->elems;
+            IrElem* item     = items->list[separated ? 1 : 0];
+            String* key      = base_field(item);
+
+            destroy_string(base);
+            base = copy_string(key);
+            append_string_str(key, "_items");
+            use_field(item, key, base, used);
+            destroy_string(elem->field);
+            elem->field = copy_string(item->field);
+            destroy_string(key);
+
+            if(list->depth == 1) {
+                IrElem* term = items->list[separated ? 0 : 1];
+                destroy_string(base);
+                base = base_field(term);
+                use_field(term, base, base, used);
+            }
+            // the loop of a separated list is the next element
+            i += separated;
+        }
+        else if(ref == NULL || ref->parent < 0)
+            use_field(elem, base, base, used);
+        else if(ref->depth == 1)
+            name_alts(ir, an, ref, used);
+
+        destroy_string(base);
+    }
+}
+
+/*
+ * Only one production of a rule is matched, so each one starts with the
+ * fields that were used before the rule and a name can be used again in the
+ * next one. After the rule, a name has been used as many times as in the
+ * production that used it the most. The loop that remove_left_recursion()
+ * made starts a new node.
+ */
+static void name_alts(IrGrammar* ir, Analysis* an, IrRule* rule, StrLst* used) {
+
+    StrLst* most = create_str_lst();
+    StrLst* alt  = create_str_lst();
+
+    for(size_t i = 0; i < rule->prods->len; i++) {
+        IrProd* prod = rule->prods->list[i];
+        int mark     = 0;
+        String* str;
+
+        clear_str_lst(alt);
+        if(prod->elems->len == 0 || prod->elems->list[0]->type != IR_LEFT)
+            while(NULL != (str = iterate_str_lst(used, &mark)))
+                append_str_lst(alt, copy_string(str));
+        name_prod(ir, an, prod, alt);
+
+        mark = 0;
+        while(NULL != (str = iterate_str_lst(alt, &mark)))
+            if(count_used(most, str) < count_used(alt, str))
+                append_str_lst(most, copy_string(str));
+    }
+
+    int mark = 0;
+    String* str;
+    while(NULL != (str = iterate_str_lst(used, &mark)))
+        if(count_used(most, str) < count_used(used, str))
+            append_str_lst(most, copy_string(str));
+
+    clear_str_lst(used);
+    for(size_t i = 0; i < most->len; i++)
+        append_str_lst(used, most->list[i]);
+    most->len = 0;
+
+    destroy_str_lst(most);
+    destroy_str_lst(alt);
+}
+
+/**
+ * @brief Name the fields that the elements are kept in. The name of a field
+ * that is used more than one time in a production has the number of the
+ * time after it, like "ident_str" and then "ident_str_2", so that each one
+ * is kept in a field of its own. The productions of a rule share the fields
+ * that have the same name. This is done after the IR is in its last form,
+ * because where the lists are depends on the analysis.
+ *
+ * @param ir
+ */
+void name_ir_fields(IrGrammar* ir) {
+
+    Analysis* an = get_analysis();
+    StrLst* used = create_str_lst();
+
+    // the elements that are not kept in the node have their name anyway
+    for(int i = 0; i < ir->num_prods; i++) {
+        IrElemVec* elems = ir->prods[i]->elems;
+        for(size_t j = 0; j < elems->len; j++) {
+            destroy_string(elems->list[j]->field);
+            elems->list[j]->field = base_field(elems->list[j]);
+        }
+    }
+
+    for(int i = 0; i < ir->num_grammar_rules; i++) {
+        clear_str_lst(used);
+        name_alts(ir, an, ir->rules[i], used);
+    }
+
+    destroy_str_lst(used);
+}
+
+/**
+ * @brief Return a hash of the lowered form of a grammar rule and the
+ * synthetic rules that were made from it. If the hash did not change then
+ * the code that is made from the rule does not change either.
+ *
+ * @param ir
+ * @param rule
+ * @return uint64_t
+ */
+uint64_t fingerprint_rule(IrGrammar* ir, IrRule* rule) {
+
+    String* str = create_string(NULL);
+    serialize_rule(ir, rule, str);
+    uint64_t hash = hash_bytes(raw_string(str), str->length);
+    destroy_string(str);
+
+    return hash;
+}
+
+/**
+ * @brief Return the element that a production of a grammar rule passes
+ * through, or NULL. The production is only another grammar rule, or the
+ * grammar rule and the loop that remove_left_recursion() made after it, so
+ * when the loop does not match the node has one child and nothing else.
+ *
+ * @param ir
+ * @param prod
+ * @return IrElem*
+ */
+IrElem* pass_through_elem(IrGrammar* ir, IrProd* prod) {
+
+    IrRule* rule     = ir->rules[prod->rule];
+    IrElemVec* elems = prod->elems;
+
+    if(rule->parent >= 0 || elems->len < 1 || elems->len > 2)
+        return NULL;
+
+    IrElem* elem = elems->list[0];
+    if(elem->type != IR_RULE || elem->min != 1 || elem->max != 1 ||
+       ir->rules[elem->sym]->parent >= 0)
+        return NULL;
+
+    if(elems->len == 2) {
+        IrElem* loop = elems->list[1];
+        IrRule* tail = (loop->type == IR_RULE) ? ir->rules[loop->sym] : NULL;
+        if(tail == NULL || tail->parent != rule->id || loop->min != 0 || loop->max != IR_MANY ||
+           tail->prods->len == 0 || tail->prods->list[0]->elems->list[0]->type != IR_LEFT)
+            return NULL;
+    }
+
+    return elem;
+}
+
+/**
+ * @brief Mark the grammar rules that have a production that passes through
+ * to another grammar rule. The first rule is never marked, because it is the
+ * node that the parser returns. The caller frees the array.
+ *
+ * @param ir
+ * @return char*
+ */
+char* find_pass_through(IrGrammar* ir) {
+
+    char* marks = _ALLOC_DS_ARRAY(char, ir->num_rules);
+
+    for(int i = 1; i < ir->num_grammar_rules; i++) {
+        IrProdVec* prods = ir->rules[i]->prods;
+        for(size_t j = 0; j < prods->len && !marks[i]; j++)
+            marks[i] = (pass_through_elem(ir, prods->list[j]) != NULL);
+    }
+
+    return marks;
+}
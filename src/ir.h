@@ -0,0 +1,103 @@
+/**
+ * @file ir.h
+ *
+ * @brief Public interface to the lowered form of the grammar. The lowered
+ * grammar has no groups. Every group in the AST becomes a synthetic rule
+ * with one production and the element that referenced the group records how
+ * many times the rule can be matched.
+ *
+ * @author Chuck Tilbury (chucktilbury@gmail.com)
+ * @version 0.0
+ * @date 2024-08-17
+ * @copyright Copyright (c) 2024
+ *
+ */
+#ifndef _IR_H_
+#define _IR_H_
+
+#include <stdint.h>
+
+#include "ast.h"
+#include "ptr_lst.h"
+#include "str.h"
+#include "vec.h"
+
+// the max count of an element that can repeat without a limit
+#define IR_MANY -1
+
+typedef enum {
+    IR_TERMINAL,
+    IR_RULE,
+    // the node of the rule that was parsed so far, made by
+    // remove_left_recursion(). It matches nothing.
+    IR_LEFT,
+} IrElemType;
+
+typedef struct {
+    IrElemType type;
+    // terminal number or rule number
+    int sym;
+    // how many times it is matched: 1/1 once, 0/1 '?', 1/IR_MANY '+' and
+    // 0/IR_MANY '*'
+    int min;
+    int max;
+    // the token and the name that was given with '$', or NULL
+    String* tok;
+    String* name;
+    // the field of the node that it is kept in, made by name_ir_fields()
+    String* field;
+} IrElem;
+
+VEC_TYPE(IrElemVec, ir_elem_vec, IrElem*, 4)
+
+typedef struct {
+    int id;
+    // the rule that the production belongs to
+    int rule;
+    // list of IrElem*
+    IrElemVec* elems;
+} IrProd;
+
+VEC_TYPE(IrProdVec, ir_prod_vec, IrProd*, 4)
+
+typedef struct {
+    int id;
+    String* name;
+    // the rule that a synthetic rule was made from, or -1
+    int parent;
+    // how deep the group was in the grammar rule, 0 for grammar rules
+    int depth;
+    // list of IrProd*
+    IrProdVec* prods;
+} IrRule;
+
+typedef struct _ir_grammar_ {
+    // the rules from the grammar come first, in the same order and with the
+    // same numbers as the symbol table, then the synthetic rules
+    int num_rules;
+    int num_grammar_rules;
+    IrRule** rules;
+    int num_prods;
+    IrProd** prods;
+    // the token of each terminal, by number
+    int num_terms;
+    String** terms;
+    // created by analyze_grammar()
+    struct _analysis_* analysis;
+} IrGrammar;
+
+void lower_grammar(void);
+void destroy_ir(IrGrammar* ir);
+IrGrammar* get_ir(void);
+uint64_t fingerprint_rule(IrGrammar* ir, IrRule* rule);
+
+IrElem* create_ir_elem(IrElemType type, int sym, String* tok, String* name);
+void destroy_ir_elem(IrElem* elem);
+IrRule* add_ir_rule(IrGrammar* ir, String* name, int parent, int depth);
+String* ir_rule_name(IrGrammar* ir, IrRule* rule, const char* kind);
+void number_ir_prods(IrGrammar* ir);
+void name_ir_fields(IrGrammar* ir);
+IrElem* pass_through_elem(IrGrammar* ir, IrProd* prod);
+char* find_pass_through(IrGrammar* ir);
+
+#endif /* _IR_H_ */
@@ -0,0 +1,494 @@
+/**
+ * @file leftrec.c
+ *
+ * @brief Find the rules that are left recursive and rewrite them so that the
+ * generated parser does not call itself forever.
+ *
+ * A rule calls another one on the left when the other one can be the first
+ * thing that a production of it matches. The rules that are left recursive
+ * are the strongly connected components of those calls, and the rules that
+ * call themselves.
+ *
+ * A rule that calls itself at the start of some of its productions,
+ *
+ *   expr : expr '+' term | expr '-' term | term ;
+ *
+ * is rewritten to the productions that do not, followed by a loop over the
+ * ones that do.
+ *
+ *   expr : term ( '+' term | '-' term )* ;
+ *
+ * The reference to the rule at the start of the loop becomes an IR_LEFT
+ * element. The parser puts the node that was parsed so far there before it
+ * matches the rest, so the AST is left associative, just as the grammar
+ * says.
+ *
+ * Rules that are left recursive through each other are taken in the order
+ * of the grammar. The productions of each one that start with an earlier
+ * one are replaced with the productions of that one, followed by the rest,
+ * and then the rule is rewritten like above. In
+ *
+ *   a : b X | Y ;
+ *   b : a Z | W ;
+ *
+ * the second rule becomes
+ *
+ *   b : b X Z | Y Z | W ;
+ *   b : ( Y Z | W ) ( X Z )* ;
+ *
+ * so the nodes of the earlier rules are not in the AST of the later ones.
+ * Their fields are in the node of the later rule instead. Left recursion
+ * through groups, or through something that can match nothing, is an error.
+ *
+ * @author Chuck Tilbury (chucktilbury@gmail.com)
+ * @version 0.0
+ * @date 2024-08-23
+ * @copyright Copyright (c) 2024
+ *
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "analysis.h"
+#include "ir.h"
+#include "leftrec.h"
+#include "memory.h"
+#include "str.h"
+#include "vec.h"
+
+// Tarjan's algorithm over the calls on the left
+typedef struct {
+    IrGrammar* ir;
+    IntVec** calls;
+    int* index;
+    int* low;
+    int* stack;
+    char* on_stack;
+    int* comp; // the component that each rule is in
+    int count;
+    int depth;
+    int num_comps;
+    int num_rules; // before anything was rewritten
+} _scc_t_;
+
+/*
+ * Add the rules that the production calls on the left to the list. Returns
+ * non-zero if the rule is one of them.
+ */
+static int left_calls(Analysis* an, IrProd* prod, int rule, IntVec* calls) {
+
+    int found = 0;
+
+    for(size_t i = 0; i < prod->elems->len; i++) {
+        IrElem* elem = prod->elems->list[i];
+        if(elem->type == IR_LEFT)
+            continue;
+        if(elem->type == IR_TERMINAL)
+            break;
+        if(calls != NULL)
+            append_int_vec(calls, elem->sym);
+        found |= (elem->sym == rule);
+        if(elem->min > 0 && !an->nullable[elem->sym])
+            break;
+    }
+
+    return found;
+}
+
+static void connect(_scc_t_* scc, int rule) {
+
+    scc->index[rule]         = ++scc->count;
+    scc->low[rule]           = scc->index[rule];
+    scc->stack[scc->depth++] = rule;
+    scc->on_stack[rule]      = 1;
+
+    IntVec* vec = scc->calls[rule];
+    for(size_t i = 0; i < vec->len; i++) {
+        int next = vec->list[i];
+        if(scc->index[next] == 0) {
+            connect(scc, next);
+            if(scc->low[next] < scc->low[rule])
+                scc->low[rule] = scc->low[next];
+        }
+        else if(scc->on_stack[next] && scc->index[next] < scc->low[rule])
+            scc->low[rule] = scc->index[next];
+    }
+
+    if(scc->low[rule] == scc->index[rule]) {
+        int num;
+        do {
+            num                = scc->stack[--scc->depth];
+            scc->on_stack[num] = 0;
+            scc->comp[num]     = scc->num_comps;
+        } while(num != rule);
+        scc->num_comps++;
+    }
+}
+
+static IrRule* top_rule(IrGrammar* ir, IrRule* rule) {
+
+    while(rule->parent >= 0)
+        rule = ir->rules[rule->parent];
+
+    return rule;
+}
+
+static void report_cycle(_scc_t_* scc, int comp) {
+
+    IrGrammar* ir = scc->ir;
+    String* str   = create_string(NULL);
+    char* seen    = _ALLOC_DS_ARRAY(char, ir->num_rules);
+
+    for(int i = 0; i < ir->num_rules; i++) {
+        IrRule* top = top_rule(ir, ir->rules[i]);
+        if(scc->comp[i] == comp && !seen[top->id]) {
+            seen[top->id] = 1;
+            append_string_fmt(str, " '%s'", raw_string(top->name));
+        }
+    }
+
+    fprintf(stderr, "error: rules are left recursive through groups:%s\n", raw_string(str));
+
+    _FREE(seen);
+    destroy_string(str);
+}
+
+/*
+ * A production can be rewritten if it calls the rule with the first element
+ * and that element is matched one time.
+ */
+static int is_direct(IrRule* rule, IrProd* prod) {
+
+    IrElem* elem = prod->elems->list[0];
+    return elem->type == IR_RULE && elem->sym == rule->id && elem->min == 1 && elem->max == 1;
+}
+
+/*
+ * Move the productions that start with the rule into a loop that follows
+ * each of the others. Returns the number of errors.
+ */
+static int rewrite_rule(IrGrammar* ir, Analysis* an, IrRule* rule) {
+
+    size_t loops = 0;
+
+    for(size_t i = 0; i < rule->prods->len; i++) {
+        IrProd* prod = rule->prods->list[i];
+        if(!is_direct(rule, prod)) {
+            if(!left_calls(an, prod, rule->id, NULL))
+                continue;
+            fprintf(stderr,
+                    "error: rule '%s' is left recursive after or through an optional or "
+                    "repeated item\n",
+                    raw_string(rule->name));
+            return 1;
+        }
+        if(prod->elems->len == 1) {
+            fprintf(stderr, "error: rule '%s' has a production that is only itself\n",
+                    raw_string(rule->name));
+            return 1;
+        }
+        loops++;
+    }
+
+    if(loops == rule->prods->len) {
+        fprintf(stderr, "error: every production of rule '%s' starts with itself\n",
+                raw_string(rule->name));
+        return 1;
+    }
+
+    IrRule* tail     = add_ir_rule(ir, ir_rule_name(ir, rule, "tail"), rule->id, rule->depth + 1);
+    IrProdVec* prods = create_ir_prod_vec();
+
+    for(size_t i = 0; i < rule->prods->len; i++) {
+        IrProd* prod = rule->prods->list[i];
+        if(is_direct(rule, prod)) {
+            prod->elems->list[0]->type = IR_LEFT;
+            prod->rule                 = tail->id;
+            append_ir_prod_vec(tail->prods, prod);
+        }
+        else
+            append_ir_prod_vec(prods, prod);
+    }
+
+    for(size_t i = 0; i < prods->len; i++) {
+        IrElem* elem = create_ir_elem(IR_RULE, tail->id, tail->name, NULL);
+        elem->min    = 0;
+        elem->max    = IR_MANY;
+        append_ir_elem_vec(prods->list[i]->elems, elem);
+    }
+
+    destroy_ir_prod_vec(rule->prods);
+    rule->prods = prods;
+
+    return 0;
+}
+
+static IrRule* copy_rule(IrGrammar* ir, IrRule* src, IrRule* parent, IrRule* top);
+
+/*
+ * Copy an element into a production of the rule at the top. The groups are
+ * copied too, because they fill in the node of the rule that they are in,
+ * and the node so far in a loop is the node of that rule.
+ */
+static IrElem* copy_elem(IrGrammar* ir, IrElem* src, IrRule* parent, IrRule* top) {
+
+    IrElem* elem;
+
+    if(src->type == IR_LEFT)
+        elem = create_ir_elem(IR_LEFT, top->id, top->name, NULL);
+    else if(src->type == IR_RULE && ir->rules[src->sym]->parent >= 0) {
+        IrRule* rule = copy_rule(ir, ir->rules[src->sym], parent, top);
+        elem         = create_ir_elem(IR_RULE, rule->id, rule->name, src->name);
+    }
+    else
+        elem = create_ir_elem(src->type, src->sym, src->tok, src->name);
+
+    elem->min = src->min;
+    elem->max = src->max;
+
+    return elem;
+}
+
+static IrProd* create_prod(IrRule* rule) {
+
+    IrProd* prod = _ALLOC_DS(IrProd);
+    prod->rule   = rule->id;
+    prod->elems  = create_ir_elem_vec();
+
+    return prod;
+}
+
+static IrRule* copy_rule(IrGrammar* ir, IrRule* src, IrRule* parent, IrRule* top) {
+
+    IrRule* rule = add_ir_rule(ir, ir_rule_name(ir, top, "group"), parent->id, parent->depth + 1);
+
+    for(size_t i = 0; i < src->prods->len; i++) {
+        IrElemVec* elems = src->prods->list[i]->elems;
+        IrProd* prod     = create_prod(rule);
+        for(size_t j = 0; j < elems->len; j++)
+            append_ir_elem_vec(prod->elems, copy_elem(ir, elems->list[j], rule, top));
+        append_ir_prod_vec(rule->prods, prod);
+    }
+
+    return rule;
+}
+
+/*
+ * Replace the productions of the rule that start with the other one with
+ * the productions of the other one, each followed by the rest. Returns
+ * non-zero if any were replaced.
+ */
+static int substitute(IrGrammar* ir, IrRule* rule, IrRule* other) {
+
+    IrProdVec* prods = create_ir_prod_vec();
+    int found        = 0;
+
+    for(size_t i = 0; i < rule->prods->len; i++) {
+        IrProd* prod = rule->prods->list[i];
+        if(!is_direct(other, prod)) {
+            append_ir_prod_vec(prods, prod);
+            continue;
+        }
+
+        // the rest is moved to the first one and copied to the others
+        for(size_t j = 0; j < other->prods->len; j++) {
+            IrElemVec* elems = other->prods->list[j]->elems;
+            IrProd* ptr      = create_prod(rule);
+            for(size_t k = 0; k < elems->len; k++)
+                append_ir_elem_vec(ptr->elems, copy_elem(ir, elems->list[k], rule, rule));
+            for(size_t k = 1; k < prod->elems->len; k++)
+                append_ir_elem_vec(ptr->elems, (j == 0) ?
+                                                   prod->elems->list[k] :
+                                                   copy_elem(ir, prod->elems->list[k], rule, rule));
+            append_ir_prod_vec(prods, ptr);
+        }
+
+        destroy_ir_elem(prod->elems->list[0]);
+        destroy_ir_elem_vec(prod->elems);
+        _FREE(prod);
+        found = 1;
+    }
+
+    destroy_ir_prod_vec(rule->prods);
+    rule->prods = prods;
+
+    return found;
+}
+
+/*
+ * Returns non-zero if a production of the rule calls a rule of the component
+ * on the left some other way than with its first element, one time.
+ */
+static int is_indirect(_scc_t_* scc, Analysis* an, IrRule* rule, int comp) {
+
+    IntVec* calls = create_int_vec();
+    int found     = 0;
+
+    for(size_t i = 0; i < rule->prods->len && !found; i++) {
+        IrProd* prod = rule->prods->list[i];
+        IrElem* elem = prod->elems->list[0];
+        int first    = -1;
+
+        if(elem->type == IR_RULE && elem->min == 1 && elem->max == 1 && !an->nullable[elem->sym])
+            first = elem->sym;
+
+        calls->len = 0;
+        left_calls(an, prod, rule->id, calls);
+        for(size_t j = 0; j < calls->len; j++) {
+            int sym = calls->list[j];
+            if(sym != first && scc->comp[sym] == comp)
+                found = 1;
+        }
+    }
+
+    destroy_int_vec(calls);
+    return found;
+}
+
+/*
+ * Rewrite the rules of a component in the order of the grammar, so that each
+ * one only calls itself or the rules after it on the left. Returns the
+ * number of errors.
+ */
+static int rewrite_cycle(_scc_t_* scc, int comp) {
+
+    IrGrammar* ir   = scc->ir;
+    Analysis* an    = get_analysis();
+    IntVec* members = create_int_vec();
+    int errors      = 0;
+
+    for(int i = 0; i < scc->num_rules; i++)
+        if(scc->comp[i] == comp)
+            append_int_vec(members, i);
+
+    for(size_t i = 0; i < members->len && errors == 0; i++) {
+        IrRule* rule = ir->rules[members->list[i]];
+        if(rule->parent >= 0) {
+            report_cycle(scc, comp);
+            errors++;
+        }
+        else if(is_indirect(scc, an, rule, comp)) {
+            fprintf(stderr,
+                    "error: rule '%s' is left recursive through other rules after or through "
+                    "an optional or repeated item\n",
+                    raw_string(rule->name));
+            errors++;
+        }
+    }
+
+    for(size_t i = 0; i < members->len && errors == 0; i++) {
+        IrRule* rule = ir->rules[members->list[i]];
+        int found    = 0;
+
+        for(size_t j = 0; j < i; j++)
+            found |= substitute(ir, rule, ir->rules[members->list[j]]);
+        if(found) {
+            number_ir_prods(ir);
+            analyze_grammar();
+            an = get_analysis();
+        }
+
+        for(size_t j = 0; j < rule->prods->len; j++) {
+            if(left_calls(an, rule->prods->list[j], rule->id, NULL)) {
+                errors += rewrite_rule(ir, an, rule);
+                break;
+            }
+        }
+    }
+
+    destroy_int_vec(members);
+    return errors;
+}
+
+/******************************************************************************
+ *
+ * Public Interface
+ *
+ */
+
+/**
+ * @brief Rewrite the rules of the IR that call themselves on the left and
+ * report the left recursion that cannot be rewritten. The grammar is
+ * analyzed again if anything changed. Returns the number of errors.
+ *
+ * @return int
+ */
+int remove_left_recursion(void) {
+
+    IrGrammar* ir = get_ir();
+    if(ir == NULL)
+        return 0;
+
+    int num = ir->num_rules;
+    _scc_t_ scc;
+    memset(&scc, 0, sizeof(scc));
+    scc.ir        = ir;
+    scc.calls     = _ALLOC_DS_ARRAY(IntVec*, num);
+    scc.index     = _ALLOC_DS_ARRAY(int, num);
+    scc.low       = _ALLOC_DS_ARRAY(int, num);
+    scc.stack     = _ALLOC_DS_ARRAY(int, num);
+    scc.on_stack  = _ALLOC_DS_ARRAY(char, num);
+    scc.comp      = _ALLOC_DS_ARRAY(int, num);
+    scc.num_rules = num;
+
+    Analysis* an = get_analysis();
+    for(int i = 0; i < num; i++) {
+        IrRule* rule = ir->rules[i];
+        scc.calls[i] = create_int_vec();
+        for(size_t j = 0; j < rule->prods->len; j++)
+            left_calls(an, rule->prods->list[j], i, scc.calls[i]);
+    }
+
+    for(int i = 0; i < num; i++)
+        if(scc.index[i] == 0)
+            connect(&scc, i);
+
+    int* size = _ALLOC_DS_ARRAY(int, scc.num_comps);
+    for(int i = 0; i < num; i++)
+        size[scc.comp[i]]++;
+
+    int errors  = 0;
+    int changed = 0;
+    for(int i = 0; i < num; i++) {
+        int comp = scc.comp[i];
+
+        // a component is reported one time, for the first rule in it
+        if(size[comp] < 0)
+            continue;
+        if(size[comp] > 1) {
+            int err   = rewrite_cycle(&scc, comp);
+            size[comp] = -1;
+            errors += err;
+            changed |= !err;
+            // the rules were analyzed again
+            an = get_analysis();
+            continue;
+        }
+
+        IntVec* vec = scc.calls[i];
+        for(size_t j = 0; j < vec->len; j++) {
+            if(vec->list[j] == i) {
+                int err = rewrite_rule(ir, an, ir->rules[i]);
+                errors += err;
+                changed |= !err;
+                break;
+            }
+        }
+    }
+
+    for(int i = 0; i < num; i++)
+        destroy_int_vec(scc.calls[i]);
+    _FREE(scc.calls);
+    _FREE(scc.index);
+    _FREE(scc.low);
+    _FREE(scc.stack);
+    _FREE(scc.on_stack);
+    _FREE(scc.comp);
+    _FREE(size);
+
+    if(changed)
+        analyze_grammar();
+
+    return errors;
+}
@@ -0,0 +1,17 @@
+/**
+ * @file leftrec.h
+ *
+ * @brief Public interface to removing left recursion from the IR.
+ *
+ * @author Chuck Tilbury (chucktilbury@gmail.com)
+ * @version 0.0
+ * @date 2024-08-23
+ * @copyright Copyright (c) 2024
+ *
+ */
+#ifndef _LEFTREC_H_
+#define _LEFTREC_H_
+
+int remove_left_recursion(void);
+
+#endif /* _LEFTREC_H_ */
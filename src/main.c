@@ -1,24 +1,27 @@
 /*
  *
  */
+#include <stdint.h>
 #include <stdio.h>
 
 #include "ast.h"
 #include "emit.h"
 #include "cmdline.h"
+#include "fragment.h"
 #include "hash.h"
+#include "module.h"
+#include "outcache.h"
 #include "scan.h"
 #include "str.h"
 #include "str_lst.h"
+#include "version.h"
+#include "watch.h"
 
 extern int yydebug;
 
-StrLst* terms  = NULL;
-StrLst* nterms = NULL;
-
 void init(int argc, char** argv) {
 
-    init_cmdline("Simple Parser Generator", "", "Parser Generator", "0.0.0");
+    init_cmdline("Simple Parser Generator", "", "Parser Generator", PARGEN_VERSION);
 
     // set the optional file names
     add_cmdline('a', "ast", "ast_name", "name of the ast files, possibly a full path",
@@ -30,6 +33,26 @@ void init(int argc, char** argv) {
     add_cmdline('v', "verbosity", "verbo", "control how much text is displayed during execution",
                 "0", NULL, CMD_NUM | CMD_RARG);
 
+    // parsed grammar modules are saved here
+    add_cmdline('c', "cache", "cache_dir", "directory to cache parsed grammar modules and outputs in",
+                NULL, NULL, CMD_STR|CMD_RARG);
+
+    // a depfile for make or ninja that lists all of the grammar files
+    add_cmdline('d', "depfile", "depfile", "write a make or ninja depfile with this name",
+                NULL, NULL, CMD_STR|CMD_RARG);
+
+    // grammar rules whose results the parser saves, or "auto"
+    add_cmdline('m', "memo", "memo", "memoize these rules in the parser, \"auto\" finds them",
+                NULL, NULL, CMD_STR|CMD_LIST|CMD_RARG);
+
+    // the nodes that only have one child are left out of the AST
+    add_cmdline('e', "elide", "elide", "leave the nodes that only have one child out of the AST",
+                NULL, NULL, CMD_NARG);
+
+    // keep running and regenerate the outputs when the grammar changes
+    add_cmdline('w', "watch", "watch", "regenerate the outputs when the grammar changes",
+                NULL, NULL, CMD_NARG);
+
     // standard options that control the command line parser behaviors
     add_cmdline('V', "version", NULL, "show the version", NULL, show_version, CMD_NARG);
     add_cmdline('h', "help", NULL, "show this help text", NULL, show_help, CMD_NARG);
@@ -54,20 +77,172 @@ void dump_str_lst(StrLst* lst, const char* str) {
         printf("%3d. %s\n", post, raw_string(ptr));
 }
 
+/*
+ * The rules to memoize as one string, separated by commas, or NULL.
+ */
+static String* memo_option(void) {
+
+    if(get_cmdline("memo") == NULL)
+        return NULL;
+
+    String* str = create_string(NULL);
+    const char* value;
+    int post = 0;
+
+    while(NULL != (value = iterate_cmdline("memo", &post))) {
+        if(str->length > 0)
+            append_string_char(str, ',');
+        append_string_str(str, value);
+    }
+
+    return str;
+}
+
+/*
+ * Write the depfile, if there is one. Returns non-zero if it cannot be made.
+ */
+static int write_depfile(StrLst* targets, StrLst* inputs) {
+
+    const char* depfile = get_cmdline("depfile");
+    return (depfile != NULL) ? emit_depfile(depfile, targets, inputs) : 0;
+}
+
+/*
+ * Write the outputs and the depfile, if there is one. If there is a key,
+ * then the outputs are also saved in the output cache. The code for the
+ * rules that did not change is taken from the fragments in the cache.
+ * Returns the number of errors.
+ */
+static int generate(uint64_t key) {
+
+    const char* cache_dir = get_cmdline("cache_dir");
+    const char* ast_name  = get_cmdline("ast_name");
+
+    if(cache_dir != NULL)
+        read_fragments(get_fragments(), cache_dir, ast_name);
+    String* memo = memo_option();
+    int errors   = emit(ast_name, get_cmdline("parse_name"),
+                        (memo != NULL) ? raw_string(memo) : NULL, get_cmdline("elide") != NULL);
+    destroy_string(memo);
+    if(errors > 0)
+        return errors;
+    if(cache_dir != NULL)
+        write_fragments(get_fragments(), cache_dir, ast_name);
+    if(key != 0)
+        save_outputs(cache_dir, key);
+
+    StrLst* targets = create_str_lst();
+    const char *name, *buffer;
+    size_t size;
+    int mark = 0;
+
+    while(iterate_outputs(&mark, &name, &buffer, &size))
+        append_str_lst(targets, create_string(name));
+
+    errors = write_depfile(targets, get_input_files());
+    destroy_str_lst(targets);
+
+    if(write_outputs(get_input_files()) < 0)
+        errors++;
+
+    return errors;
+}
+
+/*
+ * Everything other than the grammar that changes the outputs. That includes
+ * the build of pargen, so a new generator does not use the old outputs.
+ */
+static StrLst* cache_options(void) {
+
+    StrLst* lst = create_str_lst();
+    String* str = create_string("pargen ");
+    append_string_str(str, pargen_build_id());
+    append_str_lst(lst, str);
+
+    str = create_string("ast_name=");
+    append_string_str(str, get_cmdline("ast_name"));
+    append_str_lst(lst, str);
+
+    str = create_string("parse_name=");
+    append_string_str(str, get_cmdline("parse_name"));
+    append_str_lst(lst, str);
+
+    String* memo = memo_option();
+    str          = create_string("memo=");
+    if(memo != NULL)
+        append_string_string(str, memo);
+    append_str_lst(lst, str);
+    destroy_string(memo);
+
+    str = create_string("elide=");
+    append_string_str(str, (get_cmdline("elide") != NULL) ? "1" : "0");
+    append_str_lst(lst, str);
+
+    return lst;
+}
+
+/*
+ * Use the output cache for a single build. If the grammar has been built
+ * before, then the outputs are taken from the cache and it is not parsed.
+ * Returns the number of errors.
+ */
+static int cached_build(const char* fname, const char* cache_dir) {
+
+    StrLst* options = cache_options();
+    StrLst* inputs  = create_str_lst();
+    StrLst* targets = create_str_lst();
+    uint64_t key    = output_cache_key(fname, options, inputs);
+    int errors      = 0;
+
+    if(key != 0 && restore_outputs(cache_dir, key, targets)) {
+        errors = write_depfile(targets, inputs);
+        if(write_outputs(inputs) < 0)
+            errors++;
+    }
+    else {
+        errors = load_grammar(fname, cache_dir);
+        if(errors == 0)
+            errors = generate(key);
+    }
+
+    destroy_str_lst(targets);
+    destroy_str_lst(inputs);
+    destroy_str_lst(options);
+
+    return errors;
+}
+
+/*
+ * Called by the watcher when the grammar changes. The modules that did not
+ * change are kept by the loader. The symbols, the IR and the analysis are
+ * kept as well if no rule changed, otherwise they are made again for the
+ * whole grammar.
+ */
+static int regenerate(void) {
+
+    int errors = reload_grammar(get_cmdline("list of files"), get_cmdline("cache_dir"));
+
+    if(errors == 0)
+        errors = generate(0);
+
+    return errors;
+}
+
 #include "regurg.h"
 int main(int argc, char** argv) {
 
     init(argc, argv);
-    terms  = create_str_lst();
-    nterms = create_str_lst();
 
     yydebug = 0;
 
-    open_file(get_cmdline("list of files"));
-    yyparse();
+    if(get_cmdline("watch") != NULL)
+        watch_grammar(regenerate, get_input_files);
+
+    const char* cache_dir = get_cmdline("cache_dir");
+    if(cache_dir != NULL)
+        return cached_build(get_cmdline("list of files"), cache_dir)? 1: 0;
 
-    sort_str_lst(nterms);
-    sort_str_lst(terms);
+    int errors = load_grammar(get_cmdline("list of files"), cache_dir);
 
     // dump_str_lst(terms, "\nTERMINALS");
     // dump_str_lst(nterms, "\nNON TERMINALS");
@@ -75,7 +250,8 @@ int main(int argc, char** argv) {
     // traverse_ast(NULL, NULL);
     // regurg();
 
-    emit();
+    if(errors == 0)
+        errors = generate(0);
 
-    return 0;
+    return errors? 1: 0;
 }
@@ -0,0 +1,947 @@
+/**
+ * @file module.c
+ *
+ * @brief Load a grammar that is split into modules. A module is a grammar
+ * file and it can name other modules with a %include directive. Every module
+ * is parsed at most one time, no matter how many times it is included.
+ *
+ * The parsed form of a module is kept in memory between loads and it is
+ * only parsed again if its content changes. The old form is kept if the new
+ * one has the same rules, so that the grammar is seen not to have changed. If
+ * a cache directory is given then the parsed form is also saved in it, named
+ * by a hash of the content of the module, so that a module that did not
+ * change is not parsed again on the next run either.
+ *
+ * @author Chuck Tilbury (chucktilbury@gmail.com)
+ * @version 0.0
+ * @date 2024-08-13
+ * @copyright Copyright (c) 2024
+ *
+ */
+#define _XOPEN_SOURCE 700
+#include <errno.h>
+#include <limits.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "analysis.h"
+#include "ast.h"
+#include "factor.h"
+#include "fragment.h"
+#include "hash.h"
+#include "ir.h"
+#include "leftrec.h"
+#include "memory.h"
+#include "module.h"
+#include "ptr_lst.h"
+#include "scan.h"
+#include "str.h"
+#include "str_lst.h"
+#include "symbols.h"
+#include "version.h"
+
+// followed by the build id, because a new build can save the rules in
+// another way
+#define CACHE_MAGIC "pargen module 1"
+
+typedef struct {
+    String* path;      // canonical path of the file
+    uint64_t hash;     // hash of the content that was parsed
+    PtrLst* rules;     // ast_rule_t* defined in the module
+    StrLst* includes;  // names given to %include, as written
+    int seen;          // visited by the current load
+} Module;
+
+extern int errors;
+
+AstNode* root_node = NULL;
+StrLst* terms      = NULL;
+StrLst* nterms     = NULL;
+
+/*
+ * Everything that the loader keeps between calls. The root node and the
+ * symbol lists are globals because the passes read them, so they are saved
+ * here when another state is made current.
+ */
+struct _grammar_state_ {
+    AstNode* root_node;
+    StrLst* terms;
+    StrLst* nterms;
+    PtrLst* modules;      // modules that have been parsed, kept between loads
+    StrLst* input_files;  // files that were read by the last load
+    Fragments* fragments; // code made for each rule, kept between emits
+    int changed;          // a module was read by the last load
+    int checked;          // the loaded grammar was checked without errors
+};
+
+static GrammarState default_state;
+static GrammarState* state = &default_state;
+// the module that the parser is currently reading
+static Module* current = NULL;
+
+/******************************************************************************
+ *
+ * Module helpers
+ *
+ */
+static Module* create_module(const char* path, uint64_t hash) {
+
+    Module* mod   = _ALLOC_DS(Module);
+    mod->path     = create_string(path);
+    mod->hash     = hash;
+    mod->rules    = create_ptr_lst();
+    mod->includes = create_str_lst();
+
+    return mod;
+}
+
+static void destroy_module(Module* mod) {
+
+    if(mod != NULL) {
+        int mark = 0;
+        AstNode* node;
+        while(NULL != (node = iterate_ptr_lst(mod->rules, &mark)))
+            destroy_ast(node);
+        destroy_ptr_lst(mod->rules);
+        destroy_str_lst(mod->includes);
+        destroy_string(mod->path);
+        _FREE(mod);
+    }
+}
+
+static Module* find_module(const char* path) {
+
+    int mark = 0;
+    Module* mod;
+
+    while(NULL != (mod = iterate_ptr_lst(state->modules, &mark))) {
+        if(!comp_string_str(mod->path, path))
+            return mod;
+    }
+
+    return NULL;
+}
+
+static void forget_module(Module* mod) {
+
+    for(size_t i = 0; i < state->modules->len; i++) {
+        if(state->modules->list[i] == mod) {
+            del_ptr_lst(state->modules, i);
+            break;
+        }
+    }
+    destroy_module(mod);
+}
+
+/*
+ * An included name is relative to the directory of the module that includes
+ * it, unless it is an absolute path.
+ */
+static String* resolve_name(Module* from, const char* name) {
+
+    String* str = create_string(NULL);
+
+    if(from != NULL && name[0] != '/') {
+        const char* path = raw_string(from->path);
+        const char* ptr  = strrchr(path, '/');
+        if(ptr != NULL)
+            append_buffer(str, (void*)path, (ptr - path) + 1);
+    }
+    append_string_str(str, name);
+
+    return str;
+}
+
+/******************************************************************************
+ *
+ * The module cache. This is a simple text format with one item per line.
+ *
+ *   include <name>
+ *   rule <name>
+ *     prod
+ *       term <token> [<name>]
+ *       nterm <token> [<name>]
+ *       group [?+*]
+ *         ...elements...
+ *       end
+ *     end
+ *   end
+ *
+ */
+static void write_elems(FILE* fp, ast_production_t* prod);
+
+static void write_group(FILE* fp, const char* kind, ast_group_t* group) {
+
+    fprintf(fp, "group%s\n", kind);
+    write_elems(fp, group->prod);
+    fprintf(fp, "end\n");
+}
+
+static void write_elems(FILE* fp, ast_production_t* prod) {
+
+    for(size_t i = 0; i < prod->list->len; i++) {
+        AstNode* node = prod->list->list[i]->node;
+        switch(node->type) {
+            case AST_TERMINAL:
+            case AST_NON_TERMINAL: {
+                    // the two nodes have the same layout
+                    ast_terminal_t* term = (ast_terminal_t*)node;
+                    fprintf(fp, "%s %s%s%s\n", (node->type == AST_TERMINAL) ? "term" : "nterm",
+                            raw_string(term->tok), (term->name != NULL) ? " " : "",
+                            (term->name != NULL) ? raw_string(term->name) : "");
+                }
+                break;
+            case AST_ZERO_OR_ONE:
+                write_group(fp, " ?", ((ast_zero_or_one_t*)node)->group);
+                break;
+            case AST_ONE_OR_MORE:
+                write_group(fp, " +", ((ast_one_or_more_t*)node)->group);
+                break;
+            case AST_ZERO_OR_MORE:
+                write_group(fp, " *", ((ast_zero_or_more_t*)node)->group);
+                break;
+            case AST_GROUP:
+                write_group(fp, "", (ast_group_t*)node);
+                break;
+            default:
+                fprintf(stderr, "Fatal internal error: invalid state in %s: %d\n", __func__,
+                        node->type);
+                abort();
+        }
+    }
+}
+
+static String* cache_name(const char* cache_dir, uint64_t hash) {
+
+    String* str = create_string(cache_dir);
+    append_string_fmt(str, "/modules/%016llx.pgm", (unsigned long long)hash);
+
+    return str;
+}
+
+static void make_dir(const char* name) {
+
+    if(mkdir(name, 0777) != 0 && errno != EEXIST)
+        fprintf(stderr, "Warning: cannot create cache directory '%s': %s\n", name,
+                strerror(errno));
+}
+
+/*
+ * Write the includes and the rules of a module, which is everything that the
+ * rest of the program uses from it.
+ */
+static void write_module(FILE* fp, Module* mod) {
+
+    int mark = 0;
+    String* str;
+    while(NULL != (str = iterate_str_lst(mod->includes, &mark)))
+        fprintf(fp, "include %s\n", raw_string(str));
+
+    mark = 0;
+    ast_rule_t* rule;
+    while(NULL != (rule = iterate_ptr_lst(mod->rules, &mark))) {
+        fprintf(fp, "rule %s\n", raw_string(rule->name));
+        ProdVec* prods = rule->list->list;
+        for(size_t i = 0; i < prods->len; i++) {
+            fprintf(fp, "prod\n");
+            write_elems(fp, prods->list[i]);
+            fprintf(fp, "end\n");
+        }
+        fprintf(fp, "end\n");
+    }
+}
+
+/*
+ * Return 1 if the two modules have the same includes and rules. They are
+ * compared in the written form, so an edit that only changed comments or
+ * layout makes no difference.
+ */
+static int same_module(Module* a, Module* b) {
+
+    char* buf[2]   = {NULL, NULL};
+    size_t len[2]  = {0, 0};
+    Module* mod[2] = {a, b};
+    int retv       = 1;
+
+    for(int i = 0; i < 2; i++) {
+        FILE* fp = open_memstream(&buf[i], &len[i]);
+        if(fp == NULL)
+            retv = 0;
+        else {
+            write_module(fp, mod[i]);
+            fclose(fp);
+        }
+    }
+
+    if(retv)
+        retv = (len[0] == len[1] && !memcmp(buf[0], buf[1], len[0]));
+
+    // allocated by open_memstream()
+    free(buf[0]);
+    free(buf[1]);
+
+    return retv;
+}
+
+/*
+ * Save the parsed module. It is written to a temporary name and then renamed
+ * so that another process never reads a partial file.
+ */
+static void save_module(Module* mod, const char* cache_dir) {
+
+    String* dir = create_string(cache_dir);
+    make_dir(raw_string(dir));
+    append_string_str(dir, "/modules");
+    make_dir(raw_string(dir));
+    destroy_string(dir);
+
+    String* name = cache_name(cache_dir, mod->hash);
+    String* tmp  = copy_string(name);
+    append_string_fmt(tmp, ".%d", (int)getpid());
+
+    FILE* fp = fopen(raw_string(tmp), "w");
+    if(fp != NULL) {
+        fprintf(fp, "%s %s\n", CACHE_MAGIC, pargen_build_id());
+        write_module(fp, mod);
+
+        if(fclose(fp) == 0)
+            rename(raw_string(tmp), raw_string(name));
+        else
+            remove(raw_string(tmp));
+    }
+
+    destroy_string(tmp);
+    destroy_string(name);
+}
+
+typedef struct {
+    FILE* fp;
+    char line[PATH_MAX + 16];
+    char* word;  // first word on the line
+    char* rest;  // everything after the first space, or NULL
+    int eof;
+    int bad;
+} _reader_t_;
+
+static int read_line(_reader_t_* rd) {
+
+    if(rd->bad || rd->eof)
+        return 0;
+
+    if(fgets(rd->line, sizeof(rd->line), rd->fp) == NULL) {
+        rd->eof = 1;
+        return 0;
+    }
+
+    rd->line[strcspn(rd->line, "\n")] = '\0';
+    rd->word = rd->line;
+    rd->rest = strchr(rd->line, ' ');
+    if(rd->rest != NULL)
+        *rd->rest++ = '\0';
+
+    return 1;
+}
+
+static AstNode* read_symbol(_reader_t_* rd, AstNodeType type) {
+
+    if(rd->rest == NULL) {
+        rd->bad = 1;
+        return NULL;
+    }
+
+    ast_terminal_t* node = (ast_terminal_t*)create_ast_node(type);
+    char* name           = strchr(rd->rest, ' ');
+    if(name != NULL)
+        *name++ = '\0';
+
+    node->tok  = create_string(rd->rest);
+    node->name = (name != NULL) ? create_string(name) : NULL;
+
+    return (AstNode*)node;
+}
+
+static ast_production_t* read_elems(_reader_t_* rd);
+
+static AstNode* read_group(_reader_t_* rd) {
+
+    // the line is reused by read_elems(), so the kind is taken first
+    int kind          = (rd->rest != NULL) ? rd->rest[0] : '\0';
+    ast_group_t* node = (ast_group_t*)create_ast_node(AST_GROUP);
+    node->prod        = read_elems(rd);
+
+    switch(kind) {
+        case '?': {
+                ast_zero_or_one_t* ptr = (ast_zero_or_one_t*)create_ast_node(AST_ZERO_OR_ONE);
+                ptr->group             = node;
+                return (AstNode*)ptr;
+            }
+        case '+': {
+                ast_one_or_more_t* ptr = (ast_one_or_more_t*)create_ast_node(AST_ONE_OR_MORE);
+                ptr->group             = node;
+                return (AstNode*)ptr;
+            }
+        case '*': {
+                ast_zero_or_more_t* ptr = (ast_zero_or_more_t*)create_ast_node(AST_ZERO_OR_MORE);
+                ptr->group              = node;
+                return (AstNode*)ptr;
+            }
+        default:
+            return (AstNode*)node;
+    }
+}
+
+/*
+ * Read production elements up to the matching "end".
+ */
+static ast_production_t* read_elems(_reader_t_* rd) {
+
+    ast_production_t* prod = (ast_production_t*)create_ast_node(AST_PRODUCTION);
+    prod->list             = create_elem_vec();
+
+    while(read_line(rd) && strcmp(rd->word, "end")) {
+        AstNode* node = NULL;
+
+        if(!strcmp(rd->word, "term"))
+            node = read_symbol(rd, AST_TERMINAL);
+        else if(!strcmp(rd->word, "nterm"))
+            node = read_symbol(rd, AST_NON_TERMINAL);
+        else if(!strcmp(rd->word, "group"))
+            node = read_group(rd);
+        else
+            rd->bad = 1;
+
+        if(node != NULL) {
+            ast_prod_elem_t* elem = (ast_prod_elem_t*)create_ast_node(AST_PROD_ELEM);
+            elem->node            = node;
+            append_elem_vec(prod->list, elem);
+        }
+    }
+
+    // the end of the file is only expected between items
+    if(rd->eof)
+        rd->bad = 1;
+
+    return prod;
+}
+
+static AstNode* read_rule(_reader_t_* rd) {
+
+    ast_rule_t* rule = (ast_rule_t*)create_ast_node(AST_RULE);
+    rule->name       = create_string(rd->rest);
+    rule->list       = (ast_production_list_t*)create_ast_node(AST_PRODUCTION_LIST);
+    rule->list->list = create_prod_vec();
+
+    while(read_line(rd) && !strcmp(rd->word, "prod"))
+        append_prod_vec(rule->list->list, read_elems(rd));
+
+    if(rd->eof || strcmp(rd->word, "end") || rule->list->list->len == 0)
+        rd->bad = 1;
+
+    return (AstNode*)rule;
+}
+
+/*
+ * Load a module from the cache. Returns NULL if it is not there or if the
+ * file cannot be understood, in which case the module is parsed.
+ */
+static Module* load_module(const char* cache_dir, const char* path, uint64_t hash) {
+
+    String* name = cache_name(cache_dir, hash);
+    _reader_t_ rd;
+
+    rd.fp  = fopen(raw_string(name), "r");
+    rd.eof = 0;
+    rd.bad = 0;
+    destroy_string(name);
+    if(rd.fp == NULL)
+        return NULL;
+
+    Module* mod = create_module(path, hash);
+    String* id  = create_string(&CACHE_MAGIC[7]);
+    append_string_fmt(id, " %s", pargen_build_id());
+
+    if(read_line(&rd) && !strcmp(rd.line, "pargen") && rd.rest != NULL &&
+       !comp_string_str(id, rd.rest)) {
+        while(read_line(&rd)) {
+            if(!strcmp(rd.word, "include") && rd.rest != NULL)
+                append_str_lst(mod->includes, create_string(rd.rest));
+            else if(!strcmp(rd.word, "rule") && rd.rest != NULL)
+                append_ptr_lst(mod->rules, read_rule(&rd));
+            else
+                rd.bad = 1;
+        }
+    }
+    else
+        rd.bad = 1;
+
+    fclose(rd.fp);
+    destroy_string(id);
+
+    if(rd.bad) {
+        destroy_module(mod);
+        return NULL;
+    }
+
+    return mod;
+}
+
+/******************************************************************************
+ *
+ * Symbol lists
+ *
+ */
+static HashTable* term_table = NULL;
+
+static int collect_terms(AstNode* node) {
+
+    if(node->type == AST_TERMINAL) {
+        const char* str = raw_string(((ast_terminal_t*)node)->tok);
+        if(insert_hashtable(term_table, str, NULL, 0) == HASH_OK)
+            append_str_lst(terms, create_string(str));
+    }
+
+    return 0;
+}
+
+static void collect_symbols(Module* mod) {
+
+    int mark = 0;
+    ast_rule_t* rule;
+
+    while(NULL != (rule = iterate_ptr_lst(mod->rules, &mark))) {
+        append_str_lst(nterms, copy_string(rule->name));
+        ast_rule(rule, collect_terms, NULL);
+    }
+}
+
+/******************************************************************************
+ *
+ * Public Interface
+ *
+ */
+
+/**
+ * @brief Called by the parser when a rule has been read.
+ *
+ * @param node
+ */
+void add_module_rule(AstNode* node) {
+
+    append_ptr_lst(current->rules, node);
+}
+
+/**
+ * @brief Called by the parser when an %include directive has been read. The
+ * name is owned by the module after this.
+ *
+ * @param name
+ */
+void add_module_include(String* name) {
+
+    append_str_lst(current->includes, name);
+}
+
+/*
+ * Load the grammar that starts with the named module. If the text is not
+ * NULL then it is the content of the first module and the name is only used
+ * for messages and to find the modules that it includes.
+ */
+static int load_modules(const char* fname, const char* text, size_t size,
+                        const char* cache_dir) {
+
+    if(state->modules == NULL)
+        state->modules = create_ptr_lst();
+
+    terms       = create_str_lst();
+    nterms      = create_str_lst();
+    state->input_files = create_str_lst();
+    term_table  = create_hashtable();
+
+    ast_grammar_t* grammar = (ast_grammar_t*)create_ast_node(AST_GRAMMAR);
+    grammar->list          = create_ptr_lst();
+    root_node              = (AstNode*)grammar;
+
+    int mark = 0;
+    Module* mod;
+    while(NULL != (mod = iterate_ptr_lst(state->modules, &mark)))
+        mod->seen = 0;
+    state->changed = 0;
+
+    // the queue grows while it is being read as includes are found
+    StrLst* queue = create_str_lst();
+    append_str_lst(queue, create_string(fname));
+    HashTable* visited = create_hashtable();
+    int total_errors   = 0;
+
+    for(size_t i = 0; i < queue->len; i++) {
+        const char* name = raw_string(queue->list[i]);
+        int in_memory    = (i == 0 && text != NULL);
+        char path[PATH_MAX];
+        uint64_t hash;
+
+        if(in_memory)
+            snprintf(path, sizeof(path), "%s", name);
+        else if(realpath(name, path) == NULL) {
+            fprintf(stderr, "%s: error: cannot open module: %s\n", name, strerror(errno));
+            total_errors++;
+            // the watcher and the depfile have to know about it so that
+            // creating it makes the grammar load again
+            append_str_lst(state->input_files, create_string(name));
+            continue;
+        }
+
+        if(insert_hashtable(visited, path, NULL, 0) == HASH_DUP)
+            continue; // already loaded
+
+        append_str_lst(state->input_files, create_string(name));
+
+        if(in_memory)
+            hash = hash_bytes(text, size);
+        else {
+            String* content = create_string_file(path);
+            if(content == NULL) {
+                fprintf(stderr, "%s: error: cannot read module: %s\n", name, strerror(errno));
+                total_errors++;
+                continue;
+            }
+            hash = hash_bytes(content->buffer, content->length);
+            destroy_string(content);
+        }
+
+        // a module whose text changed is read again but the old one is kept
+        // if the rules in it are the same
+        Module* old = find_module(path);
+        mod         = NULL;
+        if(old != NULL && old->hash == hash)
+            mod = old;
+
+        if(mod == NULL && cache_dir != NULL)
+            mod = load_module(cache_dir, path, hash);
+
+        if(mod == NULL) {
+            current = create_module(path, hash);
+            errors  = 0;
+            int opened = (in_memory) ? open_buffer(name, text, size) : open_file(name);
+
+            if(opened != 0 || yyparse() != 0 || errors > 0) {
+                reset_scanner();
+                total_errors += (errors > 0) ? errors : 1;
+                destroy_module(current);
+                current = NULL;
+                if(old != NULL)
+                    forget_module(old);
+                continue;
+            }
+
+            mod     = current;
+            current = NULL;
+            if(cache_dir != NULL)
+                save_module(mod, cache_dir);
+        }
+
+        if(mod != old && old != NULL) {
+            if(same_module(mod, old)) {
+                destroy_module(mod);
+                old->hash = hash;
+                mod       = old;
+            }
+            else
+                forget_module(old);
+        }
+
+        if(mod != old)
+            state->changed = 1;
+        if(find_module(path) == NULL)
+            append_ptr_lst(state->modules, mod);
+        mod->seen = 1;
+
+        int rmark = 0;
+        AstNode* rule;
+        while(NULL != (rule = iterate_ptr_lst(mod->rules, &rmark)))
+            append_ptr_lst(grammar->list, rule);
+
+        int imark = 0;
+        String* str;
+        while(NULL != (str = iterate_str_lst(mod->includes, &imark)))
+            append_str_lst(queue, resolve_name(mod, raw_string(str)));
+
+        collect_symbols(mod);
+    }
+
+    destroy_str_lst(queue);
+    destroy_hashtable(visited);
+    destroy_hashtable(term_table);
+    clear_token_cache();
+    term_table = NULL;
+
+    sort_str_lst(nterms);
+    sort_str_lst(terms);
+
+    errors = total_errors;
+    return total_errors;
+}
+
+/**
+ * @brief Read the grammar, starting with the named file, and build the AST,
+ * the lists of symbols, the symbol table and the IR. Returns the number of
+ * errors.
+ *
+ * @param fname
+ * @param cache_dir
+ * @return int
+ */
+int load_grammar(const char* fname, const char* cache_dir) {
+
+    int retv = load_modules(fname, NULL, 0, cache_dir);
+
+    return (retv == 0) ? check_grammar() : retv;
+}
+
+/**
+ * @brief Read the modules of a grammar and build the AST and the lists of
+ * symbols, but do not check it. If the text is not NULL then it is the
+ * content of the first module. The name is used in messages and the files
+ * that it includes are found relative to it. Returns the number of errors.
+ *
+ * @param name
+ * @param text
+ * @param size
+ * @param cache_dir
+ * @return int
+ */
+int read_grammar(const char* name, const char* text, size_t size, const char* cache_dir) {
+
+    return load_modules(name, text, size, cache_dir);
+}
+
+/**
+ * @brief Check the grammar that read_grammar() read. This builds the symbol
+ * table and the IR, analyzes it, removes the left recursion and factors the
+ * alternatives. Returns the number of errors.
+ *
+ * @return int
+ */
+int check_grammar(void) {
+
+    int total_errors = resolve_symbols();
+
+    if(total_errors == 0) {
+        lower_grammar();
+        analyze_grammar();
+        total_errors = remove_left_recursion();
+        factor_grammar();
+        name_ir_fields(get_ir());
+    }
+
+    state->checked = (total_errors == 0);
+    errors         = total_errors;
+    return total_errors;
+}
+
+/*
+ * Free a grammar that was loaded and what was made from it. The rules
+ * belong to the modules.
+ */
+static void free_grammar(AstNode* root, StrLst* term_lst, StrLst* nterm_lst) {
+
+    if(root != NULL) {
+        destroy_ir(((ast_grammar_t*)root)->ir);
+        destroy_symbols(((ast_grammar_t*)root)->symbols);
+        destroy_ptr_lst(((ast_grammar_t*)root)->list);
+        _FREE(root);
+    }
+
+    destroy_str_lst(nterm_lst);
+    destroy_str_lst(term_lst);
+}
+
+static void forget_unseen(void) {
+
+    if(state->modules != NULL) {
+        for(size_t i = state->modules->len; i > 0; i--) {
+            Module* mod = state->modules->list[i - 1];
+            if(!mod->seen)
+                forget_module(mod);
+        }
+    }
+}
+
+/*
+ * Return 1 if the two grammars are made of the same rules in the same order.
+ */
+static int same_rules(AstNode* a, AstNode* b) {
+
+    PtrLst* la = ((ast_grammar_t*)a)->list;
+    PtrLst* lb = ((ast_grammar_t*)b)->list;
+
+    if(la->len != lb->len)
+        return 0;
+
+    for(size_t i = 0; i < la->len; i++) {
+        if(la->list[i] != lb->list[i])
+            return 0;
+    }
+
+    return 1;
+}
+
+/**
+ * @brief Free everything that load_grammar() created, except the modules,
+ * which are kept in case they are loaded again. Modules that were not part
+ * of the last load are freed.
+ */
+void unload_grammar(void) {
+
+    free_grammar(root_node, terms, nterms);
+    destroy_str_lst(state->input_files);
+    root_node = NULL;
+    nterms = terms     = NULL;
+    state->input_files = NULL;
+    state->checked     = 0;
+
+    forget_unseen();
+}
+
+/**
+ * @brief Load the grammar again after its files changed. If every module
+ * that was read again has the same rules as before, such as after an edit to
+ * a comment, then the symbol table, the IR and the analysis of the last load
+ * are kept. Otherwise this is the same as unload_grammar() followed by
+ * load_grammar(). Returns the number of errors.
+ *
+ * @param fname
+ * @param cache_dir
+ * @return int
+ */
+int reload_grammar(const char* fname, const char* cache_dir) {
+
+    AstNode* old_root  = root_node;
+    StrLst* old_terms  = terms;
+    StrLst* old_nterms = nterms;
+    int checked        = state->checked;
+
+    destroy_str_lst(state->input_files);
+    root_node = NULL;
+    nterms = terms     = NULL;
+    state->input_files = NULL;
+    state->checked     = 0;
+
+    int retv = load_modules(fname, NULL, 0, cache_dir);
+
+    if(retv == 0 && checked && !state->changed && same_rules(old_root, root_node)) {
+        free_grammar(root_node, terms, nterms);
+        root_node      = old_root;
+        terms          = old_terms;
+        nterms         = old_nterms;
+        state->checked = 1;
+    }
+    else {
+        free_grammar(old_root, old_terms, old_nterms);
+        if(retv == 0)
+            retv = check_grammar();
+    }
+
+    forget_unseen();
+
+    errors = retv;
+    return retv;
+}
+
+/**
+ * @brief Free all of the modules.
+ */
+void destroy_modules(void) {
+
+    unload_grammar();
+
+    if(state->modules != NULL) {
+        int mark = 0;
+        Module* mod;
+        while(NULL != (mod = iterate_ptr_lst(state->modules, &mark)))
+            destroy_module(mod);
+        destroy_ptr_lst(state->modules);
+        state->modules = NULL;
+    }
+
+    destroy_fragments(state->fragments);
+    state->fragments = NULL;
+}
+
+/**
+ * @brief Return the list of files that were read by the last load.
+ *
+ * @return StrLst*
+ */
+StrLst* get_input_files(void) {
+
+    return state->input_files;
+}
+
+/**
+ * @brief Return the fragment store of the current state. It is created the
+ * first time that it is used.
+ *
+ * @return Fragments*
+ */
+Fragments* get_fragments(void) {
+
+    if(state->fragments == NULL)
+        state->fragments = create_fragments();
+
+    return state->fragments;
+}
+
+/**
+ * @brief Create an empty loader state. A program that loads more than one
+ * grammar at a time gives each of them a state and makes it current with
+ * use_grammar_state() before using the loader or the passes.
+ *
+ * @return GrammarState*
+ */
+GrammarState* create_grammar_state(void) {
+
+    return _ALLOC_DS(GrammarState);
+}
+
+/**
+ * @brief Free a state and everything that was loaded into it. If it is the
+ * current state then the default state becomes current.
+ *
+ * @param st
+ */
+void destroy_grammar_state(GrammarState* st) {
+
+    if(st != NULL && st != &default_state) {
+        GrammarState* prev = (state == st) ? &default_state : state;
+        use_grammar_state(st);
+        destroy_modules();
+        use_grammar_state(prev);
+        _FREE(st);
+    }
+}
+
+/**
+ * @brief Make the state current. The globals that the passes use are saved
+ * in the state that was current and replaced with the ones from this one. A
+ * NULL state selects the default state.
+ *
+ * @param st
+ */
+void use_grammar_state(GrammarState* st) {
+
+    if(st == NULL)
+        st = &default_state;
+
+    state->root_node = root_node;
+    state->terms     = terms;
+    state->nterms    = nterms;
+
+    state     = st;
+    root_node = st->root_node;
+    terms     = st->terms;
+    nterms    = st->nterms;
+}
@@ -0,0 +1,42 @@
+/**
+ * @file module.h
+ *
+ * @brief Public interface to the grammar module loader. A grammar can be
+ * split into modules with the %include directive.
+ *
+ * @author Chuck Tilbury (chucktilbury@gmail.com)
+ * @version 0.0
+ * @date 2024-08-13
+ * @copyright Copyright (c) 2024
+ *
+ */
+#ifndef _MODULE_H_
+#define _MODULE_H_
+
+#include <stddef.h>
+
+#include "ast.h"
+#include "fragment.h"
+#include "str.h"
+#include "str_lst.h"
+
+typedef struct _grammar_state_ GrammarState;
+
+int load_grammar(const char* fname, const char* cache_dir);
+int read_grammar(const char* name, const char* text, size_t size, const char* cache_dir);
+int check_grammar(void);
+void unload_grammar(void);
+int reload_grammar(const char* fname, const char* cache_dir);
+void destroy_modules(void);
+StrLst* get_input_files(void);
+Fragments* get_fragments(void);
+
+GrammarState* create_grammar_state(void);
+void destroy_grammar_state(GrammarState* st);
+void use_grammar_state(GrammarState* st);
+
+// called by the parser
+void add_module_rule(AstNode* node);
+void add_module_include(String* name);
+
+#endif /* _MODULE_H_ */
@@ -0,0 +1,368 @@
+/**
+ * @file outcache.c
+ *
+ * @brief The output cache saves the generated files in a directory named by
+ * a hash of the grammar, the options that change the output and the version
+ * of pargen. When the same grammar is built again, in this build tree or any
+ * other one that uses the same cache, the files are hard linked or copied out
+ * of the cache and the grammar is not parsed at all.
+ *
+ * The grammar is hashed in a canonical form so that changing a comment or the
+ * layout of a grammar file does not make a new entry. The files are read as
+ * text for this, which is much cheaper than parsing them.
+ *
+ *   <cache>/outputs/<key>/manifest  the names of the outputs, one per line
+ *   <cache>/outputs/<key>/<n>       the content of the nth output
+ *
+ * @author Chuck Tilbury (chucktilbury@gmail.com)
+ * @version 0.0
+ * @date 2024-08-14
+ * @copyright Copyright (c) 2024
+ *
+ */
+#define _XOPEN_SOURCE 700
+#include <ctype.h>
+#include <errno.h>
+#include <limits.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "emit.h"
+#include "hash.h"
+#include "memory.h"
+#include "outcache.h"
+#include "str.h"
+#include "str_lst.h"
+
+#define INCLUDE_STR "%include "
+
+/*
+ * Append the canonical form of a grammar file to the buffer. Comments are
+ * removed and every run of white space becomes one space. Quoted terminals
+ * are copied as they are.
+ */
+static void canonical_text(String* out, String* text) {
+
+    const char* ptr = raw_string(text);
+    const char* end = ptr + text->length;
+    int space       = 0;
+
+    while(ptr < end) {
+        if(*ptr == '#') {
+            while(ptr < end && *ptr != '\n')
+                ptr++;
+            space = 1;
+        }
+        else if(isspace((unsigned char)*ptr)) {
+            ptr++;
+            space = 1;
+        }
+        else {
+            if(space && out->length > 0)
+                append_string_char(out, ' ');
+            space = 0;
+
+            if(*ptr == '\'' || *ptr == '\"') {
+                const char* start = ptr++;
+                while(ptr < end && *ptr != *start && *ptr != '\n')
+                    ptr++;
+                if(ptr < end && *ptr == *start)
+                    ptr++;
+                append_buffer(out, (void*)start, ptr - start);
+            }
+            else
+                append_string_char(out, *ptr++);
+        }
+    }
+}
+
+/*
+ * Add the names given to %include in canonical text to the queue. They are
+ * relative to the directory of the file that names them.
+ */
+static void find_includes(const char* text, const char* path, StrLst* queue) {
+
+    const char* dir_end = strrchr(path, '/');
+    const char* ptr     = text;
+
+    while(NULL != (ptr = strstr(ptr, INCLUDE_STR))) {
+        ptr += strlen(INCLUDE_STR);
+        if(*ptr != '\'' && *ptr != '\"')
+            continue;
+
+        const char* end = strchr(ptr + 1, *ptr);
+        if(end == NULL)
+            break;
+
+        String* name = create_string(NULL);
+        if(ptr[1] != '/' && dir_end != NULL)
+            append_buffer(name, (void*)path, (dir_end - path) + 1);
+        append_buffer(name, (void*)(ptr + 1), end - ptr - 1);
+        append_str_lst(queue, name);
+        ptr = end + 1;
+    }
+}
+
+static String* entry_name(const char* cache_dir, uint64_t key, const char* file) {
+
+    String* str = create_string(cache_dir);
+    append_string_fmt(str, "/outputs/%016llx", (unsigned long long)key);
+    if(file != NULL)
+        append_string_fmt(str, "/%s", file);
+
+    return str;
+}
+
+static int same_content(const char* left, const char* right) {
+
+    String* lstr = create_string_file(left);
+    String* rstr = create_string_file(right);
+    int retv     = (lstr != NULL && rstr != NULL && !comp_buffer(lstr, rstr));
+
+    destroy_string(lstr);
+    destroy_string(rstr);
+
+    return retv;
+}
+
+/*
+ * Put a copy of a cached file at the name. A hard link is tried first and a
+ * copy is made if that fails, such as when the cache is on a different file
+ * system. If the file is already there, then it is not touched.
+ */
+static int place_file(const char* cached, const char* name) {
+
+    struct stat cst, nst;
+
+    if(stat(cached, &cst) != 0)
+        return 0;
+
+    if(stat(name, &nst) == 0) {
+        if(cst.st_dev == nst.st_dev && cst.st_ino == nst.st_ino)
+            return 1;
+        if(same_content(cached, name))
+            return 1;
+    }
+
+    unlink(name);
+    if(link(cached, name) == 0)
+        return 1;
+
+    String* content = create_string_file(cached);
+    if(content == NULL)
+        return 0;
+
+    String* tmp = create_string(name);
+    append_string_str(tmp, ".tmp");
+
+    int retv = 0;
+    FILE* fp = fopen(raw_string(tmp), "wb");
+    if(fp != NULL) {
+        fwrite(content->buffer, 1, content->length, fp);
+        retv = (fclose(fp) == 0 && rename(raw_string(tmp), name) == 0);
+    }
+
+    destroy_string(tmp);
+    destroy_string(content);
+
+    return retv;
+}
+
+static void make_dir(const char* name) {
+
+    if(mkdir(name, 0777) != 0 && errno != EEXIST)
+        fprintf(stderr, "Warning: cannot create cache directory '%s': %s\n", name,
+                strerror(errno));
+}
+
+/******************************************************************************
+ *
+ * Public Interface
+ *
+ */
+
+/**
+ * @brief Calculate the key for the output cache from the grammar that starts
+ * with the file name and the list of option values. The names of the grammar
+ * files that were read are added to the list of inputs. Returns zero if a
+ * file cannot be read, in which case the cache should not be used.
+ *
+ * @param fname
+ * @param options
+ * @param inputs
+ * @return uint64_t
+ */
+uint64_t output_cache_key(const char* fname, StrLst* options, StrLst* inputs) {
+
+    String* canon      = create_string(NULL);
+    StrLst* queue      = create_str_lst();
+    HashTable* visited = create_hashtable();
+    uint64_t key       = 0;
+    int ok             = 1;
+
+    append_str_lst(queue, create_string(fname));
+
+    // the same order as the module loader
+    for(size_t i = 0; ok && i < queue->len; i++) {
+        const char* name = raw_string(queue->list[i]);
+        char path[PATH_MAX];
+
+        if(realpath(name, path) == NULL) {
+            ok = 0;
+            break;
+        }
+
+        if(insert_hashtable(visited, path, NULL, 0) == HASH_DUP)
+            continue;
+
+        String* text = create_string_file(path);
+        if(text == NULL) {
+            ok = 0;
+            break;
+        }
+
+        size_t start = canon->length;
+        canonical_text(canon, text);
+        find_includes(raw_string(canon) + start, path, queue);
+        append_string_char(canon, '\0');
+        append_str_lst(inputs, create_string(name));
+        destroy_string(text);
+    }
+
+    if(ok) {
+        int mark = 0;
+        String* str;
+        while(NULL != (str = iterate_str_lst(options, &mark))) {
+            append_string_string(canon, str);
+            append_string_char(canon, '\0');
+        }
+
+        key = hash_bytes(canon->buffer, canon->length);
+        // zero means "no key"
+        if(key == 0)
+            key = 1;
+    }
+
+    destroy_hashtable(visited);
+    destroy_str_lst(queue);
+    destroy_string(canon);
+
+    return key;
+}
+
+/**
+ * @brief Put the outputs that are saved under the key in place. The names of
+ * the outputs are added to the list of targets. Returns non-zero if all of
+ * them were restored.
+ *
+ * @param cache_dir
+ * @param key
+ * @param targets
+ * @return int
+ */
+int restore_outputs(const char* cache_dir, uint64_t key, StrLst* targets) {
+
+    String* name     = entry_name(cache_dir, key, "manifest");
+    String* manifest = create_string_file(raw_string(name));
+    destroy_string(name);
+
+    if(manifest == NULL)
+        return 0;
+
+    StrSplit* lst = split_slices(manifest, "\n");
+    int retv      = (lst->len > 0);
+
+    for(size_t i = 0; retv && i < lst->len; i++) {
+        const char* str = lst->list[i].ptr;
+        String* file    = create_string(NULL);
+        append_string_fmt(file, "%zu", i);
+        String* cached = entry_name(cache_dir, key, raw_string(file));
+
+        retv = place_file(raw_string(cached), str);
+        if(retv)
+            append_str_lst(targets, create_string_slice(lst->list[i]));
+
+        destroy_string(cached);
+        destroy_string(file);
+    }
+
+    destroy_str_split(lst);
+    destroy_string(manifest);
+
+    return retv;
+}
+
+/**
+ * @brief Save the outputs of the last call to emit() under the key. The
+ * entry is built in a temporary directory and renamed into place so that
+ * another build never sees part of an entry.
+ *
+ * @param cache_dir
+ * @param key
+ */
+void save_outputs(const char* cache_dir, uint64_t key) {
+
+    String* dir = create_string(cache_dir);
+    make_dir(raw_string(dir));
+    append_string_str(dir, "/outputs");
+    make_dir(raw_string(dir));
+    destroy_string(dir);
+
+    String* entry = entry_name(cache_dir, key, NULL);
+    String* tmp   = copy_string(entry);
+    append_string_fmt(tmp, ".%d", (int)getpid());
+    make_dir(raw_string(tmp));
+
+    String* manifest = create_string(NULL);
+    String* file     = create_string(NULL);
+    const char *name, *buffer;
+    size_t size;
+    int mark = 0;
+    int ok   = 1;
+
+    while(ok && iterate_outputs(&mark, &name, &buffer, &size)) {
+        clear_string(file);
+        append_string_fmt(file, "%s/%d", raw_string(tmp), mark - 1);
+
+        FILE* fp = fopen(raw_string(file), "wb");
+        ok       = (fp != NULL);
+        if(ok) {
+            fwrite(buffer, 1, size, fp);
+            ok = (fclose(fp) == 0);
+        }
+        append_string_fmt(manifest, "%s\n", name);
+    }
+
+    if(ok) {
+        clear_string(file);
+        append_string_fmt(file, "%s/manifest", raw_string(tmp));
+        FILE* fp = fopen(raw_string(file), "wb");
+        ok       = (fp != NULL);
+        if(ok) {
+            fwrite(manifest->buffer, 1, manifest->length, fp);
+            ok = (fclose(fp) == 0);
+        }
+    }
+
+    if(!ok || rename(raw_string(tmp), raw_string(entry)) != 0) {
+        // another build saved the same entry first, or it failed
+        for(int i = 0; i < mark; i++) {
+            clear_string(file);
+            append_string_fmt(file, "%s/%d", raw_string(tmp), i);
+            unlink(raw_string(file));
+        }
+        clear_string(file);
+        append_string_fmt(file, "%s/manifest", raw_string(tmp));
+        unlink(raw_string(file));
+        rmdir(raw_string(tmp));
+    }
+
+    destroy_string(file);
+    destroy_string(manifest);
+    destroy_string(tmp);
+    destroy_string(entry);
+}
@@ -0,0 +1,26 @@
+/**
+ * @file outcache.h
+ *
+ * @brief Public interface to the output cache. Generated files are saved by
+ * a hash of everything that they are made from so that another build of the
+ * same grammar can reuse them.
+ *
+ * @author Chuck Tilbury (chucktilbury@gmail.com)
+ * @version 0.0
+ * @date 2024-08-14
+ * @copyright Copyright (c) 2024
+ *
+ */
+#ifndef _OUTCACHE_H_
+#define _OUTCACHE_H_
+
+#include <stdint.h>
+
+#include "str.h"
+#include "str_lst.h"
+
+uint64_t output_cache_key(const char* fname, StrLst* options, StrLst* inputs);
+int restore_outputs(const char* cache_dir, uint64_t key, StrLst* targets);
+void save_outputs(const char* cache_dir, uint64_t key);
+
+#endif /* _OUTCACHE_H_ */
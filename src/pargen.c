@@ -0,0 +1,275 @@
+/**
+ * @file pargen.c
+ *
+ * @brief Implementation of the pargen library interface. The loader and the
+ * passes keep their state in globals, so every call here makes the state of
+ * the Pargen object current first and puts the default state back when it
+ * is finished. The grammar is not left in the globals between calls.
+ *
+ * The compiled templates and the scanner are shared by all of the objects.
+ * They are freed when the last object is destroyed.
+ *
+ * @author Chuck Tilbury (chucktilbury@gmail.com)
+ * @version 0.0
+ * @date 2024-08-15
+ * @copyright Copyright (c) 2024
+ *
+ */
+#include <stdio.h>
+#include <string.h>
+
+#include "emit.h"
+#include "memory.h"
+#include "module.h"
+#include "pargen.h"
+#include "scan.h"
+#include "str.h"
+#include "str_lst.h"
+
+struct _pargen_t_ {
+    GrammarState* state;
+    String* ast_name;
+    String* parse_name;
+    String* cache_dir;
+    String* memo;
+    int elide;
+    int loaded;
+    int analyzed;
+    int errors;
+};
+
+// the number of objects that have not been destroyed
+static int live = 0;
+
+static void enter(Pargen* pg) {
+
+    use_grammar_state(pg->state);
+}
+
+static void leave(void) {
+
+    use_grammar_state(NULL);
+}
+
+/*
+ * Replace a string option. A NULL value clears it.
+ */
+static void set_str(String** ptr, const char* value) {
+
+    destroy_string(*ptr);
+    *ptr = (value != NULL) ? create_string(value) : NULL;
+}
+
+/******************************************************************************
+ *
+ * Public Interface
+ *
+ */
+
+/**
+ * @brief Create a Pargen object with the default options.
+ *
+ * @return Pargen*
+ */
+Pargen* create_pargen(void) {
+
+    Pargen* pg     = _ALLOC_DS(Pargen);
+    pg->state      = create_grammar_state();
+    pg->ast_name   = create_string("_ast");
+    pg->parse_name = create_string("_parser");
+    live++;
+
+    return pg;
+}
+
+/**
+ * @brief Free the object and everything that was made from its grammar. When
+ * it is the last one, what the objects share is freed as well.
+ *
+ * @param pg
+ */
+void destroy_pargen(Pargen* pg) {
+
+    if(pg != NULL) {
+        destroy_grammar_state(pg->state);
+        destroy_string(pg->ast_name);
+        destroy_string(pg->parse_name);
+        destroy_string(pg->cache_dir);
+        destroy_string(pg->memo);
+        _FREE(pg);
+
+        if(--live == 0) {
+            destroy_emitters();
+            reset_scanner();
+        }
+    }
+}
+
+/**
+ * @brief Set an option. These are the same as the command line options of
+ * the pargen executable.
+ *
+ *   ast_name    name of the ast files, possibly a full path
+ *   parse_name  name of the parser files, possibly a full path
+ *   cache_dir   directory to cache parsed grammar modules and rule code in, or NULL
+ *   memo        rules that the parser memoizes, separated by commas, "auto" for
+ *               the ones that can be parsed again at the same token, or NULL
+ *   elide       anything other than NULL or "0" leaves the nodes that only pass
+ *               one child through out of the AST
+ *
+ * Returns non-zero if the name is not an option.
+ *
+ * @param pg
+ * @param name
+ * @param value
+ * @return int
+ */
+int set_pargen_option(Pargen* pg, const char* name, const char* value) {
+
+    if(!strcmp(name, "ast_name") && value != NULL)
+        set_str(&pg->ast_name, value);
+    else if(!strcmp(name, "parse_name") && value != NULL)
+        set_str(&pg->parse_name, value);
+    else if(!strcmp(name, "cache_dir"))
+        set_str(&pg->cache_dir, value);
+    else if(!strcmp(name, "memo"))
+        set_str(&pg->memo, value);
+    else if(!strcmp(name, "elide"))
+        pg->elide = (value != NULL && strcmp(value, "0"));
+    else
+        return 1;
+
+    return 0;
+}
+
+/**
+ * @brief Load the grammar that starts with the named file. The grammar that
+ * was loaded before is replaced. Modules that did not change since the last
+ * load are not parsed again. The grammar is only read, analyze_pargen()
+ * checks it. Returns the number of errors.
+ *
+ * @param pg
+ * @param fname
+ * @return int
+ */
+int load_pargen_file(Pargen* pg, const char* fname) {
+
+    return load_pargen_buffer(pg, fname, NULL, 0);
+}
+
+/**
+ * @brief Load a grammar from memory. The name is used in messages and the
+ * modules that the grammar includes are found relative to it. If the text is
+ * NULL then the named file is read. Returns the number of errors.
+ *
+ * @param pg
+ * @param name
+ * @param text
+ * @param size
+ * @return int
+ */
+int load_pargen_buffer(Pargen* pg, const char* name, const char* text, size_t size) {
+
+    const char* cache_dir = (pg->cache_dir != NULL) ? raw_string(pg->cache_dir) : NULL;
+
+    enter(pg);
+    unload_grammar();
+    pg->errors   = read_grammar(name, text, size, cache_dir);
+    pg->loaded   = 1;
+    pg->analyzed = 0;
+    leave();
+
+    return pg->errors;
+}
+
+/**
+ * @brief Check the grammar that was loaded. This resolves the symbols, makes
+ * the IR and runs the analysis passes on it: left recursion is removed and
+ * the alternatives are factored. It is only done one time for each load.
+ * Returns the number of errors, including the ones from loading it.
+ *
+ * @param pg
+ * @return int
+ */
+int analyze_pargen(Pargen* pg) {
+
+    if(!pg->loaded)
+        return 1;
+
+    if(pg->errors == 0 && !pg->analyzed) {
+        enter(pg);
+        pg->errors   = check_grammar();
+        pg->analyzed = 1;
+        leave();
+    }
+
+    return pg->errors;
+}
+
+/**
+ * @brief Generate the outputs. If the sink is NULL then the files are written
+ * to the disk, but only the ones whose content changed. Otherwise the sink is
+ * called one time for each output and nothing is written. The grammar is
+ * checked first if analyze_pargen() was not called. Returns the number of
+ * outputs, or -1 if the grammar has errors or an output cannot be made or
+ * written.
+ *
+ * @param pg
+ * @param sink
+ * @param data
+ * @return int
+ */
+int emit_pargen(Pargen* pg, PargenSink sink, void* data) {
+
+    if(analyze_pargen(pg) != 0)
+        return -1;
+
+    enter(pg);
+    if(pg->cache_dir != NULL)
+        read_fragments(get_fragments(), raw_string(pg->cache_dir), raw_string(pg->ast_name));
+    int errors = emit(raw_string(pg->ast_name), raw_string(pg->parse_name),
+                      (pg->memo != NULL) ? raw_string(pg->memo) : NULL, pg->elide);
+    if(errors == 0 && pg->cache_dir != NULL)
+        write_fragments(get_fragments(), raw_string(pg->cache_dir), raw_string(pg->ast_name));
+
+    const char *name, *buffer;
+    size_t size;
+    int mark = 0;
+
+    // the outputs are not complete if there are errors
+    if(errors == 0 && sink == NULL)
+        errors = (write_outputs(get_input_files()) < 0);
+    else if(errors == 0) {
+        while(iterate_outputs(&mark, &name, &buffer, &size))
+            (*sink)(data, name, buffer, size);
+    }
+
+    int count = 0;
+    mark      = 0;
+    while(iterate_outputs(&mark, &name, &buffer, &size))
+        count++;
+
+    destroy_outputs();
+    leave();
+
+    return (errors > 0) ? -1 : count;
+}
+
+/**
+ * @brief Return the names of the grammar files that were read by the last
+ * load, one at a time. The mark must be zero for the first call. Returns
+ * NULL when there are no more.
+ *
+ * @param pg
+ * @param mark
+ * @return const char*
+ */
+const char* iterate_pargen_inputs(Pargen* pg, int* mark) {
+
+    enter(pg);
+    StrLst* lst = get_input_files();
+    String* str = (lst != NULL) ? iterate_str_lst(lst, mark) : NULL;
+    leave();
+
+    return (str != NULL) ? raw_string(str) : NULL;
+}
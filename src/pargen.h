@@ -0,0 +1,54 @@
+/**
+ * @file pargen.h
+ *
+ * @brief Public interface to the pargen library. This is what a program uses
+ * to generate parsers without running the pargen executable.
+ *
+ * A Pargen object holds a grammar and everything that was made from it. The
+ * grammar is loaded from a file or from memory and then the outputs are
+ * emitted, either to the disk or to a function that the caller gives. The
+ * memory that is made from a grammar belongs to its Pargen object and it is
+ * freed by destroy_pargen(). The compiled templates and the scanner are
+ * shared by the objects, and they are freed when the last one is destroyed,
+ * so nothing is left when there are no objects.
+ *
+ * Any number of Pargen objects can exist at one time, but the library is not
+ * thread safe. Only one call into it can be running at a time.
+ *
+ *   Pargen* pg = create_pargen();
+ *   set_pargen_option(pg, "ast_name", "build/my_ast");
+ *   if(load_pargen_file(pg, "my_grammar.txt") == 0 && analyze_pargen(pg) == 0)
+ *       emit_pargen(pg, my_sink, my_data);
+ *   destroy_pargen(pg);
+ *
+ * @author Chuck Tilbury (chucktilbury@gmail.com)
+ * @version 0.0
+ * @date 2024-08-15
+ * @copyright Copyright (c) 2024
+ *
+ */
+#ifndef _PARGEN_H_
+#define _PARGEN_H_
+
+#include <stddef.h>
+
+typedef struct _pargen_t_ Pargen;
+
+/*
+ * Receives one generated file. The buffer belongs to the library and it is
+ * only valid until the function returns.
+ */
+typedef void (*PargenSink)(void* data, const char* name, const char* buffer, size_t size);
+
+Pargen* create_pargen(void);
+void destroy_pargen(Pargen* pg);
+int set_pargen_option(Pargen* pg, const char* name, const char* value);
+
+int load_pargen_file(Pargen* pg, const char* fname);
+int load_pargen_buffer(Pargen* pg, const char* name, const char* text, size_t size);
+int analyze_pargen(Pargen* pg);
+int emit_pargen(Pargen* pg, PargenSink sink, void* data);
+
+const char* iterate_pargen_inputs(Pargen* pg, int* mark);
+
+#endif /* _PARGEN_H_ */
@@ -8,18 +8,13 @@
 #include <stdint.h>
 
 #include "ast.h"
+#include "module.h"
 #include "scan.h"
 #include "str.h"
 #include "str_lst.h"
 
 int errors = 0;
 
-
-extern StrLst* terms;
-extern StrLst* nterms;
-
-AstNode* root_node = NULL;
-
 #ifdef USE_PARSE_TRACE
 #   define PARSE_TRACE(fmt, ...) do { \
             printf(">>> %d:%d: ", get_line_no(), get_col_no()); \
@@ -39,8 +34,8 @@ AstNode* root_node = NULL;
 
 %token<str> TERMINAL
 %token<str> IDENT
+%token<str> INCLUDE
 
-%type <node> grammar
 %type <node> rule
 %type <node> production_list
 %type <node> production
@@ -52,6 +47,10 @@ AstNode* root_node = NULL;
 %type <node> terminal
 %type <node> non_terminal
 
+// a syntax error stops the parser and what is on its stack is freed
+%destructor { destroy_string($$); } <str>
+%destructor { destroy_ast($$); } <node>
+
 %define parse.error verbose
 %locations
 
@@ -59,22 +58,25 @@ AstNode* root_node = NULL;
 
 
 grammar
+    : grammar_item
+    | grammar grammar_item
+    ;
+
+grammar_item
     : rule {
-            PARSE_TRACE("first grammar->rule");
-            $$ = root_node = create_ast_node(AST_GRAMMAR);
-            ((ast_grammar_t*)$$)->list = create_ptr_lst();
-            append_ptr_lst(((ast_grammar_t*)$$)->list, (void*)$1);
-        }
-    | grammar rule {
+            // the module loader builds the grammar from the modules
             PARSE_TRACE("add grammar->rule");
-            append_ptr_lst(((ast_grammar_t*)$1)->list, (void*)$2);
+            add_module_rule($1);
+        }
+    | INCLUDE {
+            PARSE_TRACE("include: %s", raw_string($1));
+            add_module_include($1);
         }
     ;
 
 rule
     : IDENT ':' production_list ';' {
             PARSE_TRACE("create rule: %s", raw_string($1));
-            append_str_lst(nterms, $1);
             $$ = create_ast_node(AST_RULE);
             ((ast_rule_t*)$$)->name = $1;
             ((ast_rule_t*)$$)->list = (ast_production_list_t*)$3;
@@ -85,12 +87,13 @@ production_list
     : production {
             PARSE_TRACE("first rule_list->production");
             $$ = create_ast_node(AST_PRODUCTION_LIST);
-            ((ast_production_list_t*)$$)->list = create_ptr_lst();
-            append_ptr_lst(((ast_production_list_t*)$$)->list, (void*)$1);
+            ((ast_production_list_t*)$$)->list = create_prod_vec();
+            append_prod_vec(((ast_production_list_t*)$$)->list, (ast_production_t*)$1);
         }
     | production_list '|' production {
             PARSE_TRACE("add rule_list->production");
-            append_ptr_lst(((ast_production_list_t*)$1)->list, (void*)$3);
+            append_prod_vec(((ast_production_list_t*)$1)->list, (ast_production_t*)$3);
+            $$ = $1;
         }
     ;
 
@@ -98,26 +101,21 @@ production
     : prod_elem {
             PARSE_TRACE("first production->prod_elem");
             $$ = create_ast_node(AST_PRODUCTION);
-            ((ast_production_t*)$$)->list = create_ptr_lst();
-            append_ptr_lst(((ast_production_t*)$$)->list, (void*)$1);
+            ((ast_production_t*)$$)->list = create_elem_vec();
+            append_elem_vec(((ast_production_t*)$$)->list, (ast_prod_elem_t*)$1);
         }
     | production prod_elem {
             PARSE_TRACE("add production->prod_elem");
-            append_ptr_lst(((ast_production_t*)$1)->list, (void*)$2);
+            append_elem_vec(((ast_production_t*)$1)->list, (ast_prod_elem_t*)$2);
+            $$ = $1;
         }
     ;
 
 prod_elem
     : terminal {
-            // glean the definitions of terminal symbols.
-            const char* str = raw_string(((ast_terminal_t*)$1)->tok);
-            PARSE_TRACE("prod_elem:terminal: %s", str);
+            PARSE_TRACE("prod_elem:terminal: %s", raw_string(((ast_terminal_t*)$1)->tok));
             $$ = create_ast_node(AST_PROD_ELEM);
             ((ast_prod_elem_t*)$$)->node = $1;
-
-            if(search_str_lst(terms, str) == -1)
-                append_str_lst(terms, create_string(str));
-
         }
     | non_terminal {
             // this is a reference to the non-terminal.
@@ -0,0 +1,290 @@
+/**
+ * @file precedence.c
+ *
+ * @brief Find the cascades of rules that each add operators to the rule
+ * under them, like
+ *
+ *   expr_sum : expr_sum '+' expr_prod | expr_sum '-' expr_prod | expr_prod ;
+ *   expr_prod : expr_prod '*' expr_unary | expr_prod '/' expr_unary | expr_unary ;
+ *   expr_unary : '-' expr_atom | expr_atom ;
+ *
+ * A rule like that is a level. One of its productions is the rule of the
+ * next level and the others are a prefix operator before it. The operators
+ * that come after it are the loop that remove_left_recursion() made. The
+ * parser does not call every level to get to the operand. It parses the
+ * operand and then climbs the levels of the operators that it finds, so
+ * the time that it takes goes with the number of operators and not with
+ * the number of levels.
+ *
+ * An operator can only be in one level, as a prefix or as an infix, and a
+ * prefix operator cannot start the operand. Otherwise the rules are tried
+ * one after the other like any other rule, so the cascade stops there.
+ *
+ * @author Chuck Tilbury (chucktilbury@gmail.com)
+ * @version 0.0
+ * @date 2024-08-26
+ * @copyright Copyright (c) 2024
+ *
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "memory.h"
+#include "precedence.h"
+
+static int is_once(IrElem* elem) {
+
+    return elem->min == 1 && elem->max == 1;
+}
+
+/*
+ * Returns non-zero if every production of the loop is the node so far, an
+ * operator and then the next level.
+ */
+static int is_infix_loop(IrRule* rule, IrRule* tail, int next) {
+
+    if(tail->parent != rule->id)
+        return 0;
+
+    for(size_t i = 0; i < tail->prods->len; i++) {
+        IrElemVec* elems = tail->prods->list[i]->elems;
+        if(elems->len != 3 || elems->list[0]->type != IR_LEFT ||
+           elems->list[0]->sym != rule->id || elems->list[1]->type != IR_TERMINAL ||
+           !is_once(elems->list[1]) || elems->list[2]->type != IR_RULE ||
+           elems->list[2]->sym != next || !is_once(elems->list[2]))
+            return 0;
+    }
+
+    return 1;
+}
+
+/*
+ * Returns the rule of the next level if the rule is a level, or -1.
+ */
+static int next_level(IrGrammar* ir, Analysis* an, IrRule* rule, uint64_t* after) {
+
+    int next  = -1;
+    int tail  = -1;
+    int bases = 0;
+
+    if(rule->parent >= 0)
+        return -1;
+
+    for(size_t i = 0; i < rule->prods->len; i++) {
+        IrProd* prod     = rule->prods->list[i];
+        IrElemVec* elems = prod->elems;
+        size_t idx       = 0;
+
+        if(elems->len > 0 && elems->list[0]->type == IR_TERMINAL && is_once(elems->list[0]))
+            idx = 1;
+        else
+            bases++;
+
+        if(idx >= elems->len || elems->list[idx]->type != IR_RULE || !is_once(elems->list[idx]) ||
+           (next >= 0 && elems->list[idx]->sym != next))
+            return -1;
+        next = elems->list[idx]->sym;
+
+        int loop = -1;
+        if(idx + 1 < elems->len) {
+            IrElem* elem = elems->list[idx + 1];
+            memset(after, 0, an->words * sizeof(uint64_t));
+            if(idx + 2 != elems->len || elem->type != IR_RULE || elem->min != 0 ||
+               elem->max != IR_MANY || elem_overlap(an, prod, idx + 1, after))
+                return -1;
+            loop = elem->sym;
+        }
+        if(i > 0 && loop != tail)
+            return -1;
+        tail = loop;
+    }
+
+    if(bases != 1 || next == rule->id || ir->rules[next]->parent >= 0 || an->nullable[next] ||
+       (rule->prods->len == 1 && tail < 0) ||
+       (tail >= 0 && !is_infix_loop(rule, ir->rules[tail], next)))
+        return -1;
+
+    return next;
+}
+
+/*
+ * Add the operators of the level to the sets. Returns zero if one of them
+ * is already in a level of the cascade.
+ */
+static int add_operators(IrGrammar* ir, IrRule* rule, uint64_t* prefix, uint64_t* infix) {
+
+    for(size_t i = 0; i < rule->prods->len; i++) {
+        IrElem* elem = rule->prods->list[i]->elems->list[0];
+        if(elem->type == IR_TERMINAL) {
+            if(test_bit(prefix, elem->sym))
+                return 0;
+            set_bit(prefix, elem->sym);
+        }
+    }
+
+    IrRule* tail = level_tail(ir, rule);
+    if(tail != NULL) {
+        for(size_t i = 0; i < tail->prods->len; i++) {
+            IrElem* elem = tail->prods->list[i]->elems->list[1];
+            if(test_bit(infix, elem->sym))
+                return 0;
+            set_bit(infix, elem->sym);
+        }
+    }
+
+    return 1;
+}
+
+/*
+ * The prefix operators of the levels must not start the operand.
+ */
+static int can_climb(IrGrammar* ir, Analysis* an, IntVec* levels, int operand, uint64_t* prefix) {
+
+    memset(prefix, 0, an->words * sizeof(uint64_t));
+    for(size_t i = 0; i < levels->len; i++) {
+        IrRule* rule = ir->rules[levels->list[i]];
+        for(size_t j = 0; j < rule->prods->len; j++) {
+            IrElem* elem = rule->prods->list[j]->elems->list[0];
+            if(elem->type == IR_TERMINAL)
+                set_bit(prefix, elem->sym);
+        }
+    }
+
+    return disjoint_bits(prefix, rule_first(an, operand), an->words);
+}
+
+/******************************************************************************
+ *
+ * Public Interface
+ *
+ */
+
+/**
+ * @brief Find the cascades of levels in the rules that are allowed. A
+ * cascade has at least two levels. A level is only in one cascade.
+ *
+ * @param ir
+ * @param an
+ * @param allowed
+ * @return PtrLst*
+ */
+PtrLst* find_cascades(IrGrammar* ir, Analysis* an, const char* allowed) {
+
+    PtrLst* cascades = create_ptr_lst();
+    int* next        = _ALLOC_DS_ARRAY(int, ir->num_rules);
+    char* below      = _ALLOC_DS_ARRAY(char, ir->num_rules);
+    char* taken      = _ALLOC_DS_ARRAY(char, ir->num_rules);
+    uint64_t* prefix = _ALLOC_DS_ARRAY(uint64_t, an->words);
+    uint64_t* infix  = _ALLOC_DS_ARRAY(uint64_t, an->words);
+    IntVec* starts   = create_int_vec();
+
+    for(int i = 0; i < ir->num_rules; i++)
+        next[i] = allowed[i] ? next_level(ir, an, ir->rules[i], prefix) : -1;
+    for(int i = 0; i < ir->num_rules; i++)
+        if(next[i] >= 0)
+            below[next[i]] = 1;
+
+    // the cascades start at the levels that no other level is made of, and
+    // again where a cascade had to stop
+    for(int i = ir->num_rules - 1; i >= 0; i--)
+        if(next[i] >= 0 && !below[i])
+            append_int_vec(starts, i);
+
+    while(starts->len > 0) {
+        int top = starts->list[--starts->len];
+        if(next[top] < 0 || taken[top])
+            continue;
+
+        IntVec* levels = create_int_vec();
+        int rule       = top;
+        memset(prefix, 0, an->words * sizeof(uint64_t));
+        memset(infix, 0, an->words * sizeof(uint64_t));
+        while(next[rule] >= 0 && !taken[rule] && add_operators(ir, ir->rules[rule], prefix, infix)) {
+            append_int_vec(levels, rule);
+            taken[rule] = 1;
+            rule        = next[rule];
+        }
+
+        while(levels->len > 0 && !can_climb(ir, an, levels, rule, prefix)) {
+            rule        = levels->list[--levels->len];
+            taken[rule] = 0;
+        }
+
+        if(levels->len < 2) {
+            // the first level is parsed like any other rule
+            for(size_t i = 0; i < levels->len; i++)
+                taken[levels->list[i]] = 0;
+            taken[top] = 1;
+            rule       = next[top];
+            destroy_int_vec(levels);
+        }
+        else {
+            Cascade* cascade = _ALLOC_DS(Cascade);
+            cascade->levels  = levels;
+            cascade->operand = rule;
+            append_ptr_lst(cascades, cascade);
+        }
+        append_int_vec(starts, rule);
+    }
+
+    destroy_int_vec(starts);
+    _FREE(next);
+    _FREE(below);
+    _FREE(taken);
+    _FREE(prefix);
+    _FREE(infix);
+
+    return cascades;
+}
+
+/**
+ * @brief Free the list of cascades.
+ *
+ * @param cascades
+ */
+void destroy_cascades(PtrLst* cascades) {
+
+    int mark = 0;
+    Cascade* cascade;
+
+    while(NULL != (cascade = iterate_ptr_lst(cascades, &mark))) {
+        destroy_int_vec(cascade->levels);
+        _FREE(cascade);
+    }
+    destroy_ptr_lst(cascades);
+}
+
+/**
+ * @brief Return the element of the level that refers to the next level in
+ * the production that has no prefix operator.
+ *
+ * @param rule
+ * @return IrElem*
+ */
+IrElem* level_base(IrRule* rule) {
+
+    for(size_t i = 0; i < rule->prods->len; i++) {
+        IrElem* elem = rule->prods->list[i]->elems->list[0];
+        if(elem->type == IR_RULE)
+            return elem;
+    }
+
+    return NULL;
+}
+
+/**
+ * @brief Return the rule of the loop over the infix operators of the level,
+ * or NULL if it has none.
+ *
+ * @param ir
+ * @param rule
+ * @return IrRule*
+ */
+IrRule* level_tail(IrGrammar* ir, IrRule* rule) {
+
+    IrElemVec* elems = rule->prods->list[0]->elems;
+    IrElem* elem     = elems->list[elems->len - 1];
+
+    return (elem->min == 0) ? ir->rules[elem->sym] : NULL;
+}
@@ -0,0 +1,34 @@
+/**
+ * @file precedence.h
+ *
+ * @brief Public interface to finding the cascades of operator rules in the
+ * IR, that the parser parses with precedence climbing.
+ *
+ * @author Chuck Tilbury (chucktilbury@gmail.com)
+ * @version 0.0
+ * @date 2024-08-26
+ * @copyright Copyright (c) 2024
+ *
+ */
+#ifndef _PRECEDENCE_H_
+#define _PRECEDENCE_H_
+
+#include "analysis.h"
+#include "ir.h"
+#include "ptr_lst.h"
+#include "vec.h"
+
+typedef struct {
+    // the rules of the levels, from the one that binds the loosest
+    IntVec* levels;
+    // the rule that the last level is made of
+    int operand;
+} Cascade;
+
+PtrLst* find_cascades(IrGrammar* ir, Analysis* an, const char* allowed);
+void destroy_cascades(PtrLst* cascades);
+
+IrElem* level_base(IrRule* rule);
+IrRule* level_tail(IrGrammar* ir, IrRule* rule);
+
+#endif /* _PRECEDENCE_H_ */
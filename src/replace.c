@@ -0,0 +1,352 @@
+/**
+ * @file replace.c
+ *
+ * @brief Replace every occurrence of a set of patterns in one pass. The
+ * patterns are built backwards into an Aho-Corasick automaton the first time
+ * that the table is used after a pattern was added. The text is read from
+ * the end to the start one time, with one table lookup for each byte no
+ * matter how many patterns there are, and that gives the longest pattern
+ * that starts at every place. Then the replacements are made from the start
+ * to the end. No byte is read again, so the time is linear in the length of
+ * the text.
+ *
+ * Where matches overlap, the one that starts first is replaced, and if more
+ * than one starts at the same place then the longest one is. The text after
+ * a replacement is not searched for a match that started inside of it.
+ *
+ * @author Chuck Tilbury (chucktilbury@gmail.com)
+ * @version 0.0
+ * @date 2024-08-20
+ * @copyright Copyright (c) 2024
+ *
+ */
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "memory.h"
+#include "ptr_lst.h"
+#include "replace.h"
+#include "str.h"
+
+typedef struct {
+    String* find;
+    String* repl;
+} _pattern_t_;
+
+struct _replace_table_ {
+    PtrLst* patterns;
+    // the automaton of the reversed patterns, or NULL if a pattern was
+    // added since it was built
+    int* next;  // next[state * 256 + byte]
+    int* match; // longest pattern that ends in the state, or -1
+    int num_states;
+};
+
+typedef void (*_sink_t_)(void* ptr, const void* bytes, size_t len);
+
+static void free_automaton(ReplaceTable* tab) {
+
+    _FREE(tab->next);
+    _FREE(tab->match);
+    tab->next       = NULL;
+    tab->match      = NULL;
+    tab->num_states = 0;
+}
+
+/*
+ * Make the trie of the reversed patterns and then turn it into a complete
+ * transition table with a breadth first walk, using the failure link of
+ * each state for the bytes that it does not have a transition for.
+ */
+static void build_automaton(ReplaceTable* tab) {
+
+    size_t cap = 1;
+    int mark   = 0;
+    _pattern_t_* pat;
+
+    while(NULL != (pat = iterate_ptr_lst(tab->patterns, &mark)))
+        cap += pat->find->length;
+
+    tab->next       = _ALLOC_DS_ARRAY(int, cap * 256);
+    tab->match      = _ALLOC_DS_ARRAY(int, cap);
+    tab->num_states = 1;
+    for(size_t i = 0; i < cap * 256; i++)
+        tab->next[i] = -1;
+    for(size_t i = 0; i < cap; i++)
+        tab->match[i] = -1;
+
+    for(size_t i = 0; i < tab->patterns->len; i++) {
+        pat       = tab->patterns->list[i];
+        int state = 0;
+        for(size_t j = pat->find->length; j > 0; j--) {
+            int* slot = &tab->next[state * 256 + pat->find->buffer[j - 1]];
+            if(*slot < 0)
+                *slot = tab->num_states++;
+            state = *slot;
+        }
+        tab->match[state] = (int)i;
+    }
+
+    int* fail  = _ALLOC_DS_ARRAY(int, tab->num_states);
+    int* queue = _ALLOC_DS_ARRAY(int, tab->num_states);
+    int head   = 0;
+    int tail   = 0;
+
+    for(int ch = 0; ch < 256; ch++) {
+        int* slot = &tab->next[ch];
+        if(*slot < 0)
+            *slot = 0;
+        else {
+            fail[*slot]   = 0;
+            queue[tail++] = *slot;
+        }
+    }
+
+    while(head < tail) {
+        int state = queue[head++];
+
+        // a state that does not end a pattern ends the longest one that
+        // ends in its failure state
+        if(tab->match[state] < 0)
+            tab->match[state] = tab->match[fail[state]];
+
+        for(int ch = 0; ch < 256; ch++) {
+            int* slot = &tab->next[state * 256 + ch];
+            int skip  = tab->next[fail[state] * 256 + ch];
+            if(*slot < 0)
+                *slot = skip;
+            else {
+                fail[*slot]   = skip;
+                queue[tail++] = *slot;
+            }
+        }
+    }
+
+    _FREE(fail);
+    _FREE(queue);
+}
+
+/*
+ * Run the text through the automaton backwards, which finds the longest
+ * pattern that starts at every place, and then send the text with the
+ * matches replaced to the sink. Returns the number of replacements.
+ */
+static int run(ReplaceTable* tab, const unsigned char* text, size_t len, _sink_t_ sink,
+               void* ptr) {
+
+    if(tab->next == NULL)
+        build_automaton(tab);
+
+    int* longest = _ALLOC_DS_ARRAY(int, len + 1);
+    int state    = 0;
+
+    for(size_t pos = len; pos > 0; pos--) {
+        state            = tab->next[state * 256 + text[pos - 1]];
+        longest[pos - 1] = tab->match[state];
+    }
+
+    int count   = 0;
+    size_t done = 0; // the text before this has been sent to the sink
+    size_t pos  = 0;
+
+    while(pos < len) {
+        if(longest[pos] < 0) {
+            pos++;
+            continue;
+        }
+
+        _pattern_t_* pat = tab->patterns->list[longest[pos]];
+        (*sink)(ptr, &text[done], pos - done);
+        (*sink)(ptr, pat->repl->buffer, pat->repl->length);
+        count++;
+
+        pos += pat->find->length;
+        done = pos;
+    }
+
+    (*sink)(ptr, &text[done], len - done);
+    _FREE(longest);
+
+    return count;
+}
+
+static void string_sink(void* ptr, const void* bytes, size_t len) {
+
+    if(len > 0)
+        append_buffer((String*)ptr, (void*)bytes, len);
+}
+
+static void file_sink(void* ptr, const void* bytes, size_t len) {
+
+    if(len > 0)
+        fwrite(bytes, 1, len, (FILE*)ptr);
+}
+
+/******************************************************************************
+ *
+ * Public Interface
+ *
+ */
+
+/**
+ * @brief Create an empty table of patterns.
+ *
+ * @return ReplaceTable*
+ */
+ReplaceTable* create_replace_table(void) {
+
+    ReplaceTable* tab = _ALLOC_DS(ReplaceTable);
+    tab->patterns     = create_ptr_lst();
+
+    return tab;
+}
+
+/**
+ * @brief Free the table.
+ *
+ * @param tab
+ */
+void destroy_replace_table(ReplaceTable* tab) {
+
+    if(tab != NULL) {
+        int mark = 0;
+        _pattern_t_* pat;
+        while(NULL != (pat = iterate_ptr_lst(tab->patterns, &mark))) {
+            destroy_string(pat->find);
+            destroy_string(pat->repl);
+            _FREE(pat);
+        }
+        destroy_ptr_lst(tab->patterns);
+        free_automaton(tab);
+        _FREE(tab);
+    }
+}
+
+/**
+ * @brief Add a pattern and its replacement. If the pattern is already in the
+ * table then its replacement is changed.
+ *
+ * @param tab
+ * @param find
+ * @param repl
+ */
+void add_replace_str(ReplaceTable* tab, const char* find, const char* repl) {
+
+    if(find[0] == '\0') {
+        fprintf(stderr, "Fatal internal error: cannot replace an empty pattern\n");
+        abort();
+    }
+
+    int mark = 0;
+    _pattern_t_* pat;
+    while(NULL != (pat = iterate_ptr_lst(tab->patterns, &mark))) {
+        if(!comp_string_str(pat->find, find)) {
+            destroy_string(pat->repl);
+            pat->repl = create_string(repl);
+            return;
+        }
+    }
+
+    pat       = _ALLOC_DS(_pattern_t_);
+    pat->find = create_string(find);
+    pat->repl = create_string(repl);
+    append_ptr_lst(tab->patterns, pat);
+    free_automaton(tab);
+}
+
+/**
+ * @brief Add a pattern that is replaced with the formatted string.
+ *
+ * @param tab
+ * @param find
+ * @param fmt
+ * @param ...
+ */
+void add_replace_fmt(ReplaceTable* tab, const char* find, const char* fmt, ...) {
+
+    va_list args;
+
+    va_start(args, fmt);
+    size_t len = vsnprintf(NULL, 0, fmt, args);
+    va_end(args);
+
+    char* b = _ALLOC(len + 1);
+    va_start(args, fmt);
+    vsprintf(b, fmt, args);
+    va_end(args);
+
+    add_replace_str(tab, find, b);
+    _FREE(b);
+}
+
+/**
+ * @brief Replace every pattern in the table that is in the string. Returns
+ * the number of replacements.
+ *
+ * @param ptr
+ * @param tab
+ * @return int
+ */
+int replace_string_table(String* ptr, ReplaceTable* tab) {
+
+    String* out = create_string(NULL);
+    int count   = run(tab, ptr->buffer, ptr->length, string_sink, out);
+
+    // keep the String, but give it the new text
+    unsigned char* tmp = ptr->buffer;
+    ptr->buffer        = out->buffer;
+    ptr->length        = out->length;
+    ptr->capacity      = out->capacity;
+    out->buffer        = tmp;
+    destroy_string(out);
+
+    return count;
+}
+
+/**
+ * @brief Write the text to the file with every pattern in the table
+ * replaced. Returns the number of replacements.
+ *
+ * @param fh
+ * @param tab
+ * @param text
+ * @param len
+ * @return int
+ */
+int write_replace_table(FILE* fh, ReplaceTable* tab, const char* text, size_t len) {
+
+    return run(tab, (const unsigned char*)text, len, file_sink, fh);
+}
+
+/******************************************************************************
+ * Test code.
+ *
+ */
+#ifdef TEST_REPLACE
+
+int main(void) {
+
+    ReplaceTable* tab = create_replace_table();
+    add_replace_str(tab, "$name", "value");
+    add_replace_str(tab, "$name_long", "long value");
+    add_replace_str(tab, "he", "HE");
+    add_replace_str(tab, "she", "SHE");
+    add_replace_fmt(tab, "hers", "<%d>", 4);
+
+    String* str = create_string("$name and $name_long, she said it was hers, then $nam");
+    int count   = replace_string_table(str, tab);
+    printf("%d: '%s'\n", count, raw_string(str));
+
+    const char* text = "ushers $name_lon";
+    count            = write_replace_table(stdout, tab, text, strlen(text));
+    printf("\n%d\n", count);
+
+    destroy_string(str);
+    destroy_replace_table(tab);
+
+    return 0;
+}
+
+#endif
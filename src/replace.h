@@ -0,0 +1,30 @@
+/**
+ * @file replace.h
+ *
+ * @brief Public interface to replacing many patterns in one pass over the
+ * text.
+ *
+ * @author Chuck Tilbury (chucktilbury@gmail.com)
+ * @version 0.0
+ * @date 2024-08-20
+ * @copyright Copyright (c) 2024
+ *
+ */
+#ifndef _REPLACE_H_
+#define _REPLACE_H_
+
+#include <stdio.h>
+
+#include "str.h"
+
+typedef struct _replace_table_ ReplaceTable;
+
+ReplaceTable* create_replace_table(void);
+void destroy_replace_table(ReplaceTable* tab);
+void add_replace_str(ReplaceTable* tab, const char* find, const char* repl);
+void add_replace_fmt(ReplaceTable* tab, const char* find, const char* fmt, ...);
+
+int replace_string_table(String* ptr, ReplaceTable* tab);
+int write_replace_table(FILE* fh, ReplaceTable* tab, const char* text, size_t len);
+
+#endif /* _REPLACE_H_ */
@@ -4,10 +4,16 @@
 #ifndef _SCAN_H_
 #define _SCAN_H_
 
+#include <stddef.h>
+#include <stdio.h>
+
 char* get_file_name(void);
 int get_line_no(void);
 int get_col_no(void);
 int open_file(const char* fname);
+int open_buffer(const char* fname, const char* text, size_t size);
+void clear_token_cache(void);
+void reset_scanner(void);
 
 /*
  * Defined by flex. Call one time to isolate a symbol and then use the global
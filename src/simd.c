@@ -0,0 +1,308 @@
+/**
+ * @file simd.c
+ *
+ * @brief Searching and case conversion for blocks of bytes. On x86 the SSE2
+ * versions are used when the compiler targets SSE2, and the AVX2 versions
+ * are used when the CPU that the program runs on has AVX2. Everywhere else,
+ * the plain C versions are used.
+ *
+ * The search compares the first and the last byte of the pattern against a
+ * whole vector of places in the text at once, and only the places where both
+ * of them match are compared in full.
+ *
+ * The case conversion only changes the ASCII letters, which is what
+ * tolower() and toupper() do in the "C" locale that this program runs in.
+ *
+ * @author Chuck Tilbury (chucktilbury@gmail.com)
+ * @version 0.0
+ * @date 2024-08-20
+ * @copyright Copyright (c) 2024
+ *
+ */
+#include <string.h>
+
+#include "simd.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__)) && defined(__SSE2__)
+#define USE_X86_SIMD
+#include <immintrin.h>
+#endif
+
+typedef size_t (*_search_func_t_)(const unsigned char*, size_t, const unsigned char*, size_t);
+typedef void (*_case_func_t_)(unsigned char*, size_t);
+
+/******************************************************************************
+ *
+ * Plain C versions
+ *
+ */
+static size_t search_c(const unsigned char* hay, size_t hlen, const unsigned char* needle,
+                       size_t nlen) {
+
+    if(nlen > hlen)
+        return SEARCH_NONE;
+
+    const unsigned char* ptr = hay;
+    const unsigned char* end = hay + (hlen - nlen) + 1;
+
+    // memchr() is already fast in the C library
+    while(ptr < end && NULL != (ptr = memchr(ptr, needle[0], end - ptr))) {
+        if(ptr[nlen - 1] == needle[nlen - 1] && !memcmp(ptr + 1, needle + 1, nlen - 1))
+            return ptr - hay;
+        ptr++;
+    }
+
+    return SEARCH_NONE;
+}
+
+static void lower_c(unsigned char* ptr, size_t len) {
+
+    for(size_t i = 0; i < len; i++)
+        if(ptr[i] >= 'A' && ptr[i] <= 'Z')
+            ptr[i] += 'a' - 'A';
+}
+
+static void upper_c(unsigned char* ptr, size_t len) {
+
+    for(size_t i = 0; i < len; i++)
+        if(ptr[i] >= 'a' && ptr[i] <= 'z')
+            ptr[i] -= 'a' - 'A';
+}
+
+#ifdef USE_X86_SIMD
+/******************************************************************************
+ *
+ * SSE2 versions
+ *
+ */
+
+/*
+ * Check every place in the text where the first and the last byte match.
+ * The places that are left at the end are checked with the plain version.
+ */
+static size_t search_sse2(const unsigned char* hay, size_t hlen, const unsigned char* needle,
+                          size_t nlen) {
+
+    const __m128i first = _mm_set1_epi8((char)needle[0]);
+    const __m128i last  = _mm_set1_epi8((char)needle[nlen - 1]);
+    size_t i            = 0;
+
+    for(; i + nlen - 1 + 16 <= hlen; i += 16) {
+        __m128i bf    = _mm_loadu_si128((const __m128i*)(hay + i));
+        __m128i bl    = _mm_loadu_si128((const __m128i*)(hay + i + nlen - 1));
+        unsigned mask = _mm_movemask_epi8(
+                _mm_and_si128(_mm_cmpeq_epi8(bf, first), _mm_cmpeq_epi8(bl, last)));
+
+        while(mask != 0) {
+            unsigned bit = __builtin_ctz(mask);
+            if(!memcmp(hay + i + bit + 1, needle + 1, nlen - 1))
+                return i + bit;
+            mask &= mask - 1;
+        }
+    }
+
+    size_t retv = search_c(hay + i, hlen - i, needle, nlen);
+    return (retv == SEARCH_NONE) ? retv : i + retv;
+}
+
+/*
+ * Move the range of letters to the bottom of the signed range, so that one
+ * signed compare finds all of them.
+ */
+static void case_sse2(unsigned char* ptr, size_t len, char low, int delta) {
+
+    const __m128i shift = _mm_set1_epi8((char)(-128 - low));
+    const __m128i limit = _mm_set1_epi8((char)(-128 + 26));
+    const __m128i diff  = _mm_set1_epi8((char)delta);
+    size_t i            = 0;
+
+    for(; i + 16 <= len; i += 16) {
+        __m128i v    = _mm_loadu_si128((const __m128i*)(ptr + i));
+        __m128i mask = _mm_cmplt_epi8(_mm_add_epi8(v, shift), limit);
+        v            = _mm_add_epi8(v, _mm_and_si128(mask, diff));
+        _mm_storeu_si128((__m128i*)(ptr + i), v);
+    }
+
+    if(delta > 0)
+        lower_c(ptr + i, len - i);
+    else
+        upper_c(ptr + i, len - i);
+}
+
+static void lower_sse2(unsigned char* ptr, size_t len) {
+
+    case_sse2(ptr, len, 'A', 'a' - 'A');
+}
+
+static void upper_sse2(unsigned char* ptr, size_t len) {
+
+    case_sse2(ptr, len, 'a', 'A' - 'a');
+}
+
+/******************************************************************************
+ *
+ * AVX2 versions
+ *
+ */
+__attribute__((target("avx2"))) static size_t search_avx2(const unsigned char* hay, size_t hlen,
+                                                          const unsigned char* needle,
+                                                          size_t nlen) {
+
+    const __m256i first = _mm256_set1_epi8((char)needle[0]);
+    const __m256i last  = _mm256_set1_epi8((char)needle[nlen - 1]);
+    size_t i            = 0;
+
+    for(; i + nlen - 1 + 32 <= hlen; i += 32) {
+        __m256i bf    = _mm256_loadu_si256((const __m256i*)(hay + i));
+        __m256i bl    = _mm256_loadu_si256((const __m256i*)(hay + i + nlen - 1));
+        unsigned mask = (unsigned)_mm256_movemask_epi8(
+                _mm256_and_si256(_mm256_cmpeq_epi8(bf, first), _mm256_cmpeq_epi8(bl, last)));
+
+        while(mask != 0) {
+            unsigned bit = __builtin_ctz(mask);
+            if(!memcmp(hay + i + bit + 1, needle + 1, nlen - 1))
+                return i + bit;
+            mask &= mask - 1;
+        }
+    }
+
+    size_t retv = search_sse2(hay + i, hlen - i, needle, nlen);
+    return (retv == SEARCH_NONE) ? retv : i + retv;
+}
+
+__attribute__((target("avx2"))) static void case_avx2(unsigned char* ptr, size_t len,
+                                                      char low, int delta) {
+
+    const __m256i shift = _mm256_set1_epi8((char)(-128 - low));
+    const __m256i limit = _mm256_set1_epi8((char)(-128 + 26));
+    const __m256i diff  = _mm256_set1_epi8((char)delta);
+    size_t i            = 0;
+
+    for(; i + 32 <= len; i += 32) {
+        __m256i v    = _mm256_loadu_si256((const __m256i*)(ptr + i));
+        __m256i mask = _mm256_cmpgt_epi8(limit, _mm256_add_epi8(v, shift));
+        v            = _mm256_add_epi8(v, _mm256_and_si256(mask, diff));
+        _mm256_storeu_si256((__m256i*)(ptr + i), v);
+    }
+
+    case_sse2(ptr + i, len - i, low, delta);
+}
+
+static void lower_avx2(unsigned char* ptr, size_t len) {
+
+    case_avx2(ptr, len, 'A', 'a' - 'A');
+}
+
+static void upper_avx2(unsigned char* ptr, size_t len) {
+
+    case_avx2(ptr, len, 'a', 'A' - 'a');
+}
+
+static int have_avx2(void) {
+
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("avx2");
+}
+#endif /* USE_X86_SIMD */
+
+/******************************************************************************
+ *
+ * Dispatch. Each pointer starts at a function that picks the version, saves
+ * it in the pointer and then calls it.
+ *
+ */
+static size_t search_init(const unsigned char*, size_t, const unsigned char*, size_t);
+static void lower_init(unsigned char*, size_t);
+static void upper_init(unsigned char*, size_t);
+
+static _search_func_t_ search_impl = search_init;
+static _case_func_t_ lower_impl    = lower_init;
+static _case_func_t_ upper_impl    = upper_init;
+
+static void pick_impl(void) {
+
+#ifdef USE_X86_SIMD
+    if(have_avx2()) {
+        search_impl = search_avx2;
+        lower_impl  = lower_avx2;
+        upper_impl  = upper_avx2;
+    }
+    else {
+        search_impl = search_sse2;
+        lower_impl  = lower_sse2;
+        upper_impl  = upper_sse2;
+    }
+#else
+    search_impl = search_c;
+    lower_impl  = lower_c;
+    upper_impl  = upper_c;
+#endif
+}
+
+static size_t search_init(const unsigned char* hay, size_t hlen, const unsigned char* needle,
+                          size_t nlen) {
+
+    pick_impl();
+    return (*search_impl)(hay, hlen, needle, nlen);
+}
+
+static void lower_init(unsigned char* ptr, size_t len) {
+
+    pick_impl();
+    (*lower_impl)(ptr, len);
+}
+
+static void upper_init(unsigned char* ptr, size_t len) {
+
+    pick_impl();
+    (*upper_impl)(ptr, len);
+}
+
+/******************************************************************************
+ *
+ * Public Interface
+ *
+ */
+
+/**
+ * @brief Return the index of the first place in the text where the pattern
+ * is, or SEARCH_NONE. An empty pattern is found at the start.
+ *
+ * @param hay
+ * @param hlen
+ * @param needle
+ * @param nlen
+ * @return size_t
+ */
+size_t search_bytes(const unsigned char* hay, size_t hlen, const unsigned char* needle,
+                    size_t nlen) {
+
+    if(nlen == 0)
+        return 0;
+    if(nlen > hlen)
+        return SEARCH_NONE;
+
+    return (*search_impl)(hay, hlen, needle, nlen);
+}
+
+/**
+ * @brief Convert the ASCII letters to lower case.
+ *
+ * @param ptr
+ * @param len
+ */
+void lower_bytes(unsigned char* ptr, size_t len) {
+
+    (*lower_impl)(ptr, len);
+}
+
+/**
+ * @brief Convert the ASCII letters to upper case.
+ *
+ * @param ptr
+ * @param len
+ */
+void upper_bytes(unsigned char* ptr, size_t len) {
+
+    (*upper_impl)(ptr, len);
+}
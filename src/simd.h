@@ -0,0 +1,27 @@
+/**
+ * @file simd.h
+ *
+ * @brief Byte kernels that the buffers and strings are built on. Each one
+ * has a plain C version and, where the CPU has them, versions that use the
+ * vector instructions. The version is picked the first time it is called.
+ *
+ * @author Chuck Tilbury (chucktilbury@gmail.com)
+ * @version 0.0
+ * @date 2024-08-20
+ * @copyright Copyright (c) 2024
+ *
+ */
+#ifndef _SIMD_H_
+#define _SIMD_H_
+
+#include <stddef.h>
+
+// returned by search_bytes() when there is no match
+#define SEARCH_NONE ((size_t)-1)
+
+size_t search_bytes(const unsigned char* hay, size_t hlen, const unsigned char* needle,
+                    size_t nlen);
+void lower_bytes(unsigned char* ptr, size_t len);
+void upper_bytes(unsigned char* ptr, size_t len);
+
+#endif /* _SIMD_H_ */
@@ -10,15 +10,20 @@
  * @copyright Copyright (c) 2024
  *
  */
-#include <ctype.h>
 #include <stdarg.h>
 #include <stdio.h>
 #include <string.h>
 
 #include "buffer.h"
 #include "memory.h"
+#include "simd.h"
 #include "str.h"
 
+static inline int is_mark(const char* mark, char ch) {
+
+    return ch != '\0' && strchr(mark, ch) != NULL;
+}
+
 /**
  * @brief Create a string object. Allocate memory for a dynamic string.
  *
@@ -33,6 +38,30 @@ String* create_string(const char* str) {
         return create_buffer(NULL, 0);
 }
 
+/**
+ * @brief Create a string that holds the whole content of a file. Returns
+ * NULL if the file cannot be read.
+ *
+ * @param fname
+ * @return String*
+ */
+String* create_string_file(const char* fname) {
+
+    FILE* fp = fopen(fname, "rb");
+    if(fp == NULL)
+        return NULL;
+
+    String* str = create_buffer(NULL, 0);
+    char tmp[4096];
+    size_t len;
+
+    while(0 < (len = fread(tmp, 1, sizeof(tmp), fp)))
+        append_buffer(str, tmp, len);
+    fclose(fp);
+
+    return str;
+}
+
 /**
  * @brief Free all of the memory for a dynamic string.
  *
@@ -247,8 +276,7 @@ String* copy_string(String* str) {
  */
 void lower_string(String* str) {
 
-    for(size_t i = 0; i < str->length; i++)
-        str->buffer[i] = tolower(str->buffer[i]);
+    lower_bytes(str->buffer, str->length);
 }
 
 /**
@@ -258,8 +286,7 @@ void lower_string(String* str) {
  */
 void upper_string(String* str) {
 
-    for(size_t i = 0; i < str->length; i++)
-        str->buffer[i] = toupper(str->buffer[i]);
+    upper_bytes(str->buffer, str->length);
 }
 
 /**
@@ -312,32 +339,162 @@ int iterate_string(String* str, int* post) {
 
 /**
  * @brief Return successive tokens from the string, similar to strtok(). On
- * the first call, post must point to 0. That resets strtok so that it begins
- * in the string. This function allocates a buffer to operate on so that the
- * original string does not need to be writable. Uses strtok() to tokenize
- * the string.
+ * the first call, post must point to 0. The token is a slice of the string,
+ * so the string must not be changed until the tokens are not needed any
+ * more. When there are no more tokens, the ptr of the slice is NULL.
  *
  * @param str
  * @param post
  * @param mark
- * @return const char*
+ * @return StrSlice
  */
-const char* tokenize_string(String* str, int* post, const char* mark) {
+StrSlice tokenize_string(String* str, int* post, const char* mark) {
 
-    static const char* ptr = NULL;
-    const char* retv;
+    return tokenize_slice(slice_string(str, 0, str->length), post, mark);
+}
 
-    if(*post == 0) {
-        if(ptr != NULL)
-            _FREE(ptr);
-        ptr   = _DUP_STR((const char*)str->buffer);
-        *post = 1;
-        retv  = strtok((char*)ptr, mark);
+/**
+ * @brief Return a slice of the string from the start index up to, but not
+ * including, the end index. The indexes are clamped to the string.
+ *
+ * @param str
+ * @param start
+ * @param end
+ * @return StrSlice
+ */
+StrSlice slice_string(String* str, int start, int end) {
+
+    StrSlice slice;
+    size_t first = (start < 0) ? 0 : (size_t)start;
+    size_t last  = (end < 0) ? 0 : (size_t)end;
+
+    first = (first > str->length) ? str->length : first;
+    last  = (last > str->length) ? str->length : last;
+
+    slice.ptr = (const char*)&str->buffer[first];
+    slice.len = (last > first) ? last - first : 0;
+
+    return slice;
+}
+
+/**
+ * @brief Return successive tokens from the slice. The tokens are separated by
+ * one or more of the characters in mark. On the first call, post must point
+ * to 0. All of the state is in post, so more than one slice can be
+ * tokenized at the same time.
+ *
+ * @param slice
+ * @param post
+ * @param mark
+ * @return StrSlice
+ */
+StrSlice tokenize_slice(StrSlice slice, int* post, const char* mark) {
+
+    StrSlice tok = { NULL, 0 };
+    size_t pos   = (size_t)*post;
+
+    while(pos < slice.len && is_mark(mark, slice.ptr[pos]))
+        pos++;
+
+    if(pos < slice.len) {
+        size_t start = pos;
+        while(pos < slice.len && !is_mark(mark, slice.ptr[pos]))
+            pos++;
+        tok.ptr = &slice.ptr[start];
+        tok.len = pos - start;
     }
-    else
-        retv = strtok(NULL, mark);
 
-    return retv;
+    *post = (int)pos;
+    return tok;
+}
+
+/**
+ * @brief Create a string that holds a copy of the slice.
+ *
+ * @param slice
+ * @return String*
+ */
+String* create_string_slice(StrSlice slice) {
+
+    return create_buffer((void*)slice.ptr, slice.len);
+}
+
+/**
+ * @brief Split the string at the characters in mark. The pieces are counted
+ * first, and then the list of slices and a copy of the text are made in one
+ * allocation. The slices point into the copy, where every piece ends with a
+ * zero, so the string can be changed or freed after this. The result is
+ * freed with destroy_str_split().
+ *
+ * @param str
+ * @param mark
+ * @return StrSplit*
+ */
+StrSplit* split_slices(String* str, const char* mark) {
+
+    StrSlice all = slice_string(str, 0, str->length);
+    size_t count = 0;
+    int post     = 0;
+
+    while(NULL != tokenize_slice(all, &post, mark).ptr)
+        count++;
+
+    StrSplit* split = _ALLOC(sizeof(StrSplit) + count * sizeof(StrSlice) + all.len + 1);
+    split->list     = (StrSlice*)(split + 1);
+    char* text      = (char*)(split->list + count);
+    StrSlice tok;
+
+    memcpy(text, all.ptr, all.len);
+    post = 0;
+    while(NULL != (tok = tokenize_slice(all, &post, mark)).ptr) {
+        size_t start = tok.ptr - all.ptr;
+        text[start + tok.len] = '\0';
+        split->list[split->len].ptr = &text[start];
+        split->list[split->len].len = tok.len;
+        split->len++;
+    }
+
+    return split;
+}
+
+/**
+ * @brief Free the result of split_slices().
+ *
+ * @param split
+ */
+void destroy_str_split(StrSplit* split) {
+
+    _FREE(split);
+}
+
+/**
+ * @brief Add the text of the slice to the end of the string.
+ *
+ * @param ptr
+ * @param slice
+ */
+void append_string_slice(String* ptr, StrSlice slice) {
+
+    append_buffer(ptr, (void*)slice.ptr, slice.len);
+}
+
+/**
+ * @brief Compare the String to the slice and return what strcmp() would
+ * find.
+ *
+ * @param ptr
+ * @param slice
+ * @return int
+ */
+int comp_string_slice(String* ptr, StrSlice slice) {
+
+    size_t len = (ptr->length < slice.len) ? ptr->length : slice.len;
+    int retv   = memcmp(ptr->buffer, slice.ptr, len);
+
+    if(retv != 0)
+        return retv;
+
+    return (ptr->length > slice.len) - (ptr->length < slice.len);
 }
 
 /**
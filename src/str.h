@@ -16,7 +16,26 @@
 
 typedef Buffer String;
 
+/*
+ * A slice is a view of part of a string. It does not own the text and it is
+ * not terminated with a zero.
+ */
+typedef struct {
+    const char* ptr;
+    size_t len;
+} StrSlice;
+
+/*
+ * The pieces of a string that split_slices() found. Every piece is also
+ * terminated with a zero.
+ */
+typedef struct {
+    StrSlice* list;
+    size_t len;
+} StrSplit;
+
 String* create_string(const char* str);
+String* create_string_file(const char* fname);
 void destroy_string(String* str);
 void append_string_str(String* ptr, const char* str);
 void append_string_string(String* ptr, String* str);
@@ -39,7 +58,15 @@ String* copy_string(String* str);
 const char* raw_string(String* str);
 const char* clip_string(String* str, int start, int end);
 int iterate_string(String* str, int* post);
-const char* tokenize_string(String* str, int* post, const char* mark);
+StrSlice tokenize_string(String* str, int* post, const char* mark);
+
+StrSlice slice_string(String* str, int start, int end);
+StrSlice tokenize_slice(StrSlice slice, int* post, const char* mark);
+String* create_string_slice(StrSlice slice);
+void append_string_slice(String* ptr, StrSlice slice);
+int comp_string_slice(String* ptr, StrSlice slice);
+StrSplit* split_slices(String* str, const char* mark);
+void destroy_str_split(StrSplit* split);
 
 int search_string(String* str, const char* srch);
 int comp_string_str(String* ptr, const char* str);
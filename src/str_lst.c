@@ -4,6 +4,8 @@
  * Simple wrappers for the ptr_lst functions so that types are cast in a
  * sensible way.
  */
+#include <string.h>
+
 #include "str_lst.h"
 
 /**
@@ -164,7 +166,7 @@ void sort_str_lst(StrLst* lst) {
 
     while(flag > 0) {
         flag = 0;
-        for(size_t i = 0; i < lst->len - 1; i++) {
+        for(size_t i = 0; i + 1 < lst->len; i++) {
             if(comp_string_string(lst->list[i], lst->list[i + 1]) > 0) {
                 String* tmp      = lst->list[i];
                 lst->list[i]     = lst->list[i + 1];
@@ -176,28 +178,8 @@ void sort_str_lst(StrLst* lst) {
 }
 
 /**
- * @brief Split the string into an array of char* where the character is
- * locatied.
- *
- * @param str
- * @param mark
- * @return StrLst*
- */
-StrLst* split_string(String* str, const char* mark) {
-
-    int post    = 0;
-    StrLst* lst = create_str_lst();
-    const char* tmp;
-
-    while(NULL != (tmp = tokenize_string(str, &post, mark))) {
-        append_str_lst(lst, create_string(tmp));
-    }
-
-    return lst;
-}
-
-/**
- * @brief Join an array of strings where the given str is between them.
+ * @brief Join an array of strings where the given str is between them. The
+ * size of the result is found first so that it is only allocated one time.
  *
  * @param lst
  * @param str
@@ -205,16 +187,19 @@ StrLst* split_string(String* str, const char* mark) {
  */
 String* join_string(StrLst* lst, const char* str) {
 
-    int post  = 0;
+    size_t slen = strlen(str);
+    size_t size = (lst->len > 0) ? slen * (lst->len - 1) : 0;
+
+    for(size_t i = 0; i < lst->len; i++)
+        size += ((String*)lst->list[i])->length;
+
     String* s = create_string(NULL);
-    String* tmp;
-
-    tmp = iterate_str_lst(lst, &post);
-    while(tmp != NULL) {
-        append_string_string(s, tmp);
-        tmp = iterate_str_lst(lst, &post);
-        if(tmp != NULL)
-            append_string_str(s, str);
+    reserve_buffer(s, size);
+
+    for(size_t i = 0; i < lst->len; i++) {
+        if(i > 0)
+            append_buffer(s, (void*)str, slen);
+        append_string_string(s, lst->list[i]);
     }
 
     return s;
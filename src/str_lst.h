@@ -23,7 +23,6 @@ String* iterate_str_lst(StrLst* lst, int* post);
 int search_str_lst(StrLst* lst, const char* str);
 void sort_str_lst(StrLst* lst);
 
-StrLst* split_string(String* str, const char* mark);
 String* join_string(StrLst* lst, const char* str);
 
 #endif /* _STR_LST_H_ */
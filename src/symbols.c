@@ -0,0 +1,179 @@
+/**
+ * @file symbols.c
+ *
+ * @brief Build the symbol table for the grammar after it has been read. The
+ * terminals are numbered in the order of the sorted list of terminals and the
+ * rules are numbered in the order that they appear in the grammar, so the
+ * first rule is always number zero. Every non-terminal in a production is
+ * linked to the rule that defines it.
+ *
+ * A rule that is defined more than once and a non-terminal that names a rule
+ * that is not defined are errors.
+ *
+ * @author Chuck Tilbury (chucktilbury@gmail.com)
+ * @version 0.0
+ * @date 2024-08-16
+ * @copyright Copyright (c) 2024
+ *
+ */
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "ast.h"
+#include "hash.h"
+#include "memory.h"
+#include "str.h"
+#include "str_lst.h"
+#include "symbols.h"
+
+extern AstNode* root_node;
+extern StrLst* terms;
+
+static SymbolTable* table   = NULL;
+static ast_rule_t* crnt_rule = NULL;
+static int errors           = 0;
+
+static int find_id(HashTable* tab, const char* name) {
+
+    int id;
+
+    if(find_hashtable(tab, name, &id, sizeof(id)) != HASH_OK)
+        return -1;
+
+    return id;
+}
+
+static int resolve_pre(AstNode* node) {
+
+    if(node->type == AST_TERMINAL) {
+        ast_terminal_t* term = (ast_terminal_t*)node;
+        term->id             = find_id(table->term_ids, raw_string(term->tok));
+    }
+    else if(node->type == AST_NON_TERMINAL) {
+        ast_non_terminal_t* nterm = (ast_non_terminal_t*)node;
+        nterm->id                 = find_id(table->rule_ids, raw_string(nterm->tok));
+        if(nterm->id < 0) {
+            fprintf(stderr, "error: rule '%s' refers to '%s', which is not defined\n",
+                    raw_string(crnt_rule->name), raw_string(nterm->tok));
+            nterm->rule = NULL;
+            errors++;
+        }
+        else
+            nterm->rule = table->rules[nterm->id];
+    }
+
+    return 0;
+}
+
+/******************************************************************************
+ *
+ * Public Interface
+ *
+ */
+
+/**
+ * @brief Number the symbols of the grammar that was loaded and link each
+ * non-terminal to its rule. The table is kept in the grammar node. Returns
+ * the number of errors.
+ *
+ * @return int
+ */
+int resolve_symbols(void) {
+
+    ast_grammar_t* grammar = (ast_grammar_t*)root_node;
+
+    destroy_symbols(grammar->symbols);
+    table            = _ALLOC_DS(SymbolTable);
+    table->term_ids  = create_hashtable();
+    table->rule_ids  = create_hashtable();
+    table->terms     = _ALLOC_DS_ARRAY(String*, terms->len + 1);
+    table->rules     = _ALLOC_DS_ARRAY(ast_rule_t*, grammar->list->len + 1);
+    grammar->symbols = table;
+    errors           = 0;
+
+    int mark = 0;
+    String* str;
+    while(NULL != (str = iterate_str_lst(terms, &mark))) {
+        int id = table->num_terms;
+        if(insert_hashtable(table->term_ids, raw_string(str), &id, sizeof(id)) == HASH_OK)
+            table->terms[table->num_terms++] = str;
+    }
+
+    mark = 0;
+    ast_rule_t* rule;
+    while(NULL != (rule = iterate_ptr_lst(grammar->list, &mark))) {
+        int id = table->num_rules;
+        if(insert_hashtable(table->rule_ids, raw_string(rule->name), &id, sizeof(id)) ==
+           HASH_OK) {
+            rule->id                         = id;
+            table->rules[table->num_rules++] = rule;
+        }
+        else {
+            fprintf(stderr, "error: rule '%s' is defined more than once\n",
+                    raw_string(rule->name));
+            rule->id = -1;
+            errors++;
+        }
+    }
+
+    mark = 0;
+    while(NULL != (crnt_rule = iterate_ptr_lst(grammar->list, &mark)))
+        ast_rule(crnt_rule, resolve_pre, NULL);
+
+    table     = NULL;
+    crnt_rule = NULL;
+
+    return errors;
+}
+
+/**
+ * @brief Free a symbol table. The symbols themselves belong to the AST.
+ *
+ * @param tab
+ */
+void destroy_symbols(SymbolTable* tab) {
+
+    if(tab != NULL) {
+        destroy_hashtable(tab->term_ids);
+        destroy_hashtable(tab->rule_ids);
+        _FREE(tab->terms);
+        _FREE(tab->rules);
+        _FREE(tab);
+    }
+}
+
+/**
+ * @brief Return the symbol table of the grammar that was loaded, or NULL if
+ * it has not been resolved.
+ *
+ * @return SymbolTable*
+ */
+SymbolTable* get_symbols(void) {
+
+    return (root_node != NULL) ? ((ast_grammar_t*)root_node)->symbols : NULL;
+}
+
+/**
+ * @brief Return the number of the terminal or -1 if there is no such
+ * terminal.
+ *
+ * @param tab
+ * @param tok
+ * @return int
+ */
+int find_term_id(SymbolTable* tab, const char* tok) {
+
+    return find_id(tab->term_ids, tok);
+}
+
+/**
+ * @brief Return the number of the rule or -1 if there is no such rule.
+ *
+ * @param tab
+ * @param name
+ * @return int
+ */
+int find_rule_id(SymbolTable* tab, const char* name) {
+
+    return find_id(tab->rule_ids, name);
+}
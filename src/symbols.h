@@ -0,0 +1,39 @@
+/**
+ * @file symbols.h
+ *
+ * @brief Public interface to the symbol table. Every terminal and every rule
+ * in the grammar has a dense number so that the passes can use arrays and
+ * bit sets instead of looking symbols up by name.
+ *
+ * @author Chuck Tilbury (chucktilbury@gmail.com)
+ * @version 0.0
+ * @date 2024-08-16
+ * @copyright Copyright (c) 2024
+ *
+ */
+#ifndef _SYMBOLS_H_
+#define _SYMBOLS_H_
+
+#include "ast.h"
+#include "hash.h"
+#include "str.h"
+
+typedef struct _symbol_table_ {
+    int num_terms;
+    int num_rules;
+    // the token of each terminal, by number
+    String** terms;
+    // the definition of each rule, by number
+    ast_rule_t** rules;
+    HashTable* term_ids;
+    HashTable* rule_ids;
+} SymbolTable;
+
+int resolve_symbols(void);
+void destroy_symbols(SymbolTable* tab);
+SymbolTable* get_symbols(void);
+
+int find_term_id(SymbolTable* tab, const char* tok);
+int find_rule_id(SymbolTable* tab, const char* name);
+
+#endif /* _SYMBOLS_H_ */
@@ -0,0 +1,473 @@
+/**
+ * @file template.c
+ *
+ * @brief Templates for the generated files. The text of a template is
+ * compiled into a list of operations that either copy a span of the text or
+ * insert a value, so rendering it is only copying.
+ *
+ *   {{name}}              insert the value of name
+ *   {{#if name}}          the text up to {{else}} or {{/if}} is used if name
+ *   {{else}}              has a value that is not empty or is a list that has
+ *   {{/if}}               items in it, otherwise the text after {{else}}
+ *   {{#each name}}        the text up to {{/each}} is used one time for every
+ *   {{/each}}             item in the list called name
+ *
+ * Inside of an {{#each}}, a name is looked up in the item first and then in
+ * the data that holds the list. A line that holds nothing but an {{#if}},
+ * {{else}}, {{/if}}, {{#each}} or {{/each}} is left out of the output, so the
+ * templates can be laid out like the code that they make.
+ *
+ * The templates are part of the program, so an error in one is a fatal
+ * internal error.
+ *
+ * @author Chuck Tilbury (chucktilbury@gmail.com)
+ * @version 0.0
+ * @date 2024-08-19
+ * @copyright Copyright (c) 2024
+ *
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "hash.h"
+#include "memory.h"
+#include "ptr_lst.h"
+#include "str.h"
+#include "template.h"
+
+typedef enum {
+    TPL_TEXT,
+    TPL_VALUE,
+    TPL_IF,
+    TPL_ELSE,
+    TPL_EACH,
+    TPL_END,
+} TplOpType;
+
+typedef struct {
+    TplOpType type;
+    // the span of the template text for TPL_TEXT
+    size_t offset;
+    size_t length;
+    // the name of the value, for TPL_VALUE, TPL_IF and TPL_EACH
+    String* name;
+    // for TPL_IF the {{else}} or the end, for the others the end
+    int jump;
+} _tpl_op_t_;
+
+struct _template_ {
+    String* name;
+    String* text;
+    _tpl_op_t_* ops;
+    int len;
+    int cap;
+};
+
+typedef struct {
+    String* str;
+    // list of TplData*, or NULL if it is a string
+    PtrLst* items;
+} _tpl_value_t_;
+
+struct _tpl_data_ {
+    TplData* parent;
+    // name -> index in the values
+    HashTable* names;
+    PtrLst* values;
+};
+
+static void tpl_error(Template* tpl, size_t offset, const char* msg) {
+
+    const char* text = raw_string(tpl->text);
+    int line         = 1;
+
+    for(size_t i = 0; i < offset; i++)
+        if(text[i] == '\n')
+            line++;
+
+    fprintf(stderr, "Fatal internal error: template '%s' line %d: %s\n", raw_string(tpl->name),
+            line, msg);
+    abort();
+}
+
+static _tpl_op_t_* add_op(Template* tpl, TplOpType type) {
+
+    if(tpl->len >= tpl->cap) {
+        tpl->cap <<= 1;
+        tpl->ops = _REALLOC_DS_ARRAY(tpl->ops, _tpl_op_t_, tpl->cap);
+    }
+
+    _tpl_op_t_* op = &tpl->ops[tpl->len++];
+    memset(op, 0, sizeof(_tpl_op_t_));
+    op->type = type;
+    op->jump = -1;
+
+    return op;
+}
+
+static void add_text(Template* tpl, size_t offset, size_t length) {
+
+    if(length > 0) {
+        _tpl_op_t_* op = add_op(tpl, TPL_TEXT);
+        op->offset     = offset;
+        op->length     = length;
+    }
+}
+
+/*
+ * A section tag that is alone on its line takes the whole line with it. The
+ * text before it on the line is removed from the last text op and the end is
+ * moved past the newline.
+ */
+static size_t standalone(Template* tpl, size_t start, size_t end) {
+
+    const char* text = raw_string(tpl->text);
+    size_t line      = start;
+
+    while(line > 0 && (text[line - 1] == ' ' || text[line - 1] == '\t'))
+        line--;
+    if(line > 0 && text[line - 1] != '\n')
+        return end;
+
+    size_t next = end;
+    while(text[next] == ' ' || text[next] == '\t')
+        next++;
+    if(text[next] == '\n')
+        next++;
+    else if(text[next] != '\0')
+        return end;
+
+    _tpl_op_t_* last = (tpl->len > 0) ? &tpl->ops[tpl->len - 1] : NULL;
+    if(last != NULL && last->type == TPL_TEXT && last->offset + last->length == start) {
+        last->length -= start - line;
+        if(last->length == 0)
+            tpl->len--;
+    }
+
+    return next;
+}
+
+static int is_word(const char* tag, size_t len, const char* word) {
+
+    return len == strlen(word) && !strncmp(tag, word, len);
+}
+
+static void compile(Template* tpl) {
+
+    const char* text = raw_string(tpl->text);
+    // index of the ops that are waiting for their end
+    int* stack = _ALLOC_DS_ARRAY(int, tpl->text->length + 1);
+    int depth  = 0;
+    size_t pos = 0;
+
+    while(text[pos] != '\0') {
+        const char* open = strstr(&text[pos], "{{");
+        if(open == NULL) {
+            add_text(tpl, pos, strlen(&text[pos]));
+            break;
+        }
+
+        size_t start = open - text;
+        add_text(tpl, pos, start - pos);
+
+        const char* close = strstr(open, "}}");
+        if(close == NULL)
+            tpl_error(tpl, start, "tag is not closed");
+
+        // the content of the tag with the spaces trimmed
+        const char* tag  = open + 2;
+        const char* tend = close;
+        while(tag < tend && *tag == ' ')
+            tag++;
+        while(tend > tag && tend[-1] == ' ')
+            tend--;
+
+        size_t end      = (close - text) + 2;
+        const char* arg = memchr(tag, ' ', tend - tag);
+        size_t wlen     = (arg != NULL) ? (size_t)(arg - tag) : (size_t)(tend - tag);
+        while(arg != NULL && *arg == ' ')
+            arg++;
+
+        if(tag == tend)
+            tpl_error(tpl, start, "empty tag");
+        else if(*tag != '#' && *tag != '/' && !is_word(tag, wlen, "else")) {
+            _tpl_op_t_* op = add_op(tpl, TPL_VALUE);
+            op->name       = create_buffer((void*)tag, tend - tag);
+        }
+        else if(is_word(tag, wlen, "#if") || is_word(tag, wlen, "#each")) {
+            if(arg == NULL)
+                tpl_error(tpl, start, "section has no name");
+            end            = standalone(tpl, start, end);
+            _tpl_op_t_* op = add_op(tpl, (tag[1] == 'i') ? TPL_IF : TPL_EACH);
+            op->name       = create_buffer((void*)arg, tend - arg);
+            stack[depth++] = tpl->len - 1;
+        }
+        else if(is_word(tag, wlen, "else")) {
+            if(depth == 0 || tpl->ops[stack[depth - 1]].type != TPL_IF ||
+               tpl->ops[stack[depth - 1]].jump >= 0)
+                tpl_error(tpl, start, "{{else}} is not in an {{#if}}");
+            end = standalone(tpl, start, end);
+            add_op(tpl, TPL_ELSE);
+            tpl->ops[stack[depth - 1]].jump = tpl->len - 1;
+        }
+        else if(is_word(tag, wlen, "/if") || is_word(tag, wlen, "/each")) {
+            TplOpType type = (tag[1] == 'i') ? TPL_IF : TPL_EACH;
+            if(depth == 0 || tpl->ops[stack[depth - 1]].type != type)
+                tpl_error(tpl, start, "section end does not match");
+            end = standalone(tpl, start, end);
+            add_op(tpl, TPL_END);
+
+            int idx = stack[--depth];
+            if(tpl->ops[idx].jump >= 0)
+                tpl->ops[tpl->ops[idx].jump].jump = tpl->len - 1;
+            else
+                tpl->ops[idx].jump = tpl->len - 1;
+        }
+        else
+            tpl_error(tpl, start, "unknown section");
+
+        pos = end;
+    }
+
+    if(depth != 0)
+        tpl_error(tpl, tpl->text->length, "section is not closed");
+
+    _FREE(stack);
+}
+
+static _tpl_value_t_* find_value(TplData* data, const char* name) {
+
+    int idx;
+
+    for(; data != NULL; data = data->parent)
+        if(find_hashtable(data->names, name, &idx, sizeof(idx)) == HASH_OK)
+            return data->values->list[idx];
+
+    return NULL;
+}
+
+static int is_true(_tpl_value_t_* val) {
+
+    return (val == NULL)       ? 0 :
+           (val->items != NULL) ? val->items->len > 0 :
+                                  val->str->length > 0;
+}
+
+static void render(Template* tpl, int first, int last, TplData* data, String* out) {
+
+    const char* text = raw_string(tpl->text);
+
+    for(int i = first; i < last; i++) {
+        _tpl_op_t_* op = &tpl->ops[i];
+        _tpl_value_t_* val =
+                (op->name != NULL) ? find_value(data, raw_string(op->name)) : NULL;
+
+        switch(op->type) {
+            case TPL_TEXT:
+                append_buffer(out, (void*)&text[op->offset], op->length);
+                break;
+            case TPL_VALUE:
+                if(val == NULL || val->items != NULL) {
+                    fprintf(stderr, "Fatal internal error: template '%s' has no string called '%s'\n",
+                            raw_string(tpl->name), raw_string(op->name));
+                    abort();
+                }
+                append_string_string(out, val->str);
+                break;
+            case TPL_IF: {
+                    _tpl_op_t_* jump = &tpl->ops[op->jump];
+                    int end          = (jump->type == TPL_ELSE) ? jump->jump : op->jump;
+                    if(is_true(val))
+                        render(tpl, i + 1, op->jump, data, out);
+                    else if(jump->type == TPL_ELSE)
+                        render(tpl, op->jump + 1, end, data, out);
+                    i = end;
+                }
+                break;
+            case TPL_EACH:
+                if(val != NULL && val->items != NULL) {
+                    int mark = 0;
+                    TplData* item;
+                    while(NULL != (item = iterate_ptr_lst(val->items, &mark)))
+                        render(tpl, i + 1, op->jump, item, out);
+                }
+                i = op->jump;
+                break;
+            default:
+                fprintf(stderr, "Fatal internal error: invalid state in %s: %d\n", __func__,
+                        op->type);
+                abort();
+        }
+    }
+}
+
+static _tpl_value_t_* get_value(TplData* data, const char* name) {
+
+    int idx;
+
+    if(find_hashtable(data->names, name, &idx, sizeof(idx)) == HASH_OK)
+        return data->values->list[idx];
+
+    _tpl_value_t_* val = _ALLOC_DS(_tpl_value_t_);
+    idx                = data->values->len;
+    append_ptr_lst(data->values, val);
+    insert_hashtable(data->names, name, &idx, sizeof(idx));
+
+    return val;
+}
+
+static void clear_value(_tpl_value_t_* val) {
+
+    if(val->items != NULL) {
+        int mark = 0;
+        TplData* item;
+        while(NULL != (item = iterate_ptr_lst(val->items, &mark)))
+            destroy_tpl_data(item);
+        destroy_ptr_lst(val->items);
+        val->items = NULL;
+    }
+    destroy_string(val->str);
+    val->str = NULL;
+}
+
+/******************************************************************************
+ *
+ * Public Interface
+ *
+ */
+
+/**
+ * @brief Compile the text of a template. The name is used in messages.
+ *
+ * @param name
+ * @param text
+ * @return Template*
+ */
+Template* create_template(const char* name, const char* text) {
+
+    Template* tpl = _ALLOC_DS(Template);
+    tpl->name     = create_string(name);
+    tpl->text     = create_string(text);
+    tpl->cap      = 1 << 4;
+    tpl->ops      = _ALLOC_DS_ARRAY(_tpl_op_t_, tpl->cap);
+
+    compile(tpl);
+
+    return tpl;
+}
+
+/**
+ * @brief Free a template.
+ *
+ * @param tpl
+ */
+void destroy_template(Template* tpl) {
+
+    if(tpl != NULL) {
+        for(int i = 0; i < tpl->len; i++)
+            destroy_string(tpl->ops[i].name);
+        _FREE(tpl->ops);
+        destroy_string(tpl->name);
+        destroy_string(tpl->text);
+        _FREE(tpl);
+    }
+}
+
+/**
+ * @brief Render the template with the data and add the text to the end of
+ * the string.
+ *
+ * @param tpl
+ * @param data
+ * @param out
+ */
+void render_template(Template* tpl, TplData* data, String* out) {
+
+    render(tpl, 0, tpl->len, data, out);
+}
+
+/**
+ * @brief Create an empty set of values for a template.
+ *
+ * @return TplData*
+ */
+TplData* create_tpl_data(void) {
+
+    TplData* data = _ALLOC_DS(TplData);
+    data->names   = create_hashtable();
+    data->values  = create_ptr_lst();
+
+    return data;
+}
+
+/**
+ * @brief Free the values and all of the items in the lists.
+ *
+ * @param data
+ */
+void destroy_tpl_data(TplData* data) {
+
+    if(data != NULL) {
+        int mark = 0;
+        _tpl_value_t_* val;
+        while(NULL != (val = iterate_ptr_lst(data->values, &mark))) {
+            clear_value(val);
+            _FREE(val);
+        }
+        destroy_ptr_lst(data->values);
+        destroy_hashtable(data->names);
+        _FREE(data);
+    }
+}
+
+/**
+ * @brief Set a value to a copy of the string.
+ *
+ * @param data
+ * @param name
+ * @param value
+ */
+void set_tpl_str(TplData* data, const char* name, const char* value) {
+
+    _tpl_value_t_* val = get_value(data, name);
+    clear_value(val);
+    val->str = create_string(value);
+}
+
+/**
+ * @brief Set a value to a copy of the String.
+ *
+ * @param data
+ * @param name
+ * @param value
+ */
+void set_tpl_string(TplData* data, const char* name, String* value) {
+
+    _tpl_value_t_* val = get_value(data, name);
+    clear_value(val);
+    val->str = copy_string(value);
+}
+
+/**
+ * @brief Add an item to the end of the named list and return it so that its
+ * values can be set. The list is created if it does not exist.
+ *
+ * @param data
+ * @param list
+ * @return TplData*
+ */
+TplData* add_tpl_item(TplData* data, const char* list) {
+
+    _tpl_value_t_* val = get_value(data, list);
+    if(val->items == NULL) {
+        clear_value(val);
+        val->items = create_ptr_lst();
+    }
+
+    TplData* item = create_tpl_data();
+    item->parent  = data;
+    append_ptr_lst(val->items, item);
+
+    return item;
+}
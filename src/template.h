@@ -0,0 +1,32 @@
+/**
+ * @file template.h
+ *
+ * @brief Public interface to the output templates. A template is compiled
+ * one time into a list of operations and then rendered as many times as
+ * needed with different data.
+ *
+ * @author Chuck Tilbury (chucktilbury@gmail.com)
+ * @version 0.0
+ * @date 2024-08-19
+ * @copyright Copyright (c) 2024
+ *
+ */
+#ifndef _TEMPLATE_H_
+#define _TEMPLATE_H_
+
+#include "str.h"
+
+typedef struct _template_ Template;
+typedef struct _tpl_data_ TplData;
+
+Template* create_template(const char* name, const char* text);
+void destroy_template(Template* tpl);
+void render_template(Template* tpl, TplData* data, String* out);
+
+TplData* create_tpl_data(void);
+void destroy_tpl_data(TplData* data);
+void set_tpl_str(TplData* data, const char* name, const char* value);
+void set_tpl_string(TplData* data, const char* name, String* value);
+TplData* add_tpl_item(TplData* data, const char* list);
+
+#endif /* _TEMPLATE_H_ */
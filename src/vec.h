@@ -0,0 +1,75 @@
+/**
+ * @file vec.h
+ *
+ * @brief Typed lists that keep the first few items inside of the list
+ * itself. Most of the lists in a grammar are short, so most of them never
+ * allocate an array. The items are in the array that list points to, so
+ * they can be walked with a plain for loop.
+ *
+ *   VEC_TYPE(ElemVec, elem_vec, struct _ast_prod_elem_*, 4)
+ *
+ * makes the type ElemVec and the functions create_elem_vec(),
+ * destroy_elem_vec() and append_elem_vec(). The list must not be copied by
+ * value, because list can point into it.
+ *
+ * @author Chuck Tilbury (chucktilbury@gmail.com)
+ * @version 0.0
+ * @date 2024-08-21
+ * @copyright Copyright (c) 2024
+ *
+ */
+#ifndef _VEC_H_
+#define _VEC_H_
+
+#include <stddef.h>
+
+#include "memory.h"
+
+#define VEC_TYPE(name, prefix, type, n)                                            \
+    typedef struct {                                                               \
+        type* list;                                                                \
+        size_t len;                                                                \
+        size_t cap;                                                                \
+        type small[n];                                                             \
+    } name;                                                                        \
+                                                                                   \
+    static inline name* create_##prefix(void) {                                    \
+                                                                                   \
+        name* vec = _ALLOC_DS(name);                                               \
+        vec->list = vec->small;                                                    \
+        vec->cap  = (n);                                                           \
+                                                                                   \
+        return vec;                                                                \
+    }                                                                              \
+                                                                                   \
+    static inline void destroy_##prefix(name* vec) {                               \
+                                                                                   \
+        if(vec != NULL) {                                                          \
+            if(vec->list != vec->small)                                            \
+                _FREE(vec->list);                                                  \
+            _FREE(vec);                                                            \
+        }                                                                          \
+    }                                                                              \
+                                                                                   \
+    static inline void grow_##prefix(name* vec) {                                  \
+                                                                                   \
+        vec->cap <<= 1;                                                            \
+        if(vec->list == vec->small) {                                              \
+            vec->list = _ALLOC_DS_ARRAY(type, vec->cap);                           \
+            memcpy(vec->list, vec->small, sizeof(vec->small));                     \
+        }                                                                          \
+        else                                                                       \
+            vec->list = _REALLOC_DS_ARRAY(vec->list, type, vec->cap);              \
+    }                                                                              \
+                                                                                   \
+    static inline void append_##prefix(name* vec, type item) {                     \
+                                                                                   \
+        if(vec->len >= vec->cap)                                                   \
+            grow_##prefix(vec);                                                    \
+        vec->list[vec->len++] = item;                                              \
+    }
+
+// a list of numbers, such as rule or production numbers
+VEC_TYPE(IntVec, int_vec, int, 4)
+
+#endif /* _VEC_H_ */
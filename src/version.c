@@ -0,0 +1,32 @@
+/**
+ * @file version.c
+ *
+ * @brief The build id of pargen. When it is built with CMake, the id is a
+ * hash of the sources of the generator that build_id.cmake writes into
+ * build_id.h. Otherwise it is the time that this file was compiled, so every
+ * build is a new one.
+ *
+ * @author Chuck Tilbury (chucktilbury@gmail.com)
+ * @version 0.0
+ * @date 2024-08-21
+ * @copyright Copyright (c) 2024
+ *
+ */
+#include "version.h"
+
+#ifdef HAVE_BUILD_ID
+#include "build_id.h"
+#else
+#define PARGEN_BUILD_ID __DATE__ " " __TIME__
+#endif
+
+/**
+ * @brief Return the version and the build id. This is the same for every
+ * run of the same build of pargen.
+ *
+ * @return const char*
+ */
+const char* pargen_build_id(void) {
+
+    return PARGEN_VERSION " " PARGEN_BUILD_ID;
+}
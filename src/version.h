@@ -0,0 +1,22 @@
+/**
+ * @file version.h
+ *
+ * @brief Public interface to the version of pargen. The version is the one
+ * that is shown to the user. The build id changes every time that the
+ * generator itself changes, so the caches can tell what one build of pargen
+ * made from what another one made.
+ *
+ * @author Chuck Tilbury (chucktilbury@gmail.com)
+ * @version 0.0
+ * @date 2024-08-21
+ * @copyright Copyright (c) 2024
+ *
+ */
+#ifndef _VERSION_H_
+#define _VERSION_H_
+
+#define PARGEN_VERSION "0.0.0"
+
+const char* pargen_build_id(void);
+
+#endif /* _VERSION_H_ */
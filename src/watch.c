@@ -0,0 +1,241 @@
+/**
+ * @file watch.c
+ *
+ * @brief Implement the watch mode. This uses inotify to wait for the grammar
+ * files to change and then calls back to regenerate the outputs. The
+ * directory that holds a file is watched instead of the file itself because
+ * most editors save a file by writing a new one and renaming it, which would
+ * silently drop a watch on the original file.
+ *
+ * When an event arrives, the content of every file is hashed and compared to
+ * what was there the last time. If nothing actually changed, such as when a
+ * file is saved without edits, then nothing is regenerated.
+ *
+ * @author Chuck Tilbury (chucktilbury@gmail.com)
+ * @version 0.0
+ * @date 2024-08-12
+ * @copyright Copyright (c) 2024
+ *
+ */
+#define _POSIX_C_SOURCE 200809L
+#include <errno.h>
+#include <poll.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/inotify.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "hash.h"
+#include "memory.h"
+#include "ptr_lst.h"
+#include "str.h"
+#include "str_lst.h"
+#include "watch.h"
+
+// Time to wait for more events after the first one, in milliseconds. An
+// editor saving a file can create several events in quick succession.
+#define SETTLE_TIME 50
+
+#define EVENT_MASK (IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE | IN_DELETE)
+
+typedef struct {
+    String* name;  // name of the file as the scanner opened it
+    String* base;  // name of the file in the directory
+    uint64_t hash; // hash of the content the last time it was read
+    int exists;
+    int wd;
+} _watched_t_;
+
+static PtrLst* watched = NULL;
+static int ifd         = -1;
+
+/*
+ * Hash the content of a file. Returns zero if the file cannot be read, such
+ * as when an editor has deleted it in order to replace it.
+ */
+static int hash_file(const char* name, uint64_t* hash) {
+
+    String* buf = create_string_file(name);
+    if(buf == NULL)
+        return 0;
+
+    *hash = hash_bytes(buf->buffer, buf->length);
+    destroy_string(buf);
+
+    return 1;
+}
+
+static void clear_watched(void) {
+
+    if(watched != NULL) {
+        int mark = 0;
+        _watched_t_* ptr;
+        while(NULL != (ptr = iterate_ptr_lst(watched, &mark))) {
+            // a directory watched twice has the same descriptor
+            inotify_rm_watch(ifd, ptr->wd);
+            destroy_string(ptr->name);
+            destroy_string(ptr->base);
+            _FREE(ptr);
+        }
+        destroy_ptr_lst(watched);
+    }
+
+    watched = create_ptr_lst();
+}
+
+/*
+ * Replace the set of watched files with the ones that were read by the last
+ * regeneration and remember what they contain now.
+ */
+static void update_watched(StrLst* files) {
+
+    clear_watched();
+
+    int mark = 0;
+    String* str;
+
+    while(NULL != (str = iterate_str_lst(files, &mark))) {
+        const char* name = raw_string(str);
+        const char* base = strrchr(name, '/');
+        String* dir;
+
+        if(base != NULL) {
+            dir = create_string(NULL);
+            append_buffer(dir, (void*)name, (base - name) + 1);
+            base++;
+        }
+        else {
+            dir  = create_string(".");
+            base = name;
+        }
+
+        _watched_t_* ptr = _ALLOC_DS(_watched_t_);
+        ptr->name        = create_string(name);
+        ptr->base        = create_string(base);
+        ptr->exists      = hash_file(name, &ptr->hash);
+        ptr->wd          = inotify_add_watch(ifd, raw_string(dir), EVENT_MASK);
+        if(ptr->wd < 0)
+            fprintf(stderr, "Warning: cannot watch '%s': %s\n", raw_string(dir),
+                    strerror(errno));
+
+        append_ptr_lst(watched, ptr);
+        destroy_string(dir);
+    }
+}
+
+/*
+ * Read all of the events that are waiting and return non-zero if any of
+ * them are for a watched file.
+ */
+static int read_events(void) {
+
+    char buf[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+    int retv = 0;
+    ssize_t len;
+
+    while(0 < (len = read(ifd, buf, sizeof(buf)))) {
+        for(char* ptr = buf; ptr < buf + len;) {
+            struct inotify_event* event = (struct inotify_event*)ptr;
+
+            if(event->len > 0) {
+                int mark = 0;
+                _watched_t_* w;
+                while(NULL != (w = iterate_ptr_lst(watched, &mark))) {
+                    if(w->wd == event->wd && !comp_string_str(w->base, event->name))
+                        retv = 1;
+                }
+            }
+            ptr += sizeof(struct inotify_event) + event->len;
+        }
+    }
+
+    return retv;
+}
+
+/*
+ * Return non-zero if the content of any watched file is different from the
+ * last time it was read. If a file that was there is missing, then return
+ * zero because it is probably in the middle of being replaced. A file that
+ * was missing, like an include that was not written yet, changed when it
+ * shows up.
+ */
+static int content_changed(void) {
+
+    int mark = 0;
+    int retv = 0;
+    _watched_t_* ptr;
+    uint64_t hash;
+
+    while(NULL != (ptr = iterate_ptr_lst(watched, &mark))) {
+        int exists = hash_file(raw_string(ptr->name), &hash);
+        if(!exists && ptr->exists)
+            return 0;
+        if(exists && (!ptr->exists || hash != ptr->hash))
+            retv = 1;
+    }
+
+    return retv;
+}
+
+static double elapsed_ms(struct timespec* start) {
+
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return (now.tv_sec - start->tv_sec) * 1000.0 + (now.tv_nsec - start->tv_nsec) / 1.0e6;
+}
+
+static void regenerate(WatchRegenFunc regen, WatchFilesFunc files) {
+
+    struct timespec start;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    int errors = (*regen)();
+    double ms  = elapsed_ms(&start);
+
+    if(errors == 0)
+        printf("watch: regenerated in %.1f ms\n", ms);
+    else
+        printf("watch: %d error(s) in %.1f ms, outputs not changed\n", errors, ms);
+    fflush(stdout);
+
+    update_watched((*files)());
+}
+
+/**
+ * @brief Generate the outputs and then regenerate them every time one of the
+ * input files changes. This does not return.
+ *
+ * @param regen
+ * @param files
+ */
+void watch_grammar(WatchRegenFunc regen, WatchFilesFunc files) {
+
+    ifd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if(ifd < 0) {
+        fprintf(stderr, "Fatal error: cannot start watching files: %s\n", strerror(errno));
+        exit(1);
+    }
+
+    regenerate(regen, files);
+
+    struct pollfd pfd = { .fd = ifd, .events = POLLIN };
+
+    while(1) {
+        if(poll(&pfd, 1, -1) <= 0)
+            continue;
+
+        if(!read_events())
+            continue;
+
+        // let the editor finish what it is doing
+        while(poll(&pfd, 1, SETTLE_TIME) > 0)
+            read_events();
+
+        if(content_changed())
+            regenerate(regen, files);
+    }
+}
@@ -0,0 +1,25 @@
+/**
+ * @file watch.h
+ *
+ * @brief Public interface to the watch mode. The grammar files are watched
+ * and the outputs are regenerated when they change.
+ *
+ * @author Chuck Tilbury (chucktilbury@gmail.com)
+ * @version 0.0
+ * @date 2024-08-12
+ * @copyright Copyright (c) 2024
+ *
+ */
+#ifndef _WATCH_H_
+#define _WATCH_H_
+
+#include "str_lst.h"
+
+// Regenerate the outputs. Returns the number of errors.
+typedef int (*WatchRegenFunc)(void);
+// Return the list of files that the last regeneration read.
+typedef StrLst* (*WatchFilesFunc)(void);
+
+void watch_grammar(WatchRegenFunc regen, WatchFilesFunc files);
+
+#endif /* _WATCH_H_ */